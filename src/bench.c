@@ -0,0 +1,583 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE bench.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "fdupves.h"
+#include "util.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+/*
+ * fdupves-bench: microbenchmarks of the hash kernels and the cache.
+ * every case is run --repeat times, each run is timed as a whole
+ * and reported as ns per op.
+ * */
+
+typedef struct
+{
+  const gchar *name;
+
+  /* ops of one run */
+  gint64 ops;
+
+  /* not timed */
+  void (*setup) ();
+  void (*run) (gint64);
+  void (*teardown) ();
+} bench_case;
+
+typedef struct
+{
+  const gchar *name;
+  gint64 ops;
+  gint repeat;
+
+  gdouble mean_ns;
+  gdouble stddev_ns;
+  gdouble min_ns;
+  gdouble ops_per_sec;
+} bench_result;
+
+#define BENCH_PIXBUFS 16
+
+static struct
+{
+  GdkPixbuf *hash_pixbufs[BENCH_PIXBUFS];
+  GdkPixbuf *phash_pixbufs[BENCH_PIXBUFS];
+  GdkPixbuf *dhash_pixbufs[BENCH_PIXBUFS];
+  unsigned char *grays;
+
+  hash_t *hashs;
+
+  gchar *dir;
+  gchar *target;
+  gchar *cache_file;
+  GPtrArray *paths;
+  cache_t *cache;
+
+  /* keeps the results alive */
+  volatile guint64 sink;
+} bench[1];
+
+static gint bench_repeat = 5;
+static gint64 bench_entries = 1000000;
+static gint bench_scale = 1;
+static gboolean bench_json;
+static gchar *bench_filter;
+
+static GOptionEntry bench_entries_opt[] =
+  {
+    { "repeat", 'r', 0, G_OPTION_ARG_INT, &bench_repeat,
+      "Runs of every case", "N" },
+    { "entries", 'n', 0, G_OPTION_ARG_INT64, &bench_entries,
+      "Cache entries of the cache cases", "N" },
+    { "scale", 's', 0, G_OPTION_ARG_INT, &bench_scale,
+      "Multiply the ops of the kernel cases", "N" },
+    { "json", 0, 0, G_OPTION_ARG_NONE, &bench_json,
+      "Print the results as json", NULL },
+    { "filter", 'f', 0, G_OPTION_ARG_STRING, &bench_filter,
+      "Only run the cases with the name containing it", "TEXT" },
+    { NULL }
+  };
+
+static GdkPixbuf * bench_pixbuf_new (GRand *, int, int);
+static void bench_kernel_setup ();
+static void bench_kernel_teardown ();
+static void bench_run_hash (gint64);
+static void bench_run_phash (gint64);
+static void bench_run_dhash (gint64);
+static void bench_run_dct (gint64);
+static void bench_run_cmp (gint64);
+static void bench_paths_setup ();
+static void bench_paths_teardown ();
+static void bench_cache_empty ();
+static void bench_cache_full ();
+static void bench_cache_saved ();
+static void bench_cache_free ();
+static void bench_run_cache_set (gint64);
+static void bench_run_cache_get (gint64);
+static void bench_run_cache_save (gint64);
+static void bench_run_cache_load (gint64);
+static gboolean bench_case_run (const bench_case *, bench_result *);
+static void bench_print_text (const bench_result *);
+static void bench_print_json (GArray *);
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *err;
+  GArray *results;
+  bench_result result[1];
+  guint i;
+
+  bench_case cases[] =
+    {
+      { "pixbuf_hash", 200000,
+	bench_kernel_setup, bench_run_hash, bench_kernel_teardown },
+      { "pixbuf_phash", 20000,
+	bench_kernel_setup, bench_run_phash, bench_kernel_teardown },
+      { "pixbuf_dhash", 200000,
+	bench_kernel_setup, bench_run_dhash, bench_kernel_teardown },
+      { "buffer_dct", 20000,
+	bench_kernel_setup, bench_run_dct, bench_kernel_teardown },
+      { "hash_cmp", 10000000,
+	bench_kernel_setup, bench_run_cmp, bench_kernel_teardown },
+      { "cache_set", 0,
+	bench_cache_empty, bench_run_cache_set, bench_cache_free },
+      { "cache_get", 0,
+	bench_cache_full, bench_run_cache_get, bench_cache_free },
+      { "cache_save", 0,
+	bench_cache_full, bench_run_cache_save, bench_cache_free },
+      { "cache_load", 0,
+	bench_cache_saved, bench_run_cache_load, bench_cache_free },
+    };
+
+#if !GLIB_CHECK_VERSION(2, 32, 0)
+  g_thread_init (NULL);
+#endif
+
+  context = g_option_context_new ("- benchmark the fdupves kernels");
+  g_option_context_add_main_entries (context, bench_entries_opt, PACKAGE);
+  err = NULL;
+  if (!g_option_context_parse (context, &argc, &argv, &err))
+    {
+      g_printerr ("%s\n", err->message);
+      g_error_free (err);
+      g_option_context_free (context);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (bench_repeat < 1 || bench_entries < 1 || bench_scale < 1)
+    {
+      g_printerr ("--repeat, --entries and --scale must be positive\n");
+      return 1;
+    }
+
+  /* the defaults, not the user configuration */
+  ini_new ();
+
+  results = g_array_new (FALSE, FALSE, sizeof (bench_result));
+  for (i = 0; i < G_N_ELEMENTS (cases); ++ i)
+    {
+      if (bench_filter && strstr (cases[i].name, bench_filter) == NULL)
+	{
+	  continue;
+	}
+
+      if (cases[i].ops == 0)
+	{
+	  cases[i].ops = bench_entries;
+	  if (!bench->paths)
+	    {
+	      bench_paths_setup ();
+	    }
+	}
+      else
+	{
+	  cases[i].ops *= bench_scale;
+	}
+
+      if (bench_case_run (cases + i, result))
+	{
+	  g_array_append_val (results, result[0]);
+	  if (!bench_json)
+	    {
+	      bench_print_text (result);
+	    }
+	}
+    }
+
+  if (bench_json)
+    {
+      bench_print_json (results);
+    }
+
+  if (bench->paths)
+    {
+      bench_paths_teardown ();
+    }
+  g_array_free (results, TRUE);
+
+  return 0;
+}
+
+static gboolean
+bench_case_run (const bench_case *c, bench_result *result)
+{
+  gint64 start, end;
+  gdouble *ns, sum, var;
+  gint i;
+
+  ns = g_new (gdouble, bench_repeat);
+
+  for (i = 0; i < bench_repeat; ++ i)
+    {
+      if (c->setup)
+	{
+	  c->setup ();
+	}
+
+      start = g_get_monotonic_time ();
+      c->run (c->ops);
+      end = g_get_monotonic_time ();
+
+      if (c->teardown)
+	{
+	  c->teardown ();
+	}
+
+      ns[i] = (gdouble) (end - start) * 1000.0 / c->ops;
+    }
+
+  sum = 0;
+  result->min_ns = ns[0];
+  for (i = 0; i < bench_repeat; ++ i)
+    {
+      sum += ns[i];
+      if (ns[i] < result->min_ns)
+	{
+	  result->min_ns = ns[i];
+	}
+    }
+  result->mean_ns = sum / bench_repeat;
+
+  var = 0;
+  for (i = 0; i < bench_repeat; ++ i)
+    {
+      var += (ns[i] - result->mean_ns) * (ns[i] - result->mean_ns);
+    }
+  result->stddev_ns = bench_repeat > 1 ? sqrt (var / (bench_repeat - 1)) : 0;
+
+  result->name = c->name;
+  result->ops = c->ops;
+  result->repeat = bench_repeat;
+  result->ops_per_sec = result->mean_ns > 0 ? 1e9 / result->mean_ns : 0;
+
+  g_free (ns);
+
+  return TRUE;
+}
+
+static void
+bench_print_text (const bench_result *r)
+{
+  printf ("%-14s %10" G_GINT64_FORMAT " ops x%d  %12.1f ns/op  "
+	  "+-%5.1f%%  min %12.1f ns/op  %14.0f ops/s\n",
+	  r->name, r->ops, r->repeat, r->mean_ns,
+	  r->mean_ns > 0 ? r->stddev_ns * 100 / r->mean_ns : 0,
+	  r->min_ns, r->ops_per_sec);
+  fflush (stdout);
+}
+
+static void
+bench_print_json (GArray *results)
+{
+  const bench_result *r;
+  guint i;
+
+  printf ("{\"version\":\"%s.%s.%s\",\"benchmarks\":[",
+	  PROJECT_MAJOR, PROJECT_MINOR, PROJECT_PATCH);
+  for (i = 0; i < results->len; ++ i)
+    {
+      r = &g_array_index (results, bench_result, i);
+      printf ("%s{\"name\":\"%s\",\"ops\":%" G_GINT64_FORMAT ","
+	      "\"repeat\":%d,\"ns_per_op\":%.3f,\"stddev_ns\":%.3f,"
+	      "\"variance_ns2\":%.3f,\"min_ns\":%.3f,\"ops_per_sec\":%.1f}",
+	      i ? "," : "",
+	      r->name, r->ops, r->repeat, r->mean_ns, r->stddev_ns,
+	      r->stddev_ns * r->stddev_ns, r->min_ns, r->ops_per_sec);
+    }
+  printf ("]}\n");
+}
+
+/* kernels, on fixed pseudo random pictures */
+static GdkPixbuf *
+bench_pixbuf_new (GRand *rand, int width, int height)
+{
+  GdkPixbuf *pixbuf;
+  guchar *pixels;
+  int y, x, rowstride;
+
+  pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+  g_return_val_if_fail (pixbuf, NULL);
+
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  for (y = 0; y < height; ++ y)
+    {
+      for (x = 0; x < width * 3; ++ x)
+	{
+	  pixels[y * rowstride + x] = g_rand_int_range (rand, 0, 256);
+	}
+    }
+
+  return pixbuf;
+}
+
+static void
+bench_kernel_setup ()
+{
+  GRand *rand;
+  int i, j;
+
+  rand = g_rand_new_with_seed (0xfd);
+
+  for (i = 0; i < BENCH_PIXBUFS; ++ i)
+    {
+      bench->hash_pixbufs[i] = bench_pixbuf_new (rand, 8, 8);
+      bench->phash_pixbufs[i] = bench_pixbuf_new (rand, 32, 32);
+      bench->dhash_pixbufs[i] = bench_pixbuf_new (rand, 9, 8);
+    }
+
+  bench->grays = g_new (unsigned char, 32 * 32 * BENCH_PIXBUFS);
+  for (i = 0; i < 32 * 32 * BENCH_PIXBUFS; ++ i)
+    {
+      bench->grays[i] = g_rand_int_range (rand, 0, 256);
+    }
+
+  bench->hashs = g_new (hash_t, 0x10000);
+  for (i = 0; i < 0x10000; ++ i)
+    {
+      for (j = 0; j < FDUPVES_HASH_WORDS; ++ j)
+	{
+	  bench->hashs[i].w[j] = ((guint64) g_rand_int (rand) << 32)
+	    | g_rand_int (rand);
+	}
+      bench->hashs[i].valid = TRUE;
+    }
+
+  g_rand_free (rand);
+}
+
+static void
+bench_kernel_teardown ()
+{
+  int i;
+
+  for (i = 0; i < BENCH_PIXBUFS; ++ i)
+    {
+      g_object_unref (bench->hash_pixbufs[i]);
+      g_object_unref (bench->phash_pixbufs[i]);
+      g_object_unref (bench->dhash_pixbufs[i]);
+    }
+  g_free (bench->grays);
+  g_free (bench->hashs);
+}
+
+static void
+bench_run_hash (gint64 n)
+{
+  gint64 i;
+
+  for (i = 0; i < n; ++ i)
+    {
+      bench->sink ^= pixbuf_hash (bench->hash_pixbufs[i % BENCH_PIXBUFS]).w[0];
+    }
+}
+
+static void
+bench_run_phash (gint64 n)
+{
+  gint64 i;
+
+  for (i = 0; i < n; ++ i)
+    {
+      bench->sink ^= pixbuf_phash (bench->phash_pixbufs[i % BENCH_PIXBUFS]).w[0];
+    }
+}
+
+static void
+bench_run_dhash (gint64 n)
+{
+  gint64 i;
+
+  for (i = 0; i < n; ++ i)
+    {
+      bench->sink ^= pixbuf_dhash (bench->dhash_pixbufs[i % BENCH_PIXBUFS]).w[0];
+    }
+}
+
+static void
+bench_run_dct (gint64 n)
+{
+  unsigned char out[32 * 32];
+  gint64 i;
+
+  for (i = 0; i < n; ++ i)
+    {
+      buffer_dct (bench->grays + (i % BENCH_PIXBUFS) * 32 * 32,
+		  out, sizeof out);
+      bench->sink ^= out[i % sizeof out];
+    }
+}
+
+static void
+bench_run_cmp (gint64 n)
+{
+  gint64 i;
+  int sum;
+
+  sum = 0;
+  for (i = 0; i < n; ++ i)
+    {
+      sum += hash_cmp (bench->hashs + (i & 0xFFFF),
+		       bench->hashs + ((i * 7 + 1) & 0xFFFF));
+    }
+  bench->sink ^= sum;
+}
+
+/*
+ * cache cases. cache_load drops the entries of missing files, so all
+ * the paths name one real file, spelled differently: every bit of the
+ * index is a "./" or ".//" component.
+ * */
+static void
+bench_paths_setup ()
+{
+  GString *path;
+  gint64 i, bit;
+
+  bench->dir = g_dir_make_tmp ("fdupves-bench-XXXXXX", NULL);
+  g_return_if_fail (bench->dir);
+
+  bench->target = g_build_filename (bench->dir, "target.jpg", NULL);
+  g_file_set_contents (bench->target, "", 0, NULL);
+  bench->cache_file = g_build_filename (bench->dir, "cache", NULL);
+
+  bench->paths = g_ptr_array_new_with_free_func (g_free);
+  path = g_string_new (NULL);
+  for (i = 0; i < bench_entries; ++ i)
+    {
+      g_string_assign (path, bench->dir);
+      for (bit = 1; bit <= bench_entries; bit <<= 1)
+	{
+	  g_string_append (path, i & bit ? "/.//" : "/./");
+	}
+      g_string_append (path, "target.jpg");
+      g_ptr_array_add (bench->paths, g_strdup (path->str));
+    }
+  g_string_free (path, TRUE);
+}
+
+static void
+bench_paths_teardown ()
+{
+  g_unlink (bench->cache_file);
+  g_unlink (bench->target);
+  g_rmdir (bench->dir);
+  g_free (bench->cache_file);
+  g_free (bench->target);
+  g_free (bench->dir);
+  g_ptr_array_free (bench->paths, TRUE);
+  bench->paths = NULL;
+}
+
+static void
+bench_cache_empty ()
+{
+  /* an empty file, cache_new loads it */
+  g_file_set_contents (bench->cache_file, "", 0, NULL);
+  bench->cache = cache_new (bench->cache_file);
+}
+
+static void
+bench_cache_full ()
+{
+  bench_cache_empty ();
+  bench_run_cache_set (bench->paths->len);
+}
+
+static void
+bench_cache_saved ()
+{
+  bench_cache_full ();
+  cache_save (bench->cache, bench->cache_file);
+  bench_cache_free ();
+}
+
+static void
+bench_cache_free ()
+{
+  if (bench->cache)
+    {
+      if (g_cache == bench->cache)
+	{
+	  g_cache = NULL;
+	}
+      cache_free (bench->cache);
+      bench->cache = NULL;
+    }
+}
+
+static void
+bench_run_cache_set (gint64 n)
+{
+  hash_t h;
+  gint64 i;
+
+  memset (&h, 0, sizeof h);
+  h.valid = TRUE;
+  for (i = 0; i < n; ++ i)
+    {
+      h.w[0] = i + 1;
+      cache_set (bench->cache, g_ptr_array_index (bench->paths, i),
+		 0, FDUPVES_HASH_HASH, 64, h);
+    }
+}
+
+static void
+bench_run_cache_get (gint64 n)
+{
+  hash_t h;
+  gint64 i;
+
+  for (i = 0; i < n; ++ i)
+    {
+      if (cache_get (bench->cache, g_ptr_array_index (bench->paths, i),
+		     0, FDUPVES_HASH_HASH, 64, &h))
+	{
+	  bench->sink ^= h.w[0];
+	}
+    }
+}
+
+static void
+bench_run_cache_save (gint64 n)
+{
+  cache_save (bench->cache, bench->cache_file);
+}
+
+static void
+bench_run_cache_load (gint64 n)
+{
+  /* cache_new loads the file */
+  bench->cache = cache_new (bench->cache_file);
+}
@@ -25,6 +25,8 @@
  */
 
 #include "cache.h"
+#include "trace.h"
+#include "stats.h"
 
 #include <glib.h>
 #include <glib/gstdio.h>
@@ -36,14 +38,13 @@
 
 cache_t *g_cache;
 
+/* hash workers may share one cache */
+G_LOCK_DEFINE_STATIC (cache);
+
 #ifndef PATH_MAX
 #define PATH_MAX 4096
 #endif
 
-#ifdef WIN32
-#define strtouq _strtoui64
-#endif
-
 #ifndef FDUPVES_KEY_SEPS
 #define FDUPVES_KEY_SEPS "||||"
 #endif
@@ -81,58 +82,89 @@ split_key (const char *key, char *file, int *off, char *alg)
   strcpy (alg, p);
 }
 
-struct cache_s
+/*
+ * the files are slots of an open addressing table, probed linearly from
+ * the 64 bit hash of the path. the paths are packed in one arena, the
+ * hashes of a file are fixed size records chained from its slot, their
+ * bits/64 words are in one word array.
+ * */
+#define CACHE_SLOTS_MIN 64
+
+/* a file, key 0 is an empty slot */
+struct cache_slot
 {
-  gchar *file;
-
-  gint count;
-
-  GHashTable *table;
-
-  GStringChunk *chunk;
+  guint64 key;
+  /* offset of the path in paths */
+  guint32 path;
+  /* index + 1 of the first record, 0 for none */
+  guint32 first;
 };
 
-struct cache_value_node
+/* a hash of a file */
+struct cache_record
 {
-  int time;
-  int alg;
-  hash_t hash;
+  /* index of the first word in words */
+  guint32 word;
+  gint32 time;
+  gint16 alg;
+  gint16 bits;
+  /* index + 1 of the next record of the file */
+  guint32 next;
 };
 
-struct cache_value
+struct cache_s
 {
-  cache_t *cache;
   gchar *file;
-  GPtrArray *hashs;
-};
 
-static struct cache_value * cache_value_new (cache_t *, const char *);
-static gboolean cache_value_set (struct cache_value *, int, int, hash_t);
-static gboolean cache_value_get (struct cache_value *, int, int, hash_t *);
-static void cache_value_free (struct cache_value *);
+  /* power of 2 */
+  guint size;
+  guint count;
+  struct cache_slot *slots;
+
+  /* the NUL terminated paths */
+  GByteArray *paths;
 
-static gboolean write_hash (guint, struct cache_value *, FILE *);
-static gboolean read_hash (char *, int *, int *, hash_t *, FILE *);
+  GArray *records;
+  GArray *words;
+  /* index + 1 of the first released record */
+  guint32 unused;
+};
+
+static guint64 cache_key (const gchar *);
+static struct cache_slot * cache_find (cache_t *, const gchar *, guint64);
+static struct cache_slot * cache_insert (cache_t *, const gchar *, guint64);
+static void cache_grow (cache_t *);
+static void cache_delete (cache_t *, struct cache_slot *);
+static struct cache_record * cache_record_find (cache_t *,
+						struct cache_slot *,
+						int, int, int);
+static struct cache_record * cache_record_new (cache_t *,
+					       struct cache_slot *, int);
+
+#define CACHE_RECORD(cache, index) \
+  (&g_array_index ((cache)->records, struct cache_record, (index) - 1))
+#define CACHE_PATH(cache, slot) \
+  ((const gchar *) (cache)->paths->data + (slot)->path)
+#define CACHE_WORDS(cache, rec) \
+  (&g_array_index ((cache)->words, guint64, (rec)->word))
+
+static void cache_record_hash (cache_t *, struct cache_record *, hash_t *);
+static gboolean read_hash (char *, int *, int *, int *, hash_t *, FILE *);
 
 cache_t *
 cache_new (const gchar *file)
 {
   cache_t *cache;
 
-  cache = g_malloc (sizeof (cache_t));
+  cache = g_malloc0 (sizeof (cache_t));
   g_return_val_if_fail (cache, NULL);
 
-  cache->table = g_hash_table_new_full (g_str_hash,
-					g_str_equal,
-					NULL,
-					(GDestroyNotify) cache_value_free);
-  if (cache->table == NULL)
-    {
-      g_free (cache);
-      return NULL;
-    }
-
-  cache->chunk = g_string_chunk_new (PATH_MAX * 1024 * 10);
+  cache->file = g_strdup (file);
+  cache->size = CACHE_SLOTS_MIN;
+  cache->slots = g_new0 (struct cache_slot, cache->size);
+  cache->paths = g_byte_array_new ();
+  cache->records = g_array_new (FALSE, FALSE, sizeof (struct cache_record));
+  cache->words = g_array_new (FALSE, FALSE, sizeof (guint64));
 
   cache_load (cache, file);
 
@@ -147,8 +179,11 @@ cache_new (const gchar *file)
 void
 cache_free (cache_t *cache)
 {
-  g_string_chunk_free (cache->chunk);
-  g_hash_table_destroy (cache->table);
+  g_array_free (cache->words, TRUE);
+  g_array_free (cache->records, TRUE);
+  g_byte_array_free (cache->paths, TRUE);
+  g_free (cache->slots);
+  g_free (cache->file);
   g_free (cache);
 }
 
@@ -157,13 +192,15 @@ cache_load (cache_t *cache, const char *filename)
 {
   FILE *fp;
   gchar line[PATH_MAX], file[PATH_MAX];
-  int off, alg;
+  int off, alg, bits;
   hash_t value[1];
   gchar *localfile;
+  gint64 t;
 
   localfile = g_locale_from_utf8 (filename, -1, NULL, NULL, NULL);
   g_return_val_if_fail (localfile, FALSE);
 
+  t = trace_begin ();
   fp = fopen (localfile, "rb");
   if (fp == NULL)
     {
@@ -177,15 +214,16 @@ cache_load (cache_t *cache, const char *filename)
 
   alg = 0;
   off = 0;
-  while (read_hash (file, &off, &alg, value, fp))
+  while (read_hash (file, &off, &alg, &bits, value, fp))
     {
-      if (g_file_test (file, G_FILE_TEST_IS_REGULAR))
+      if (bits && g_file_test (file, G_FILE_TEST_IS_REGULAR))
 	{
-	  cache_set (cache, file, off, alg, *value);
+	  cache_set (cache, file, off, alg, bits, *value);
 	}
     }
 
   fclose (fp);
+  trace_end (t, "cache load", filename);
 
   g_free (localfile);
 
@@ -193,56 +231,94 @@ cache_load (cache_t *cache, const char *filename)
 }
 
 gboolean
-cache_has (cache_t *cache, const gchar *file, int off, int alg)
+cache_has (cache_t *cache, const gchar *file, int off, int alg, int bits)
 {
-  char buf[PATH_MAX];
-  gpointer v;
+  struct cache_slot *slot;
+  gboolean ret;
 
-  join_key (buf, sizeof buf, file, off, alg);
-  v = g_hash_table_lookup (cache->table, buf);
-  if (v == NULL)
+  ret = FALSE;
+  G_LOCK (cache);
+  slot = cache_find (cache, file, cache_key (file));
+  if (slot)
     {
-      return FALSE;
+      ret = cache_record_find (cache, slot, off, alg, bits) != NULL;
     }
-  return TRUE;
+  G_UNLOCK (cache);
+
+  return ret;
 }
 
 gboolean
-cache_get (cache_t *cache, const gchar *file, int off, int alg, hash_t *hp)
+cache_get (cache_t *cache, const gchar *file, int off, int alg, int bits,
+	   hash_t *hp)
 {
-  struct cache_value *value;
+  struct cache_slot *slot;
+  struct cache_record *rec;
   gboolean ret;
 
-  value = g_hash_table_lookup (cache->table, file);
-  if (value == NULL)
+  ret = FALSE;
+  G_LOCK (cache);
+  slot = cache_find (cache, file, cache_key (file));
+  if (slot)
     {
-      return FALSE;
+      rec = cache_record_find (cache, slot, off, alg, bits);
+      if (rec)
+	{
+	  cache_record_hash (cache, rec, hp);
+	  ret = TRUE;
+	}
     }
+  G_UNLOCK (cache);
+
+  stats_add (FD_STAT_CACHE (alg,
+			    ret ? FD_STAT_HIT :
+			    slot ? FD_STAT_STALE : FD_STAT_MISS), 1);
 
-  ret = cache_value_get (value, off, alg, hp);
   return ret;
 }
 
 gboolean
-cache_set (cache_t *cache, const gchar *file, int off, int alg, hash_t h)
+cache_set (cache_t *cache, const gchar *file, int off, int alg, int bits,
+	   hash_t h)
 {
-  struct cache_value *value;
-  gboolean ret;
+  return cache_set_n (cache, file, off, 1, &alg, &bits, &h);
+}
 
-  value = g_hash_table_lookup (cache->table, file);
-  if (value == NULL)
+/* the values of a file under one lock and one lookup */
+gboolean
+cache_set_n (cache_t *cache, const gchar *file, int off, int count,
+	     const int *algs, const int *bits, const hash_t *hashs)
+{
+  struct cache_slot *slot;
+  struct cache_record *rec;
+  guint64 key;
+  int i;
+
+  if (count <= 0)
     {
-      value = cache_value_new (cache, file);
-      if (value)
-	{
-	  g_hash_table_insert (cache->table, value->file, value);
-	}
+      return TRUE;
     }
 
-  g_return_val_if_fail (value, FALSE);
+  key = cache_key (file);
+  G_LOCK (cache);
+  slot = cache_find (cache, file, key);
+  if (slot == NULL)
+    {
+      slot = cache_insert (cache, file, key);
+    }
 
-  ret = cache_value_set (value, off, alg, h);
-  g_return_val_if_fail (ret, FALSE);
+  for (i = 0; i < count; ++ i)
+    {
+      rec = cache_record_find (cache, slot, off, algs[i], bits[i]);
+      if (rec == NULL)
+	{
+	  rec = cache_record_new (cache, slot, bits[i]);
+	  rec->time = off;
+	  rec->alg = algs[i];
+	}
+      memcpy (CACHE_WORDS (cache, rec), hashs[i].w, bits[i] / 8);
+    }
+  G_UNLOCK (cache);
 
   return TRUE;
 }
@@ -250,7 +326,15 @@ cache_set (cache_t *cache, const gchar *file, int off, int alg, hash_t h)
 gboolean
 cache_remove (cache_t *cache, const gchar *file)
 {
-  g_hash_table_remove (cache->table, file);
+  struct cache_slot *slot;
+
+  G_LOCK (cache);
+  slot = cache_find (cache, file, cache_key (file));
+  if (slot)
+    {
+      cache_delete (cache, slot);
+    }
+  G_UNLOCK (cache);
   return TRUE;
 }
 
@@ -260,6 +344,13 @@ cache_save (cache_t *cache, const gchar *file)
   FILE *fp;
   char *localfile;
   char *dirname;
+  char key[PATH_MAX], value[FDUPVES_HASH_WORDS * 24];
+  struct cache_slot *slot;
+  struct cache_record *rec;
+  hash_t h;
+  guint32 r;
+  guint i;
+  gint64 t;
 
   if (file == NULL)
     {
@@ -276,6 +367,7 @@ cache_save (cache_t *cache, const gchar *file)
       g_free (dirname);
     }
 
+  t = trace_begin ();
   fp = fopen (localfile, "wb");
   if (fp == NULL)
     {
@@ -286,34 +378,56 @@ cache_save (cache_t *cache, const gchar *file)
 
   fprintf (fp, "ver:%s-%s-%s\n", PROJECT_MAJOR, PROJECT_MINOR, PROJECT_PATCH);
 
-  g_hash_table_foreach (cache->table, (GHFunc) (write_hash), fp);
+  G_LOCK (cache);
+  for (i = 0; i < cache->size; ++ i)
+    {
+      slot = cache->slots + i;
+      for (r = slot->key ? slot->first : 0; r; r = rec->next)
+	{
+	  rec = CACHE_RECORD (cache, r);
+	  join_key (key, sizeof key, CACHE_PATH (cache, slot),
+		    rec->time, rec->alg);
+	  cache_record_hash (cache, rec, &h);
+	  fprintf (fp, "%s"FDUPVES_HASH_SEPS"%s\n", key,
+		   hash_to_string (&h, rec->bits, value, sizeof value));
+	}
+    }
+  G_UNLOCK (cache);
 
   fclose (fp);
+  trace_end (t, "cache save", file);
 
   g_free (localfile);
 
   return TRUE;
 }
 
-static gboolean
-write_hash (guint k, struct cache_value *value, FILE *fp)
+void
+cache_foreach (cache_t *cache, cache_foreach_func func, gpointer data)
 {
-  size_t i;
-  struct cache_value_node *n;
-  char key[PATH_MAX];
-
-  for (i = 0; i < value->hashs->len; ++ i)
+  struct cache_slot *slot;
+  struct cache_record *rec;
+  hash_t h;
+  guint32 r;
+  guint i;
+
+  G_LOCK (cache);
+  for (i = 0; i < cache->size; ++ i)
     {
-      n = g_ptr_array_index (value->hashs, i);
-      join_key (key, sizeof key, value->file, n->time, n->alg);
-      fprintf (fp, "%s"FDUPVES_HASH_SEPS"%llu\n", key, n->hash);
+      slot = cache->slots + i;
+      for (r = slot->key ? slot->first : 0; r; r = rec->next)
+	{
+	  rec = CACHE_RECORD (cache, r);
+	  cache_record_hash (cache, rec, &h);
+	  func (CACHE_PATH (cache, slot), rec->time, rec->alg, rec->bits, h,
+		data);
+	}
     }
-
-  return TRUE;
+  G_UNLOCK (cache);
 }
 
 static gboolean
-read_hash (char *file, int *off, int *alg, hash_t *h, FILE *fp)
+read_hash (char *file, int *off, int *alg, int *bits, hash_t *h, FILE *fp)
 {
   char buf[PATH_MAX * 2], algs[0x10], *p;
   size_t i;
@@ -329,7 +443,8 @@ read_hash (char *file, int *off, int *alg, hash_t *h, FILE *fp)
       return FALSE;
     }
 
-  *h = strtouq (p + 4, NULL, 10);
+  /* one word for 64 bits, a wider hash is its words joined by ',' */
+  *bits = hash_from_string (p + 4, h);
 
   *p = '\0';
   split_key (buf, file, off, algs);
@@ -346,72 +461,193 @@ read_hash (char *file, int *off, int *alg, hash_t *h, FILE *fp)
   return TRUE;
 }
 
-static struct cache_value *
-cache_value_new (cache_t *cache, const char *file)
+/* FNV-1a, 0 is kept for the empty slots */
+static guint64
+cache_key (const gchar *file)
+{
+  guint64 h;
+
+  h = G_GUINT64_CONSTANT (0xcbf29ce484222325);
+  for (; *file; ++ file)
+    {
+      h ^= (guchar) *file;
+      h *= G_GUINT64_CONSTANT (0x100000001b3);
+    }
+
+  return h ? h : 1;
+}
+
+static struct cache_slot *
+cache_find (cache_t *cache, const gchar *file, guint64 key)
+{
+  struct cache_slot *slot;
+  guint i, mask;
+
+  mask = cache->size - 1;
+  for (i = key & mask; cache->slots[i].key; i = (i + 1) & mask)
+    {
+      slot = cache->slots + i;
+      if (slot->key == key
+	  && strcmp (CACHE_PATH (cache, slot), file) == 0)
+	{
+	  return slot;
+	}
+    }
+
+  return NULL;
+}
+
+static struct cache_slot *
+cache_insert (cache_t *cache, const gchar *file, guint64 key)
 {
-  struct cache_value *value;
+  struct cache_slot *slot;
+  guint i, mask;
 
-  value = g_malloc (sizeof (struct cache_value));
-  g_return_val_if_fail (value, NULL);
+  /* at most 3/4 full, the probes stay short */
+  if ((cache->count + 1) * 4 > cache->size * 3)
+    {
+      cache_grow (cache);
+    }
+
+  mask = cache->size - 1;
+  for (i = key & mask; cache->slots[i].key; i = (i + 1) & mask)
+    ;
 
-  value->cache = cache;
-  value->file = g_string_chunk_insert_const (cache->chunk, file);
-  value->hashs = g_ptr_array_new_with_free_func (g_free);
+  slot = cache->slots + i;
+  slot->key = key;
+  slot->path = cache->paths->len;
+  slot->first = 0;
+  g_byte_array_append (cache->paths, (const guint8 *) file, strlen (file) + 1);
+  ++ cache->count;
 
-  return value;
+  return slot;
 }
 
-static gboolean
-cache_value_set (struct cache_value *value, int time, int alg, hash_t h)
+static void
+cache_grow (cache_t *cache)
 {
-  size_t i;
-  struct cache_value_node *n;
+  struct cache_slot *old;
+  guint i, j, size, mask;
+
+  old = cache->slots;
+  size = cache->size;
 
-  for (i = 0; i < value->hashs->len; ++ i)
+  cache->size = size * 2;
+  cache->slots = g_new0 (struct cache_slot, cache->size);
+  mask = cache->size - 1;
+  for (i = 0; i < size; ++ i)
     {
-      n = g_ptr_array_index (value->hashs, i);
-      if (n->time == time
-	  && n->alg == alg)
+      if (old[i].key)
 	{
-	  n->hash = h;
-	  return TRUE;
+	  for (j = old[i].key & mask; cache->slots[j].key; j = (j + 1) & mask)
+	    ;
+	  cache->slots[j] = old[i];
 	}
     }
 
-  n = g_malloc (sizeof (struct cache_value_node));
-  g_return_val_if_fail (n, FALSE);
+  g_free (old);
+}
 
-  n->time = time;
-  n->alg = alg;
-  n->hash = h;
-  g_ptr_array_add (value->hashs, n);
+/* the path bytes stay in the arena, the records are reused */
+static void
+cache_delete (cache_t *cache, struct cache_slot *slot)
+{
+  struct cache_record *rec;
+  guint32 r, next;
+  guint i, j, home, mask;
 
-  return TRUE;
+  for (r = slot->first; r; r = next)
+    {
+      rec = CACHE_RECORD (cache, r);
+      next = rec->next;
+      rec->next = cache->unused;
+      cache->unused = r;
+    }
+
+  /* shift the following slots of the probe back into the hole */
+  mask = cache->size - 1;
+  i = slot - cache->slots;
+  j = i;
+  for (;;)
+    {
+      cache->slots[i].key = 0;
+      for (;;)
+	{
+	  j = (j + 1) & mask;
+	  if (cache->slots[j].key == 0)
+	    {
+	      -- cache->count;
+	      return;
+	    }
+
+	  /* the slot may move only if its home is not in (i, j] */
+	  home = cache->slots[j].key & mask;
+	  if (i <= j ? (home <= i || home > j) : (home <= i && home > j))
+	    {
+	      break;
+	    }
+	}
+
+      cache->slots[i] = cache->slots[j];
+      i = j;
+    }
 }
 
-static gboolean
-cache_value_get (struct cache_value *value, int time, int alg, hash_t *hp)
+static struct cache_record *
+cache_record_find (cache_t *cache, struct cache_slot *slot,
+		   int time, int alg, int bits)
 {
-  size_t i;
-  struct cache_value_node *n;
+  struct cache_record *rec;
+  guint32 r;
 
-  for (i = 0; i < value->hashs->len; ++ i)
+  for (r = slot->first; r; r = rec->next)
     {
-      n = g_ptr_array_index (value->hashs, i);
-      if (n->time == time
-	  && n->alg == alg)
+      rec = CACHE_RECORD (cache, r);
+      if (rec->time == time && rec->alg == alg && rec->bits == bits)
 	{
-	  *hp = n->hash;
-	  return TRUE;
+	  return rec;
 	}
     }
 
-  return FALSE;
+  return NULL;
+}
+
+/*
+ * a new record at the head of the slot's chain. a released record is
+ * reused for a hash of its width, all the hashes of a scan have one.
+ * */
+static struct cache_record *
+cache_record_new (cache_t *cache, struct cache_slot *slot, int bits)
+{
+  struct cache_record *rec;
+  guint32 r;
+
+  if (cache->unused && CACHE_RECORD (cache, cache->unused)->bits == bits)
+    {
+      r = cache->unused;
+      cache->unused = CACHE_RECORD (cache, r)->next;
+      rec = CACHE_RECORD (cache, r);
+    }
+  else
+    {
+      g_array_set_size (cache->records, cache->records->len + 1);
+      r = cache->records->len;
+      rec = CACHE_RECORD (cache, r);
+      rec->word = cache->words->len;
+      rec->bits = bits;
+      g_array_set_size (cache->words, cache->words->len + bits / 64);
+    }
+
+  rec->next = slot->first;
+  slot->first = r;
+
+  return rec;
 }
 
 static void
-cache_value_free (struct cache_value *value)
+cache_record_hash (cache_t *cache, struct cache_record *rec, hash_t *hp)
 {
-  g_ptr_array_free (value->hashs, TRUE);
-  g_free (value);
+  memset (hp, 0, sizeof (hash_t));
+  memcpy (hp->w, CACHE_WORDS (cache, rec), rec->bits / 8);
+  hp->valid = TRUE;
 }
@@ -33,22 +33,33 @@
 
 typedef struct cache_s cache_t;
 
+/* file, seek, alg, bits, hash, data */
+typedef void (*cache_foreach_func) (const gchar *, int, int, int, hash_t,
+				    gpointer);
+
 cache_t * cache_new (const gchar *);
 
 gboolean cache_load (cache_t *, const gchar *);
 
 void cache_free (cache_t *);
 
-gboolean cache_has (cache_t *, const gchar *, int, int);
+/* file, seek, alg, bits */
+gboolean cache_has (cache_t *, const gchar *, int, int, int);
+
+gboolean cache_get (cache_t *, const gchar *, int, int, int, hash_t *);
 
-gboolean cache_get (cache_t *, const gchar *, int, int, hash_t *);
+gboolean cache_set (cache_t *, const gchar *, int, int, int, hash_t);
 
-gboolean cache_set (cache_t *, const gchar *, int, int, hash_t);
+/* file, seek, count, then the algs, bits and hashes of count values */
+gboolean cache_set_n (cache_t *, const gchar *, int, int,
+		      const int *, const int *, const hash_t *);
 
 gboolean cache_remove (cache_t *, const gchar *);
 
 gboolean cache_save (cache_t *, const gchar *);
 
+void cache_foreach (cache_t *, cache_foreach_func, gpointer);
+
 extern cache_t *g_cache;
 
 #endif
@@ -0,0 +1,315 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE cli.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "cli.h"
+#include "fdupves.h"
+#include "server.h"
+#include "cost.h"
+#include "stats.h"
+#include "metrics.h"
+#include "util.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef enum
+  {
+    CLI_FORMAT_TEXT,
+    CLI_FORMAT_JSON,
+  } cli_format;
+
+typedef struct
+{
+  cli_format format;
+
+  GArray *images;
+  GArray *videos;
+
+  gint found;
+} cli_t;
+
+static gboolean cli_scan;
+static gboolean cli_image;
+static gboolean cli_video;
+static gint cli_jobs;
+static gchar *cli_format_name;
+static gchar *cli_socket;
+static gchar *cli_trace;
+static gchar *cli_metrics;
+
+static GOptionEntry cli_entries[] =
+  {
+    { "scan", 0, 0, G_OPTION_ARG_NONE, &cli_scan,
+      "Scan the given directories without the GUI", NULL },
+    { "image", 0, 0, G_OPTION_ARG_NONE, &cli_image,
+      "Find duplicate images", NULL },
+    { "video", 0, 0, G_OPTION_ARG_NONE, &cli_video,
+      "Find duplicate videos", NULL },
+    { "jobs", 'j', 0, G_OPTION_ARG_INT, &cli_jobs,
+      "Number of hash threads", "N" },
+    { "format", 'f', 0, G_OPTION_ARG_STRING, &cli_format_name,
+      "Output format: text or json", "FORMAT" },
+    { "daemon", 0, 0, G_OPTION_ARG_FILENAME, &cli_socket,
+      "Serve duplicate queries on the UNIX socket, indexing the given directories", "SOCKET" },
+    { "trace", 0, 0, G_OPTION_ARG_FILENAME, &cli_trace,
+      "Save a chrome trace of the scan to FILE", "FILE" },
+    { "metrics", 0, 0, G_OPTION_ARG_STRING, &cli_metrics,
+      "Serve prometheus metrics of the scan on [HOST]:PORT or a UNIX socket", "ADDR" },
+    { NULL }
+  };
+
+static void cli_find_step_cb (const find_step *, cli_t *);
+static const gchar *cli_type_name (same_type);
+static void cli_print_stats (cli_t *);
+
+gboolean
+cli_is_headless (int argc, char *argv[])
+{
+  int i;
+
+  for (i = 1; i < argc; ++ i)
+    {
+      if (strcmp (argv[i], "--scan") == 0
+	  || strncmp (argv[i], "--daemon", 8) == 0)
+	{
+	  return TRUE;
+	}
+    }
+
+  return FALSE;
+}
+
+int
+cli_main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *err;
+  cli_t cli[1];
+  gchar **dirs;
+  int i, ret;
+  gboolean serving;
+
+  context = g_option_context_new (_ ("DIR... - find duplicate video/image files"));
+  g_option_context_add_main_entries (context, cli_entries, PACKAGE);
+
+  err = NULL;
+  if (!g_option_context_parse (context, &argc, &argv, &err))
+    {
+      g_printerr ("%s\n", err->message);
+      g_error_free (err);
+      g_option_context_free (context);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (argc < 2 && cli_socket == NULL)
+    {
+      g_printerr (_ ("No directory given to scan\n"));
+      return 1;
+    }
+
+  memset (cli, 0, sizeof cli);
+  if (cli_format_name == NULL
+      || g_ascii_strcasecmp (cli_format_name, "text") == 0)
+    {
+      cli->format = CLI_FORMAT_TEXT;
+    }
+  else if (g_ascii_strcasecmp (cli_format_name, "json") == 0)
+    {
+      cli->format = CLI_FORMAT_JSON;
+    }
+  else
+    {
+      g_printerr (_ ("Unknown output format: %s\n"), cli_format_name);
+      return 1;
+    }
+
+  /* the same as FDUPVES_TRACE=FILE */
+  if (cli_trace)
+    {
+      g_setenv ("FDUPVES_TRACE", cli_trace, TRUE);
+    }
+
+  fdupves_init (FD_USR_CONF_FILE);
+
+  if (cli_jobs > 0)
+    {
+      g_ini->jobs = cli_jobs;
+    }
+  if (cli_image || cli_video)
+    {
+      g_ini->proc_image = cli_image;
+      g_ini->proc_video = cli_video;
+    }
+
+  if (cli_socket)
+    {
+      dirs = g_new0 (gchar *, argc);
+      for (i = 1; i < argc; ++ i)
+	{
+	  dirs[i - 1] = g_strdup (argv[i]);
+	}
+
+      ret = server_run (cli_socket, dirs);
+      fdupves_shutdown ();
+
+      return ret == 0 ? 0 : 1;
+    }
+
+  cli->images = g_array_new (FALSE, FALSE, sizeof (fd_path_id));
+  cli->videos = g_array_new (FALSE, FALSE, sizeof (fd_path_id));
+
+  stats_reset ();
+  if (g_ini->cost_top > 0)
+    {
+      cost_start ();
+    }
+  if (cli_metrics)
+    {
+      g_free (g_ini->metrics_listen);
+      g_ini->metrics_listen = g_strdup (cli_metrics);
+    }
+  serving = g_ini->metrics_listen && g_ini->metrics_listen[0]
+    && metrics_start (g_ini->metrics_listen);
+
+  for (i = 1; i < argc; ++ i)
+    {
+      find_list (argv[i], cli->images, cli->videos);
+    }
+
+  if (g_ini->proc_image && cli->images->len > 0)
+    {
+      g_message (_ ("find %d images to process"), cli->images->len);
+      find_images (cli->images, (find_step_cb) cli_find_step_cb, cli);
+    }
+
+  if (g_ini->proc_video && cli->videos->len > 0)
+    {
+      g_message (_ ("find %d videos to process"), cli->videos->len);
+      find_videos (cli->videos, (find_step_cb) cli_find_step_cb, cli);
+    }
+
+  g_message (_ ("find %d pairs same files"), cli->found);
+  cli_print_stats (cli);
+
+  cost_finish (g_ini->cost_top, g_ini->cost_file);
+
+  stats_set_stage ("done");
+  if (serving)
+    {
+      metrics_stop ();
+    }
+
+  g_array_free (cli->images, TRUE);
+  g_array_free (cli->videos, TRUE);
+
+  fdupves_shutdown ();
+
+  return 0;
+}
+
+static void
+cli_find_step_cb (const find_step *step, cli_t *cli)
+{
+  gchar *apath, *bpath, *afile, *bfile;
+
+  if (!step->found)
+    {
+      return;
+    }
+
+  apath = path_dup (step->afile);
+  bpath = path_dup (step->bfile);
+  switch (cli->format)
+    {
+    case CLI_FORMAT_JSON:
+      afile = fd_json_quote (apath);
+      bfile = fd_json_quote (bpath);
+      fprintf (stdout, "{\"type\":\"%s\",\"files\":[%s,%s]}\n",
+	       cli_type_name (step->type), afile, bfile);
+      g_free (afile);
+      g_free (bfile);
+      break;
+
+    default:
+      fprintf (stdout, "%s\t%s\t%s\n",
+	       cli_type_name (step->type), apath, bpath);
+      break;
+    }
+  g_free (apath);
+  g_free (bpath);
+
+  /* stream the results, the scan may run for hours */
+  fflush (stdout);
+  ++ cli->found;
+}
+
+static const gchar *
+cli_type_name (same_type type)
+{
+  switch (type)
+    {
+    case FD_SAME_IMAGE:
+      return "image";
+
+    case FD_SAME_VIDEO_HEAD:
+      return "video-head";
+
+    case FD_SAME_VIDEO_TAIL:
+      return "video-tail";
+
+    default:
+      return "unknown";
+    }
+}
+
+static void
+cli_print_stats (cli_t *cli)
+{
+  gchar *text, **lines;
+  int i;
+
+  switch (cli->format)
+    {
+    case CLI_FORMAT_JSON:
+      text = stats_to_json ();
+      fprintf (stdout, "{\"stats\":%s}\n", text);
+      g_free (text);
+      break;
+
+    default:
+      text = stats_to_text ("\n");
+      lines = g_strsplit (text, "\n", -1);
+      for (i = 0; lines[i]; ++ i)
+	{
+	  g_message ("%s", lines[i]);
+	}
+      g_strfreev (lines);
+      g_free (text);
+      break;
+    }
+}
@@ -0,0 +1,543 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE corpus.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "util.h"
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+/*
+ * fdupves-corpus: writes a synthetic corpus with known duplicate groups.
+ *
+ * an image group is a generated picture and its resized, re-encoded,
+ * cropped and colour-shifted copies. a video group is a generated clip
+ * encoded at two bitrates and two sizes, and with its head or its tail
+ * cut. the distractors are single files. the groups are listed in
+ * truth.tsv as "group<TAB>type<TAB>path", the path relative to the
+ * corpus dir.
+ * */
+
+#define CORPUS_IMAGE_WIDTH 640
+#define CORPUS_IMAGE_HEIGHT 480
+
+#define CORPUS_VIDEO_FPS 10
+#define CORPUS_VIDEO_SECONDS 30
+#define CORPUS_VIDEO_CUT 5
+
+/* a smooth picture, from a few low frequency waves per channel */
+typedef struct
+{
+  gdouble fx[3], fy[3];
+  gdouble phase[3];
+  gdouble speed[3];
+} corpus_pattern;
+
+static gint corpus_images = 25;
+static gint corpus_videos = 4;
+static gint corpus_distractors = 8;
+static gint corpus_seed = 1;
+
+static GOptionEntry corpus_entries[] =
+  {
+    { "images", 'i', 0, G_OPTION_ARG_INT, &corpus_images,
+      "Image groups", "N" },
+    { "videos", 'v', 0, G_OPTION_ARG_INT, &corpus_videos,
+      "Video groups", "N" },
+    { "distractors", 'd', 0, G_OPTION_ARG_INT, &corpus_distractors,
+      "Single images and videos", "N" },
+    { "seed", 's', 0, G_OPTION_ARG_INT, &corpus_seed,
+      "Seed of the generator", "N" },
+    { NULL }
+  };
+
+static void corpus_pattern_new (GRand *, corpus_pattern *);
+static guchar corpus_pattern_at (const corpus_pattern *, int,
+				 gdouble, gdouble, gdouble);
+static GdkPixbuf * corpus_image_new (const corpus_pattern *, int, int);
+static gboolean corpus_image_save (GdkPixbuf *, const gchar *, const gchar *,
+				   const gchar *, FILE *, int);
+static GdkPixbuf * corpus_image_shift (GdkPixbuf *, int, int, int);
+static gboolean corpus_image_group (const gchar *, int, GRand *, FILE *, int);
+static gboolean corpus_video_write (const gchar *, const corpus_pattern *,
+				    int, int, int, int, int);
+static int corpus_video_encode (AVFormatContext *, AVCodecContext *,
+				AVStream *, AVFrame *, AVPacket *);
+static void corpus_video_frame (AVFrame *, const corpus_pattern *, int);
+static gboolean corpus_video_group (const gchar *, int, GRand *, FILE *, int);
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *err;
+  GRand *rand;
+  gchar *dir, *file;
+  FILE *truth;
+  int i, group;
+
+  context = g_option_context_new ("DIR - generate a duplicate media corpus");
+  g_option_context_add_main_entries (context, corpus_entries, PACKAGE);
+  err = NULL;
+  if (!g_option_context_parse (context, &argc, &argv, &err))
+    {
+      g_printerr ("%s\n", err->message);
+      g_error_free (err);
+      g_option_context_free (context);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (argc != 2)
+    {
+      g_printerr ("No corpus dir given\n");
+      return 1;
+    }
+
+  av_register_all ();
+
+  for (i = 0; i < 2; ++ i)
+    {
+      dir = g_build_filename (argv[1], i ? "videos" : "images", NULL);
+      if (g_mkdir_with_parents (dir, 0755) != 0)
+	{
+	  g_printerr ("Create dir: %s failed\n", dir);
+	  g_free (dir);
+	  return 1;
+	}
+      g_free (dir);
+    }
+
+  file = g_build_filename (argv[1], "truth.tsv", NULL);
+  truth = g_fopen (file, "w");
+  if (truth == NULL)
+    {
+      g_printerr ("Create: %s failed\n", file);
+      g_free (file);
+      return 1;
+    }
+  g_free (file);
+
+  rand = g_rand_new_with_seed (corpus_seed);
+
+  group = 0;
+  for (i = 0; i < corpus_images; ++ i)
+    {
+      corpus_image_group (argv[1], i, rand, truth, group ++);
+    }
+  for (i = 0; i < corpus_distractors; ++ i)
+    {
+      corpus_image_group (argv[1], corpus_images + i, rand, truth, -1 - i);
+    }
+  for (i = 0; i < corpus_videos; ++ i)
+    {
+      corpus_video_group (argv[1], i, rand, truth, group ++);
+    }
+  for (i = 0; i < corpus_distractors; ++ i)
+    {
+      corpus_video_group (argv[1], corpus_videos + i, rand, truth,
+			  -1 - corpus_distractors - i);
+    }
+
+  g_rand_free (rand);
+  fclose (truth);
+
+  return 0;
+}
+
+static void
+corpus_pattern_new (GRand *rand, corpus_pattern *pattern)
+{
+  int c;
+
+  for (c = 0; c < 3; ++ c)
+    {
+      pattern->fx[c] = g_rand_double_range (rand, 0.5, 3.0);
+      pattern->fy[c] = g_rand_double_range (rand, 0.5, 3.0);
+      pattern->phase[c] = g_rand_double_range (rand, 0, 2 * M_PI);
+      pattern->speed[c] = g_rand_double_range (rand, -0.2, 0.2);
+    }
+}
+
+/* u and v are in 0..1 across the picture, t is in seconds */
+static guchar
+corpus_pattern_at (const corpus_pattern *pattern, int c,
+		   gdouble u, gdouble v, gdouble t)
+{
+  gdouble s;
+
+  s = sin (2 * M_PI * (pattern->fx[c] * u + pattern->speed[c] * t)
+	   + pattern->phase[c])
+    * cos (2 * M_PI * pattern->fy[c] * v + pattern->phase[(c + 1) % 3]);
+
+  return (guchar) (128 + 120 * s);
+}
+
+static GdkPixbuf *
+corpus_image_new (const corpus_pattern *pattern, int width, int height)
+{
+  GdkPixbuf *pixbuf;
+  guchar *pixels, *p;
+  int x, y, c, rowstride;
+
+  pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+  g_return_val_if_fail (pixbuf, NULL);
+
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  for (y = 0; y < height; ++ y)
+    {
+      for (x = 0; x < width; ++ x)
+	{
+	  p = pixels + y * rowstride + x * 3;
+	  for (c = 0; c < 3; ++ c)
+	    {
+	      p[c] = corpus_pattern_at (pattern, c,
+					(gdouble) x / width,
+					(gdouble) y / height, 0);
+	    }
+	}
+    }
+
+  return pixbuf;
+}
+
+static gboolean
+corpus_image_save (GdkPixbuf *pixbuf, const gchar *dir, const gchar *name,
+		   const gchar *quality, FILE *truth, int group)
+{
+  gchar *file;
+  GError *err;
+
+  file = g_build_filename (dir, "images", name, NULL);
+
+  err = NULL;
+  if (quality)
+    {
+      gdk_pixbuf_save (pixbuf, file, "jpeg", &err, "quality", quality, NULL);
+    }
+  else
+    {
+      gdk_pixbuf_save (pixbuf, file, "png", &err, NULL);
+    }
+  g_free (file);
+  if (err)
+    {
+      g_printerr ("Save: %s failed: %s\n", name, err->message);
+      g_error_free (err);
+      return FALSE;
+    }
+
+  fprintf (truth, "%d\timage\timages/%s\n", group, name);
+
+  return TRUE;
+}
+
+static GdkPixbuf *
+corpus_image_shift (GdkPixbuf *pixbuf, int r, int g, int b)
+{
+  GdkPixbuf *shift;
+  guchar *pixels, *p;
+  int x, y, c, rowstride, d[3];
+
+  shift = gdk_pixbuf_copy (pixbuf);
+  g_return_val_if_fail (shift, NULL);
+
+  d[0] = r;
+  d[1] = g;
+  d[2] = b;
+  pixels = gdk_pixbuf_get_pixels (shift);
+  rowstride = gdk_pixbuf_get_rowstride (shift);
+  for (y = 0; y < gdk_pixbuf_get_height (shift); ++ y)
+    {
+      for (x = 0; x < gdk_pixbuf_get_width (shift); ++ x)
+	{
+	  p = pixels + y * rowstride + x * 3;
+	  for (c = 0; c < 3; ++ c)
+	    {
+	      p[c] = (guchar) CLAMP (p[c] + d[c], 0, 255);
+	    }
+	}
+    }
+
+  return shift;
+}
+
+static gboolean
+corpus_image_group (const gchar *dir, int index, GRand *rand,
+		    FILE *truth, int group)
+{
+  corpus_pattern pattern[1];
+  GdkPixbuf *base, *variant, *sub;
+  gchar name[0x40];
+  int w, h;
+
+  corpus_pattern_new (rand, pattern);
+  base = corpus_image_new (pattern, CORPUS_IMAGE_WIDTH, CORPUS_IMAGE_HEIGHT);
+  g_return_val_if_fail (base, FALSE);
+
+  g_snprintf (name, sizeof name, "img%04d.png", index);
+  corpus_image_save (base, dir, name, NULL, truth, group);
+  if (group < 0)
+    {
+      g_object_unref (base);
+      return TRUE;
+    }
+
+  /* resized */
+  variant = gdk_pixbuf_scale_simple (base,
+				     CORPUS_IMAGE_WIDTH / 2,
+				     CORPUS_IMAGE_HEIGHT / 2,
+				     GDK_INTERP_BILINEAR);
+  g_snprintf (name, sizeof name, "img%04d-small.jpg", index);
+  corpus_image_save (variant, dir, name, "90", truth, group);
+  g_object_unref (variant);
+
+  /* re-encoded */
+  g_snprintf (name, sizeof name, "img%04d-q30.jpg", index);
+  corpus_image_save (base, dir, name, "30", truth, group);
+
+  /* cropped, 5% of each side */
+  w = CORPUS_IMAGE_WIDTH / 20;
+  h = CORPUS_IMAGE_HEIGHT / 20;
+  sub = gdk_pixbuf_new_subpixbuf (base, w, h,
+				  CORPUS_IMAGE_WIDTH - 2 * w,
+				  CORPUS_IMAGE_HEIGHT - 2 * h);
+  variant = gdk_pixbuf_copy (sub);
+  g_object_unref (sub);
+  g_snprintf (name, sizeof name, "img%04d-crop.png", index);
+  corpus_image_save (variant, dir, name, NULL, truth, group);
+  g_object_unref (variant);
+
+  /* colour-shifted */
+  variant = corpus_image_shift (base, 24, 0, -24);
+  g_snprintf (name, sizeof name, "img%04d-shift.png", index);
+  corpus_image_save (variant, dir, name, NULL, truth, group);
+  g_object_unref (variant);
+
+  g_object_unref (base);
+
+  return TRUE;
+}
+
+static gboolean
+corpus_video_group (const gchar *dir, int index, GRand *rand,
+		    FILE *truth, int group)
+{
+  static const struct
+  {
+    const gchar *suffix;
+    int width, height;
+    int bitrate;
+    int first, last;
+  } variants[] =
+      {
+	{ "", 320, 240, 800000, 0, CORPUS_VIDEO_SECONDS },
+	{ "-lowrate", 320, 240, 100000, 0, CORPUS_VIDEO_SECONDS },
+	{ "-big", 640, 480, 1600000, 0, CORPUS_VIDEO_SECONDS },
+	{ "-head", 320, 240, 800000,
+	  CORPUS_VIDEO_CUT, CORPUS_VIDEO_SECONDS },
+	{ "-tail", 320, 240, 800000,
+	  0, CORPUS_VIDEO_SECONDS - CORPUS_VIDEO_CUT },
+      };
+  corpus_pattern pattern[1];
+  gchar name[0x40], *file;
+  int i, cnt;
+
+  corpus_pattern_new (rand, pattern);
+
+  cnt = group < 0 ? 1 : G_N_ELEMENTS (variants);
+  for (i = 0; i < cnt; ++ i)
+    {
+      g_snprintf (name, sizeof name, "vid%03d%s.mp4",
+		  index, variants[i].suffix);
+      file = g_build_filename (dir, "videos", name, NULL);
+      if (corpus_video_write (file, pattern,
+			      variants[i].width, variants[i].height,
+			      variants[i].bitrate,
+			      variants[i].first * CORPUS_VIDEO_FPS,
+			      variants[i].last * CORPUS_VIDEO_FPS))
+	{
+	  fprintf (truth, "%d\tvideo\tvideos/%s\n", group, name);
+	}
+      g_free (file);
+    }
+
+  return TRUE;
+}
+
+/* frames first..last-1 of the clip, as a mpeg4 mp4 */
+static gboolean
+corpus_video_write (const gchar *file, const corpus_pattern *pattern,
+		    int width, int height, int bitrate,
+		    int first, int last)
+{
+  AVFormatContext *oc;
+  AVCodec *codec;
+  AVCodecContext *ctx;
+  AVStream *st;
+  AVFrame *frame;
+  AVPacket *pkt;
+  int i, ret;
+
+  oc = NULL;
+  if (avformat_alloc_output_context2 (&oc, NULL, NULL, file) < 0)
+    {
+      g_printerr ("No muxer for: %s\n", file);
+      return FALSE;
+    }
+
+  codec = avcodec_find_encoder (AV_CODEC_ID_MPEG4);
+  st = avformat_new_stream (oc, NULL);
+  ctx = avcodec_alloc_context3 (codec);
+  if (codec == NULL || st == NULL || ctx == NULL)
+    {
+      g_printerr ("No mpeg4 encoder for: %s\n", file);
+      avcodec_free_context (&ctx);
+      avformat_free_context (oc);
+      return FALSE;
+    }
+
+  ctx->width = width;
+  ctx->height = height;
+  ctx->bit_rate = bitrate;
+  ctx->time_base.num = 1;
+  ctx->time_base.den = CORPUS_VIDEO_FPS;
+  ctx->gop_size = CORPUS_VIDEO_FPS;
+  ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+  if (oc->oformat->flags & AVFMT_GLOBALHEADER)
+    {
+      ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+  st->time_base = ctx->time_base;
+
+  frame = av_frame_alloc ();
+  pkt = av_packet_alloc ();
+  ret = -1;
+  if (frame == NULL || pkt == NULL
+      || avcodec_open2 (ctx, codec, NULL) < 0
+      || avcodec_parameters_from_context (st->codecpar, ctx) < 0
+      || avio_open (&oc->pb, file, AVIO_FLAG_WRITE) < 0)
+    {
+      g_printerr ("Open encoder for: %s failed\n", file);
+      goto out;
+    }
+
+  frame->format = ctx->pix_fmt;
+  frame->width = width;
+  frame->height = height;
+  if (av_frame_get_buffer (frame, 32) < 0
+      || avformat_write_header (oc, NULL) < 0)
+    {
+      g_printerr ("Write header of: %s failed\n", file);
+      avio_closep (&oc->pb);
+      goto out;
+    }
+
+  ret = 0;
+  for (i = first; i < last && ret >= 0; ++ i)
+    {
+      av_frame_make_writable (frame);
+      corpus_video_frame (frame, pattern, i);
+      frame->pts = i - first;
+      ret = corpus_video_encode (oc, ctx, st, frame, pkt);
+    }
+  /* flush */
+  if (ret >= 0)
+    {
+      ret = corpus_video_encode (oc, ctx, st, NULL, pkt);
+    }
+  av_write_trailer (oc);
+  avio_closep (&oc->pb);
+
+ out:
+  av_packet_free (&pkt);
+  av_frame_free (&frame);
+  avcodec_free_context (&ctx);
+  avformat_free_context (oc);
+
+  return ret >= 0;
+}
+
+static int
+corpus_video_encode (AVFormatContext *oc, AVCodecContext *ctx,
+		     AVStream *st, AVFrame *frame, AVPacket *pkt)
+{
+  int ret;
+
+  ret = avcodec_send_frame (ctx, frame);
+  while (ret >= 0)
+    {
+      ret = avcodec_receive_packet (ctx, pkt);
+      if (ret == AVERROR (EAGAIN) || ret == AVERROR_EOF)
+	{
+	  return 0;
+	}
+      else if (ret < 0)
+	{
+	  break;
+	}
+
+      av_packet_rescale_ts (pkt, ctx->time_base, st->time_base);
+      pkt->stream_index = st->index;
+      ret = av_interleaved_write_frame (oc, pkt);
+    }
+
+  return ret;
+}
+
+/* the pattern in yuv, channel 0 is Y, 1 and 2 are U and V */
+static void
+corpus_video_frame (AVFrame *frame, const corpus_pattern *pattern, int index)
+{
+  int x, y, c, w, h;
+  gdouble t;
+
+  t = (gdouble) index / CORPUS_VIDEO_FPS;
+  for (c = 0; c < 3; ++ c)
+    {
+      w = c ? frame->width / 2 : frame->width;
+      h = c ? frame->height / 2 : frame->height;
+      for (y = 0; y < h; ++ y)
+	{
+	  for (x = 0; x < w; ++ x)
+	    {
+	      frame->data[c][y * frame->linesize[c] + x] =
+		corpus_pattern_at (pattern, c,
+				   (gdouble) x / w, (gdouble) y / h, t);
+	    }
+	}
+    }
+}
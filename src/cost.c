@@ -0,0 +1,324 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE cost.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "cost.h"
+#include "util.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct
+{
+  const gchar *name;
+  gint64 usec;
+  gint64 bytes;
+  gint decodes;
+  gint files;
+} cost_sum;
+
+typedef struct
+{
+  gchar *file;
+
+  /* interned */
+  const gchar *codec;
+
+  gint64 usec;
+  gint64 bytes;
+  gint decodes;
+} cost_file;
+
+volatile gint g_cost_on;
+
+/* file -> cost_file */
+static GHashTable *cost_files;
+G_LOCK_DEFINE_STATIC (cost_files);
+
+static void cost_file_free (cost_file *);
+static gint cost_file_cmp (gconstpointer, gconstpointer);
+static gint cost_sum_cmp (gconstpointer, gconstpointer);
+static gboolean cost_sum_add (GHashTable *, const gchar *, const cost_file *);
+static void cost_sum_print (GString *, const gchar *, GHashTable *, gint64);
+
+void
+cost_add (const gchar *file, gint64 usec, gint64 bytes, gint decodes,
+	  const gchar *codec)
+{
+  cost_file *cf;
+  struct stat buf[1];
+
+  if (bytes < 0)
+    {
+      bytes = g_stat (file, buf) == 0 ? buf->st_size : 0;
+    }
+
+  G_LOCK (cost_files);
+  if (cost_files)
+    {
+      cf = g_hash_table_lookup (cost_files, file);
+      if (cf == NULL)
+	{
+	  cf = g_new0 (cost_file, 1);
+	  cf->file = g_strdup (file);
+	  g_hash_table_insert (cost_files, cf->file, cf);
+	}
+      cf->usec += usec;
+      cf->bytes += bytes;
+      cf->decodes += decodes;
+      if (codec)
+	{
+	  cf->codec = g_intern_string (codec);
+	}
+    }
+  G_UNLOCK (cost_files);
+}
+
+void
+cost_start ()
+{
+  G_LOCK (cost_files);
+  if (cost_files)
+    {
+      g_hash_table_remove_all (cost_files);
+    }
+  else
+    {
+      cost_files = g_hash_table_new_full (g_str_hash, g_str_equal,
+					  NULL,
+					  (GDestroyNotify) cost_file_free);
+    }
+  G_UNLOCK (cost_files);
+
+  g_atomic_int_set (&g_cost_on, TRUE);
+}
+
+gint64
+cost_total ()
+{
+  GHashTableIter iter;
+  gpointer value;
+  gint64 total;
+
+  total = 0;
+  G_LOCK (cost_files);
+  if (cost_files)
+    {
+      g_hash_table_iter_init (&iter, cost_files);
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+	{
+	  total += ((cost_file *) value)->usec;
+	}
+    }
+  G_UNLOCK (cost_files);
+
+  return total;
+}
+
+void
+cost_finish (gint top, const gchar *file)
+{
+  GPtrArray *files;
+  GHashTable *codecs, *exts;
+  GHashTableIter iter;
+  gpointer value;
+  cost_file *cf;
+  GString *report;
+  gchar **lines, *ext;
+  gint64 total;
+  guint i;
+
+  g_atomic_int_set (&g_cost_on, FALSE);
+
+  files = g_ptr_array_new ();
+  codecs = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+  exts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  total = 0;
+
+  G_LOCK (cost_files);
+  if (cost_files)
+    {
+      g_hash_table_iter_init (&iter, cost_files);
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+	{
+	  cf = (cost_file *) value;
+	  g_ptr_array_add (files, cf);
+	  total += cf->usec;
+
+	  cost_sum_add (codecs, cf->codec ? cf->codec : "image", cf);
+
+	  ext = strrchr (cf->file, '.');
+	  if (ext == NULL || strchr (ext, G_DIR_SEPARATOR))
+	    {
+	      ext = g_strdup ("(none)");
+	    }
+	  else
+	    {
+	      ext = g_ascii_strdown (ext, -1);
+	    }
+	  if (!cost_sum_add (exts, ext, cf))
+	    {
+	      g_free (ext);
+	    }
+	}
+    }
+
+  if (files->len == 0 || top <= 0)
+    {
+      G_UNLOCK (cost_files);
+      g_ptr_array_free (files, TRUE);
+      g_hash_table_destroy (codecs);
+      g_hash_table_destroy (exts);
+      return;
+    }
+
+  g_ptr_array_sort (files, cost_file_cmp);
+
+  report = g_string_new (NULL);
+  g_string_append_printf (report,
+			  _ ("%d slowest of %u files, %.1f s in total:\n"),
+			  MIN ((guint) top, files->len), files->len,
+			  total / 1e6);
+  for (i = 0; i < files->len && i < (guint) top; ++ i)
+    {
+      cf = g_ptr_array_index (files, i);
+      g_string_append_printf (report,
+			      "  %9.1f ms %9.1f MB %6d decodes  %-10s %s\n",
+			      cf->usec / 1e3, cf->bytes / 1048576.0,
+			      cf->decodes, cf->codec ? cf->codec : "image",
+			      cf->file);
+    }
+  G_UNLOCK (cost_files);
+
+  cost_sum_print (report, _ ("by codec:"), codecs, total);
+  cost_sum_print (report, _ ("by extension:"), exts, total);
+
+  lines = g_strsplit (report->str, "\n", -1);
+  for (i = 0; lines[i] && lines[i][0]; ++ i)
+    {
+      g_message ("%s", lines[i]);
+    }
+  g_strfreev (lines);
+
+  if (file && !g_file_set_contents (file, report->str, report->len, NULL))
+    {
+      g_warning (_ ("Save cost report: %s failed"), file);
+    }
+
+  g_string_free (report, TRUE);
+  g_ptr_array_free (files, TRUE);
+  g_hash_table_destroy (codecs);
+  g_hash_table_destroy (exts);
+}
+
+static void
+cost_file_free (cost_file *cf)
+{
+  g_free (cf->file);
+  g_free (cf);
+}
+
+/* slowest first */
+static gint
+cost_file_cmp (gconstpointer a, gconstpointer b)
+{
+  const cost_file *fa, *fb;
+
+  fa = *(const cost_file **) a;
+  fb = *(const cost_file **) b;
+
+  return fa->usec < fb->usec ? 1 : fa->usec > fb->usec ? -1 : 0;
+}
+
+static gint
+cost_sum_cmp (gconstpointer a, gconstpointer b)
+{
+  const cost_sum *sa, *sb;
+
+  sa = *(const cost_sum **) a;
+  sb = *(const cost_sum **) b;
+
+  return sa->usec < sb->usec ? 1 : sa->usec > sb->usec ? -1 : 0;
+}
+
+/* returns TRUE if the name is new, the table owns it then */
+static gboolean
+cost_sum_add (GHashTable *sums, const gchar *name, const cost_file *cf)
+{
+  cost_sum *sum;
+  gboolean added;
+
+  added = FALSE;
+  sum = g_hash_table_lookup (sums, name);
+  if (sum == NULL)
+    {
+      sum = g_new0 (cost_sum, 1);
+      sum->name = name;
+      g_hash_table_insert (sums, (gpointer) name, sum);
+      added = TRUE;
+    }
+
+  sum->usec += cf->usec;
+  sum->bytes += cf->bytes;
+  sum->decodes += cf->decodes;
+  ++ sum->files;
+
+  return added;
+}
+
+static void
+cost_sum_print (GString *report, const gchar *title, GHashTable *sums,
+		gint64 total)
+{
+  GPtrArray *list;
+  GHashTableIter iter;
+  gpointer value;
+  const cost_sum *sum;
+  guint i;
+
+  list = g_ptr_array_new ();
+  g_hash_table_iter_init (&iter, sums);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      g_ptr_array_add (list, value);
+    }
+  g_ptr_array_sort (list, cost_sum_cmp);
+
+  g_string_append_printf (report, "%s\n", title);
+  for (i = 0; i < list->len; ++ i)
+    {
+      sum = g_ptr_array_index (list, i);
+      g_string_append_printf (report,
+			      "  %-10s %6d files %9.1f s %5.1f%% "
+			      "%9.1f MB %8d decodes\n",
+			      sum->name, sum->files, sum->usec / 1e6,
+			      total ? 100.0 * sum->usec / total : 0,
+			      sum->bytes / 1048576.0, sum->decodes);
+    }
+
+  g_ptr_array_free (list, TRUE);
+}
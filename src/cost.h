@@ -0,0 +1,70 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE cost.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_COST_H_
+#define _FDUPVES_COST_H_
+
+#include <glib.h>
+
+/*
+ * per-file cost of a scan: wall time, bytes read and decode calls of
+ * the image loads, video probes and screenshots.
+ *
+ *   gint64 c;
+ *   c = cost_begin ();
+ *   ...
+ *   cost_end (c, file, bytes, decodes, codec);
+ *
+ * bytes -1 is the size of the file, codec NULL an image.
+ * */
+extern volatile gint g_cost_on;
+
+#define cost_begin() \
+  (G_UNLIKELY (g_cost_on) ? g_get_monotonic_time () : 0)
+
+#define cost_end(start, file, bytes, decodes, codec) G_STMT_START {	\
+    if (G_UNLIKELY (start))						\
+      {									\
+	cost_add ((file), g_get_monotonic_time () - (start),		\
+		  (bytes), (decodes), (codec));				\
+      }									\
+  } G_STMT_END
+
+void cost_add (const gchar *, gint64, gint64, gint, const gchar *);
+
+/* forget the last scan and collect */
+void cost_start ();
+
+/* the time of all the files collected so far, usec */
+gint64 cost_total ();
+
+/*
+ * stop collecting, log the top slowest files and the per-codec and
+ * per-extension totals, and save them to the file if not NULL.
+ * */
+void cost_finish (gint, const gchar *);
+
+#endif
@@ -0,0 +1,243 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE dhash.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "hash.h"
+#include "util.h"
+#include "video.h"
+#include "image.h"
+#include "cache.h"
+#include "trace.h"
+#include "stats.h"
+
+#include <glib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * the difference hash: the luma of (cols + 1) x rows pixels, a bit is
+ * set where a pixel is brighter than its right neighbour. it costs a
+ * aHash and does not move with the gamma or the brightness.
+ * */
+#define FDUPVES_DHASH_STRIDE 17
+
+static void dhash_grays (GdkPixbuf *, guchar *);
+static void dhash_rows (const guchar *, int, int, hash_t *);
+
+hash_t
+file_dhash (const char *file)
+{
+  hash_t hashs[FDUPVES_HASH_ALGS_CNT];
+
+  /* the cache key has one producer, see file_hashes */
+  file_hashes (file, 1u << FDUPVES_HASH_DHASH, hashs);
+
+  return hashs[FDUPVES_HASH_DHASH];
+}
+
+hash_t
+buffer_dhash (const char *buffer, int size)
+{
+  GdkPixbuf *buf;
+  GError *err;
+  hash_t h;
+  int cols, rows;
+
+  memset (&h, 0, sizeof h);
+  hash_grid (hash_bits (FDUPVES_HASH_DHASH), &cols, &rows);
+  g_return_val_if_fail (size >= (cols + 1) * rows * 3, h);
+
+  err = NULL;
+  buf = gdk_pixbuf_new_from_data ((const guchar *) buffer,
+				  GDK_COLORSPACE_RGB,
+				  FALSE,
+				  8,
+				  cols + 1,
+				  rows,
+				  (cols + 1) * 3,
+				  NULL,
+				  &err);
+  if (err)
+    {
+      g_warning ("Load inline data to pixbuf failed: %s", err->message);
+      g_error_free (err);
+      return h;
+    }
+
+  h = pixbuf_dhash (buf);
+  g_object_unref (buf);
+
+  return h;
+}
+
+hash_t
+video_time_dhash (const char *file, int time)
+{
+  hash_t h;
+  gchar buffer[FDUPVES_DHASH_STRIDE * 16 * 3];
+  gint64 t;
+  int bits, cols, rows;
+
+  bits = hash_bits (FDUPVES_HASH_DHASH);
+  if (g_cache)
+    {
+      if (cache_get (g_cache, file, time, FDUPVES_HASH_DHASH, bits, &h))
+	{
+	  return h;
+	}
+    }
+
+  hash_grid (bits, &cols, &rows);
+  video_time_screenshot (file, time, cols + 1, rows,
+			 buffer, (cols + 1) * rows * 3);
+
+  t = trace_begin ();
+  h = buffer_dhash (buffer, (cols + 1) * rows * 3);
+  trace_end (t, "dhash", file);
+  stats_add (FD_STAT_HASHES, 1);
+
+  if (g_cache)
+    {
+      if (!HASH_IS_NULL (h))
+	{
+	  cache_set (g_cache, file, time, FDUPVES_HASH_DHASH, bits, h);
+	}
+    }
+
+  return h;
+}
+
+/* the width of the hash is (width - 1) x height */
+hash_t
+pixbuf_dhash (GdkPixbuf *pixbuf)
+{
+  guchar grays[FDUPVES_DHASH_STRIDE * 16];
+  hash_t hash;
+  int cols, rows;
+
+  g_assert (gdk_pixbuf_get_colorspace (pixbuf) == GDK_COLORSPACE_RGB);
+  g_assert (gdk_pixbuf_get_bits_per_sample (pixbuf) == 8);
+
+  memset (&hash, 0, sizeof hash);
+  cols = gdk_pixbuf_get_width (pixbuf) - 1;
+  rows = gdk_pixbuf_get_height (pixbuf);
+  g_return_val_if_fail ((cols == 8 || cols == 16)
+			&& rows > 0 && rows <= 16
+			&& rows % (16 / cols) == 0, hash);
+
+  dhash_grays (pixbuf, grays);
+  dhash_rows (grays, cols, rows, &hash);
+  /* all 0 is a valid dhash, of a flat image */
+  hash.valid = TRUE;
+
+  return hash;
+}
+
+/* the rows are FDUPVES_DHASH_STRIDE apart */
+static void
+dhash_grays (GdkPixbuf *pixbuf, guchar *grays)
+{
+  int width, height, rowstride, n_channels, x, y;
+  guchar *pixels, *p;
+
+  n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+  width = gdk_pixbuf_get_width (pixbuf);
+  height = gdk_pixbuf_get_height (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+
+  for (y = 0; y < height; ++ y)
+    {
+      p = pixels + y * rowstride;
+      for (x = 0; x < width; ++ x, p += n_channels)
+	{
+	  grays[y * FDUPVES_DHASH_STRIDE + x] =
+	    (p[0] * 30 + p[1] * 59 + p[2] * 11) / 100;
+	}
+    }
+}
+
+/*
+ * 16 comparisons a step: one row of 16, or two rows of 8. the bytes
+ * are biased by 0x80 for the signed compare of sse2.
+ * */
+static void
+dhash_rows (const guchar *grays, int cols, int rows, hash_t *hash)
+{
+  const guchar *row;
+  guint mask;
+  int y, off;
+#ifdef __SSE2__
+  __m128i a, b, bias;
+
+  bias = _mm_set1_epi8 ((char) 0x80);
+#else
+  int x;
+#endif
+
+  for (y = 0; y < rows; y += 16 / cols)
+    {
+      row = grays + y * FDUPVES_DHASH_STRIDE;
+#ifdef __SSE2__
+      if (cols == 16)
+	{
+	  a = _mm_loadu_si128 ((const __m128i *) row);
+	  b = _mm_loadu_si128 ((const __m128i *) (row + 1));
+	}
+      else
+	{
+	  a = _mm_unpacklo_epi64 (_mm_loadl_epi64 ((const __m128i *) row),
+				  _mm_loadl_epi64 ((const __m128i *)
+						   (row + FDUPVES_DHASH_STRIDE)));
+	  b = _mm_unpacklo_epi64 (_mm_loadl_epi64 ((const __m128i *) (row + 1)),
+				  _mm_loadl_epi64 ((const __m128i *)
+						   (row + FDUPVES_DHASH_STRIDE + 1)));
+	}
+      a = _mm_xor_si128 (a, bias);
+      b = _mm_xor_si128 (b, bias);
+      mask = _mm_movemask_epi8 (_mm_cmpgt_epi8 (a, b));
+#else
+      mask = 0;
+      for (x = 0; x < 16; ++ x)
+	{
+	  if (cols == 8 && x == 8)
+	    {
+	      row += FDUPVES_DHASH_STRIDE - 8;
+	    }
+	  if (row[x] > row[x + 1])
+	    {
+	      mask |= 1u << x;
+	    }
+	}
+#endif
+
+      /* 16 bit steps never cross a word */
+      off = y * cols;
+      hash->w[off >> 6] |= (guint64) mask << (off & 63);
+    }
+}
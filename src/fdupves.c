@@ -0,0 +1,123 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE fdupves.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "fdupves.h"
+#include "trace.h"
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+
+#include <glib.h>
+
+#if LIBAVCODEC_VERSION_MAJOR < 58
+static int fdupves_av_lock (void **, enum AVLockOp);
+#endif
+
+gboolean
+fdupves_init (const gchar *conf)
+{
+  /* saved by fdupves_shutdown */
+  if (g_getenv ("FDUPVES_TRACE"))
+    {
+      trace_start ();
+    }
+
+  /* av format init */
+  av_register_all ();
+#if LIBAVCODEC_VERSION_MAJOR < 58
+  /* the jobs and the thumbnail workers open videos at once, the older
+     libavcodec needs a lock manager for that */
+  av_lockmgr_register (fdupves_av_lock);
+#endif
+
+  if (g_ini == NULL)
+    {
+      if (conf == NULL || ini_new_with_file (conf) == NULL)
+	{
+	  ini_new ();
+	}
+    }
+  g_return_val_if_fail (g_ini, FALSE);
+
+  if (g_cache == NULL)
+    {
+      cache_new (g_ini->cache_file);
+    }
+
+  return TRUE;
+}
+
+#if LIBAVCODEC_VERSION_MAJOR < 58
+static int
+fdupves_av_lock (void **mutex, enum AVLockOp op)
+{
+  switch (op)
+    {
+    case AV_LOCK_CREATE:
+#if GLIB_CHECK_VERSION(2, 32, 0)
+      *mutex = g_new (GMutex, 1);
+      g_mutex_init (*mutex);
+#else
+      *mutex = g_mutex_new ();
+#endif
+      break;
+    case AV_LOCK_OBTAIN:
+      g_mutex_lock (*mutex);
+      break;
+    case AV_LOCK_RELEASE:
+      g_mutex_unlock (*mutex);
+      break;
+    case AV_LOCK_DESTROY:
+#if GLIB_CHECK_VERSION(2, 32, 0)
+      g_mutex_clear (*mutex);
+      g_free (*mutex);
+#else
+      g_mutex_free (*mutex);
+#endif
+      *mutex = NULL;
+      break;
+    }
+
+  return 0;
+}
+#endif
+
+void
+fdupves_shutdown ()
+{
+  if (g_cache)
+    {
+      cache_save (g_cache, g_ini->cache_file);
+      cache_free (g_cache);
+      g_cache = NULL;
+    }
+
+  if (g_trace_on)
+    {
+      trace_stop ();
+      trace_save (g_getenv ("FDUPVES_TRACE"));
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE fdupves.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_FDUPVES_H_
+#define _FDUPVES_FDUPVES_H_
+
+#include "ini.h"
+#include "hash.h"
+#include "find.h"
+#include "cache.h"
+#include "video.h"
+#include "image.h"
+
+#include <glib.h>
+
+/*
+ * load the configuration file (defaults when it can't be read),
+ * register the ffmpeg formats and load the hash cache.
+ * the trace points are switched on when FDUPVES_TRACE names a file.
+ * */
+gboolean fdupves_init (const gchar *);
+
+/*
+ * save and free the hash cache, and save the trace.
+ * */
+void fdupves_shutdown ();
+
+#endif
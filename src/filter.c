@@ -0,0 +1,278 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE filter.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "filter.h"
+#include "util.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+struct _fd_filter
+{
+  /* entry => fd_path_id, entry => group id */
+  GArray *paths;
+  GArray *ids;
+
+  /* gram => GArray of entries, the grams are the trigrams, bigrams
+     and single bytes of the paths, see FILTER_KEY */
+  GHashTable *grams;
+
+  /* the last query and its matched entries */
+  gchar *last;
+  GArray *matches;
+};
+
+#define FILTER_GRAM(p) (((guint) (guchar) (p)[0] << 16)	\
+			| ((guint) (guchar) (p)[1] << 8)	\
+			| (guint) (guchar) (p)[2])
+
+/* the first n (1 to 3) bytes of p, the length in the high byte keeps
+   them apart */
+#define FILTER_KEY(p, n) ((n) == 3 ? FILTER_GRAM (p)			\
+			  : (n) == 2 ? (2u << 24				\
+					| ((guint) (guchar) (p)[0] << 8)	\
+					| (guint) (guchar) (p)[1])		\
+			  : (1u << 24 | (guint) (guchar) (p)[0]))
+
+static void filter_reset_last (fd_filter *);
+static void filter_post (fd_filter *, guint, guint);
+static void filter_posting_free (GArray *);
+static int filter_id_cmp (const void *, const void *);
+
+fd_filter *
+filter_new ()
+{
+  fd_filter *filter;
+
+  filter = g_malloc0 (sizeof (fd_filter));
+  g_return_val_if_fail (filter, NULL);
+
+  filter->paths = g_array_new (FALSE, FALSE, sizeof (fd_path_id));
+  filter->ids = g_array_new (FALSE, FALSE, sizeof (guint));
+  filter->grams = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					 NULL,
+					 (GDestroyNotify) filter_posting_free);
+
+  return filter;
+}
+
+void
+filter_free (fd_filter *filter)
+{
+  filter_reset_last (filter);
+  g_hash_table_destroy (filter->grams);
+  g_array_free (filter->ids, TRUE);
+  g_array_free (filter->paths, TRUE);
+  g_free (filter);
+}
+
+void
+filter_clear (fd_filter *filter)
+{
+  filter_reset_last (filter);
+  g_hash_table_remove_all (filter->grams);
+  g_array_set_size (filter->ids, 0);
+  g_array_set_size (filter->paths, 0);
+}
+
+void
+filter_add (fd_filter *filter, guint id, fd_path_id file)
+{
+  guint entry;
+  gchar path[PATH_MAX];
+  const gchar *p;
+
+  entry = filter->paths->len;
+  g_array_append_val (filter->paths, file);
+  g_array_append_val (filter->ids, id);
+
+  path_copy (file, path, sizeof path);
+  for (p = path; p[0]; ++ p)
+    {
+      filter_post (filter, FILTER_KEY (p, 1), entry);
+      if (p[1])
+	{
+	  filter_post (filter, FILTER_KEY (p, 2), entry);
+	  if (p[2])
+	    {
+	      filter_post (filter, FILTER_KEY (p, 3), entry);
+	    }
+	}
+    }
+
+  /* the cached matches miss the new entry */
+  filter_reset_last (filter);
+}
+
+GArray *
+filter_query (fd_filter *filter, const gchar *query)
+{
+  GArray *candidates, *posting, *matches, *ids;
+  guint i, n, entry, id;
+  gchar path[PATH_MAX];
+  const gchar *p;
+  gboolean all, exact;
+  gsize len;
+
+  if (query == NULL || *query == '\0')
+    {
+      filter_reset_last (filter);
+      return NULL;
+    }
+
+  candidates = NULL;
+  all = TRUE;
+
+  /* a query shorter than a trigram is a gram, its posting is the
+     answer */
+  len = strlen (query);
+  exact = len < 3;
+  if (exact)
+    {
+      candidates = g_hash_table_lookup (filter->grams,
+					GUINT_TO_POINTER (FILTER_KEY (query,
+								      len)));
+      all = FALSE;
+    }
+
+  /* the shortest posting list of the query trigrams */
+  for (p = query; !exact && p[0] && p[1] && p[2]; ++ p)
+    {
+      posting = g_hash_table_lookup (filter->grams,
+				     GUINT_TO_POINTER (FILTER_GRAM (p)));
+      if (posting == NULL)
+	{
+	  candidates = NULL;
+	  all = FALSE;
+	  break;
+	}
+      if (all || posting->len < candidates->len)
+	{
+	  candidates = posting;
+	  all = FALSE;
+	}
+    }
+
+  /* each match of an extended query is a match of the last one */
+  if (!exact && filter->last && strstr (query, filter->last)
+      && (all || (candidates && filter->matches->len < candidates->len)))
+    {
+      candidates = filter->matches;
+      all = FALSE;
+    }
+
+  n = all ? filter->paths->len : (candidates ? candidates->len : 0);
+  matches = g_array_new (FALSE, FALSE, sizeof (guint));
+  for (i = 0; i < n; ++ i)
+    {
+      entry = all ? i : g_array_index (candidates, guint, i);
+      if (exact)
+	{
+	  g_array_append_val (matches, entry);
+	  continue;
+	}
+      path_copy (g_array_index (filter->paths, fd_path_id, entry),
+		 path, sizeof path);
+      if (strstr (path, query))
+	{
+	  g_array_append_val (matches, entry);
+	}
+    }
+
+  ids = g_array_sized_new (FALSE, FALSE, sizeof (guint), matches->len);
+  for (i = 0; i < matches->len; ++ i)
+    {
+      id = g_array_index (filter->ids, guint,
+			  g_array_index (matches, guint, i));
+      g_array_append_val (ids, id);
+    }
+  if (ids->len > 1)
+    {
+      qsort (ids->data, ids->len, sizeof (guint), filter_id_cmp);
+      for (n = 1, i = 1; i < ids->len; ++ i)
+	{
+	  if (g_array_index (ids, guint, i) != g_array_index (ids, guint, n - 1))
+	    {
+	      g_array_index (ids, guint, n ++) = g_array_index (ids, guint, i);
+	    }
+	}
+      g_array_set_size (ids, n);
+    }
+
+  filter_reset_last (filter);
+  filter->last = g_strdup (query);
+  filter->matches = matches;
+
+  return ids;
+}
+
+static void
+filter_reset_last (fd_filter *filter)
+{
+  g_free (filter->last);
+  filter->last = NULL;
+  if (filter->matches)
+    {
+      g_array_free (filter->matches, TRUE);
+      filter->matches = NULL;
+    }
+}
+
+static void
+filter_post (fd_filter *filter, guint key, guint entry)
+{
+  GArray *posting;
+
+  posting = g_hash_table_lookup (filter->grams, GUINT_TO_POINTER (key));
+  if (posting == NULL)
+    {
+      posting = g_array_new (FALSE, FALSE, sizeof (guint));
+      g_hash_table_insert (filter->grams, GUINT_TO_POINTER (key), posting);
+    }
+  /* a gram repeated in the same path */
+  else if (g_array_index (posting, guint, posting->len - 1) == entry)
+    {
+      return;
+    }
+  g_array_append_val (posting, entry);
+}
+
+static void
+filter_posting_free (GArray *posting)
+{
+  g_array_free (posting, TRUE);
+}
+
+static int
+filter_id_cmp (const void *a, const void *b)
+{
+  guint x, y;
+
+  x = * (const guint *) a;
+  y = * (const guint *) b;
+
+  return x < y ? -1 : x > y;
+}
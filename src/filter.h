@@ -0,0 +1,55 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE filter.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_FILTER_H_
+#define _FDUPVES_FILTER_H_
+
+#include "path.h"
+
+#include <glib.h>
+
+/*
+ * substring index over the result paths, a path is added with the id
+ * of its group and a query answers the ids of the matched groups.
+ * the paths are not copied, they are read by path_copy.
+ * */
+typedef struct _fd_filter fd_filter;
+
+fd_filter * filter_new ();
+
+void filter_free (fd_filter *);
+
+void filter_clear (fd_filter *);
+
+void filter_add (fd_filter *, guint, fd_path_id);
+
+/*
+ * returns the sorted ids of the matched groups, NULL for an empty
+ * query. free it with g_array_free.
+ * */
+GArray * filter_query (fd_filter *, const gchar *);
+
+#endif
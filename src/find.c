@@ -29,6 +29,8 @@
 #include "video.h"
 #include "ini.h"
 #include "util.h"
+#include "trace.h"
+#include "stats.h"
 
 #include <string.h>
 
@@ -44,7 +46,7 @@ struct st_hash
 
 struct st_file
 {
-  const char *file;
+  fd_path_id file;
   int length;
   struct st_hash head[1];
   struct st_hash tail[1];
@@ -53,53 +55,200 @@ struct st_file
 struct st_find
 {
   GPtrArray *ptr[0x10];
-  find_step *step;
-  find_step_cb cb;
-  gpointer arg;
+  GArray *files;
+  hash_t *hashs;
+  /* the verify hashes, of the same decode as hashs */
+  hash_t *phashs;
+  int *lengths;
+};
+
+typedef void (*find_job_func) (gsize, struct st_find *);
+
+struct st_jobs
+{
+  find_job_func func;
+  struct st_find *find;
+  GAsyncQueue *done;
 };
 
-static void vfind_prepare (const gchar *, struct st_find *);
+static void find_list_dir (const gchar *, GArray *, GArray *);
+static void find_list_file (const gchar *, GArray *, GArray *);
+static void find_foreach (gsize, find_job_func, struct st_find *,
+			  find_step *, find_step_cb, gpointer);
+static void find_job_run (gpointer, struct st_jobs *);
+static void ifind_hash (gsize, struct st_find *);
+static void vfind_length (gsize, struct st_find *);
+static void vfind_prepare (gsize, struct st_find *);
 static int vfind_time_hash (struct st_file *, int, int);
 static void st_file_free (struct st_file *);
-static gboolean is_image_same (const gchar *, const gchar *);
+static gboolean is_image_same (struct st_find *, gsize, gsize);
 static gboolean is_video_same (struct st_file *, struct st_file *, gboolean);
 
+void
+find_list (const gchar *path, GArray *images, GArray *videos)
+{
+  gint64 t;
+
+  stats_set_stage ("walk");
+  t = trace_begin ();
+  if (g_file_test (path, G_FILE_TEST_IS_DIR))
+    {
+      find_list_dir (path, images, videos);
+    }
+  else if (g_file_test (path, G_FILE_TEST_IS_REGULAR))
+    {
+      find_list_file (path, images, videos);
+    }
+  trace_end (t, "walk", path);
+}
+
+static void
+find_list_dir (const gchar *path, GArray *images, GArray *videos)
+{
+  GQueue stack[1];
+  GDir *gdir;
+  GError *err;
+  gchar *dir, *curpath;
+  const gchar *cur;
+
+  g_queue_init (stack);
+  dir = g_strdup (path);
+  g_queue_push_tail (stack, dir);
+
+  while ((dir = g_queue_pop_tail (stack)) != NULL)
+    {
+      err = NULL;
+      gdir = g_dir_open (dir, 0, &err);
+      if (err)
+	{
+	  g_warning ("Can't open dir: %s: %s", dir, err->message);
+	  g_error_free (err);
+	  g_free (dir);
+	  continue;
+	}
+
+      while ((cur = g_dir_read_name (gdir)) != NULL)
+	{
+	  if (strcmp (cur, ".") == 0
+	      || strcmp (cur, "..") == 0)
+	    {
+	      continue;
+	    }
+
+	  curpath = g_build_filename (dir, cur, NULL);
+	  if (g_file_test (curpath, G_FILE_TEST_IS_DIR))
+	    {
+	      g_queue_push_tail (stack, curpath);
+	    }
+	  else
+	    {
+	      if (g_file_test (curpath, G_FILE_TEST_IS_REGULAR))
+		{
+		  find_list_file (curpath, images, videos);
+		}
+	      g_free (curpath);
+	    }
+	}
+
+      g_dir_close (gdir);
+      g_free (dir);
+    }
+}
+
+static void
+find_list_file (const gchar *path, GArray *images, GArray *videos)
+{
+  fd_path_id id;
+
+  if (is_image (path))
+    {
+      if (g_ini->proc_image)
+	{
+	  id = path_intern (path);
+	  g_array_append_val (images, id);
+	  stats_add (FD_STAT_IMAGES, 1);
+	}
+    }
+  else if (is_video (path))
+    {
+      if (g_ini->proc_video)
+	{
+	  id = path_intern (path);
+	  g_array_append_val (videos, id);
+	  stats_add (FD_STAT_VIDEOS, 1);
+	}
+    }
+  else
+    {
+      g_debug ("%s is not image/video, skipped", path);
+    }
+}
+
 int
-find_images (GPtrArray *ptr, find_step_cb cb, gpointer arg)
+find_images (GArray *ptr, find_step_cb cb, gpointer arg)
 {
   size_t i, j;
-  int dist, count;
-  hash_t *hashs;
+  int dist, count, bits, limit, v, orients;
+  hash_t *hashs, *orient;
+  hash_cmp_func cmp;
+  struct st_find find[1];
   find_step step[1];
+  gint64 t;
 
   count = 0;
 
+  if (ptr->len < 2)
+    {
+      return count;
+    }
+
   hashs = g_new0 (hash_t, ptr->len);
   g_return_val_if_fail (hashs, 0);
 
   step->found = FALSE;
   step->total = ptr->len;
   step->doing = _ ("Generate image hash value");
-  for (i = 0; i < ptr->len; ++ i)
-    {
-      hashs[i] = file_hash ((gchar *) g_ptr_array_index (ptr, i));
-      step->now = i;
-      cb (step, arg);
-    }
+
+  find->files = ptr;
+  find->hashs = hashs;
+  find->phashs = g_new0 (hash_t, ptr->len);
+  stats_set_stage ("image hash");
+  t = trace_begin ();
+  find_foreach (ptr->len, ifind_hash, find, step, cb, arg);
+  trace_end (t, "image hashes", NULL);
 
   step->doing = _ ("Compare image hash value");
   step->now = 0;
+  /* a loose screen, the candidates are verified by is_image_same */
+  bits = hash_bits (image_screen ());
+  cmp = hash_cmp_kernel (bits);
+  limit = hash_limit (bits, g_ini->screen_image_distance);
+  stats_set_stage ("image compare");
+  t = trace_begin ();
+
+  /* the rotations and flips of a file, made once for all its pairs */
+  orients = g_ini->phash_dihedral ? hash_orient_count (bits) : 1;
+  orient = g_new (hash_t, orients);
   for (i = 0; i < ptr->len - 1; ++ i)
     {
+      for (v = 1; v < orients; ++ v)
+	{
+	  orient[v] = hash_orient (hashs + i, bits, v);
+	}
+
       for (j = i + 1; j < ptr->len; ++ j)
 	{
-	  dist = hash_cmp (hashs[i], hashs[j]);
-	  if (dist < g_ini->same_image_distance)
+	  dist = cmp (hashs + i, hashs + j);
+	  for (v = 1; v < orients && dist >= limit; ++ v)
+	    {
+	      dist = cmp (orient + v, hashs + j);
+	    }
+	  if (dist < limit)
 	    {
-	      step->afile = g_ptr_array_index (ptr, i);
-	      step->bfile = g_ptr_array_index (ptr, j);
+	      step->afile = g_array_index (ptr, fd_path_id, i);
+	      step->bfile = g_array_index (ptr, fd_path_id, j);
 
-	      if (is_image_same (step->afile, step->bfile))
+	      if (is_image_same (find, i, j))
 		{
 		  step->found = TRUE;
 		  step->type = FD_SAME_IMAGE;
@@ -108,25 +257,31 @@ find_images (GPtrArray *ptr, find_step_cb cb, gpointer arg)
 		}
 	    }
 	}
+      stats_add (FD_STAT_PAIRS_COMPARED, ptr->len - 1 - i);
 
       step->now = i;
       step->found = FALSE;
       cb (step, arg);
     }
+  trace_end (t, "image compare", NULL);
 
+  g_free (orient);
   g_free (hashs);
+  g_free (find->phashs);
 
   return count;
 }
 
 int
-find_videos (GPtrArray *ptr, find_step_cb cb, gpointer arg)
+find_videos (GArray *ptr, find_step_cb cb, gpointer arg)
 {
   gsize i, j, g, group_cnt;
-  int dist, count;
+  int dist, count, bits, limit;
+  hash_cmp_func cmp;
   struct st_find find[1];
   struct st_file *afile, *bfile;
   find_step step[1];
+  gint64 t;
 
   count = 0;
 
@@ -141,12 +296,24 @@ find_videos (GPtrArray *ptr, find_step_cb cb, gpointer arg)
   step->now = 0;
   step->doing = _ ("Generate video screenshot hash value");
 
-  find->step = step;
-  find->cb = cb;
-  find->arg = arg;
-  g_ptr_array_foreach (ptr, (GFunc) vfind_prepare, find);
+  find->files = ptr;
+  find->lengths = g_new0 (int, ptr->len);
+  stats_set_stage ("video length");
+  t = trace_begin ();
+  find_foreach (ptr->len, vfind_length, find, step, cb, arg);
+  trace_end (t, "video lengths", NULL);
+  for (i = 0; i < ptr->len; ++ i)
+    {
+      vfind_prepare (i, find);
+    }
+  g_free (find->lengths);
 
   step->doing = _ ("Compare video screenshot hash value");
+  bits = hash_bits (FDUPVES_HASH_HASH);
+  cmp = hash_cmp_kernel (bits);
+  limit = hash_limit (bits, g_ini->same_video_distance);
+  stats_set_stage ("video compare");
+  t = trace_begin ();
   for (g = 0; g < group_cnt; ++ g)
     {
       if (find->ptr[g]->len <= 0)
@@ -161,21 +328,21 @@ find_videos (GPtrArray *ptr, find_step_cb cb, gpointer arg)
 	      afile = g_ptr_array_index (find->ptr[g], i);
 	      bfile = g_ptr_array_index (find->ptr[g], j);
 
-	      if (afile->head->hash == 0)
+	      if (HASH_IS_NULL (afile->head->hash))
 		{
 		  vfind_time_hash (afile,
 				   g_ini->video_timers[g][2],
 				   0);
 		}
-	      if (bfile->head->hash == 0)
+	      if (HASH_IS_NULL (bfile->head->hash))
 		{
 		  vfind_time_hash (bfile,
 				   g_ini->video_timers[g][2],
 				   0);
 		}
-	      dist = hash_cmp (afile->head->hash,
-			       bfile->head->hash);
-	      if (dist < g_ini->same_video_distance)
+	      stats_add (FD_STAT_PAIRS_COMPARED, 1);
+	      dist = cmp (&afile->head->hash, &bfile->head->hash);
+	      if (dist < limit)
 		{
 		  if (is_video_same (afile, bfile, FALSE))
 		    {
@@ -189,21 +356,20 @@ find_videos (GPtrArray *ptr, find_step_cb cb, gpointer arg)
 		    }
 		}
 
-	      if (afile->tail->hash == 0)
+	      if (HASH_IS_NULL (afile->tail->hash))
 		{
 		  vfind_time_hash (afile,
 				   afile->length - g_ini->video_timers[g][2],
 				   1);
 		}
-	      if (bfile->tail->hash == 0)
+	      if (HASH_IS_NULL (bfile->tail->hash))
 		{
 		  vfind_time_hash (bfile,
 				   bfile->length - g_ini->video_timers[g][2],
 				   1);
 		}
-	      dist = hash_cmp (afile->tail->hash,
-			       bfile->tail->hash);
-	      if (dist < g_ini->same_video_distance)
+	      dist = cmp (&afile->tail->hash, &bfile->tail->hash);
+	      if (dist < limit)
 		{
 		  if (is_video_same (afile, bfile, TRUE))
 		    {
@@ -225,10 +391,102 @@ find_videos (GPtrArray *ptr, find_step_cb cb, gpointer arg)
 
       g_ptr_array_free (find->ptr[g], TRUE);
     }
+  trace_end (t, "video compare", NULL);
 
   return count;
 }
 
+static void
+find_foreach (gsize count, find_job_func func, struct st_find *find,
+	      find_step *step, find_step_cb cb, gpointer arg)
+{
+  struct st_jobs jobs[1];
+  GThreadPool *pool;
+  gsize i;
+
+  stats_add (FD_STAT_JOBS_QUEUED, count);
+
+  pool = NULL;
+  if (g_ini->jobs > 1 && count > 1)
+    {
+      jobs->func = func;
+      jobs->find = find;
+      jobs->done = g_async_queue_new ();
+      pool = g_thread_pool_new ((GFunc) find_job_run, jobs,
+				g_ini->jobs, TRUE, NULL);
+      if (pool == NULL)
+	{
+	  g_async_queue_unref (jobs->done);
+	}
+    }
+
+  if (pool == NULL)
+    {
+      for (i = 0; i < count; ++ i)
+	{
+	  func (i, find);
+	  stats_add (FD_STAT_JOBS_QUEUED, -1);
+	  stats_add (FD_STAT_JOBS_DONE, 1);
+	  step->now = i;
+	  cb (step, arg);
+	}
+      return;
+    }
+
+  /* index is pushed with 1 offset, the pool does not accept NULL */
+  for (i = 0; i < count; ++ i)
+    {
+      g_thread_pool_push (pool, GSIZE_TO_POINTER (i + 1), NULL);
+    }
+
+  /* the callback is always called from the find thread */
+  for (i = 0; i < count; ++ i)
+    {
+      g_async_queue_pop (jobs->done);
+      step->now = i;
+      cb (step, arg);
+    }
+
+  g_thread_pool_free (pool, FALSE, TRUE);
+  g_async_queue_unref (jobs->done);
+}
+
+static void
+find_job_run (gpointer index, struct st_jobs *jobs)
+{
+  jobs->func (GPOINTER_TO_SIZE (index) - 1, jobs->find);
+  stats_add (FD_STAT_JOBS_QUEUED, -1);
+  stats_add (FD_STAT_JOBS_DONE, 1);
+  g_async_queue_push (jobs->done, index);
+}
+
+static void
+ifind_hash (gsize index, struct st_find *find)
+{
+  gchar file[PATH_MAX];
+  hash_t hashs[FDUPVES_HASH_ALGS_CNT];
+  int screen;
+
+  path_copy (g_array_index (find->files, fd_path_id, index),
+	     file, sizeof file);
+
+  /* one decode for the screen and the verify hashes */
+  screen = image_screen ();
+  file_hashes (file, (1u << screen) | (1u << FDUPVES_HASH_PHASH), hashs);
+  find->hashs[index] = hashs[screen];
+  find->phashs[index] = hashs[FDUPVES_HASH_PHASH];
+}
+
+static void
+vfind_length (gsize index, struct st_find *find)
+{
+  gchar file[PATH_MAX];
+
+  path_copy (g_array_index (find->files, fd_path_id, index),
+	     file, sizeof file);
+  find->lengths[index] = video_get_length (file);
+}
+
 static void
 st_file_free (struct st_file *file)
 {
@@ -236,15 +494,20 @@ st_file_free (struct st_file *file)
 }
 
 static void
-vfind_prepare (const gchar *file, struct st_find *find)
+vfind_prepare (gsize index, struct st_find *find)
 {
   int i, length;
+  fd_path_id file;
+  gchar *path;
   struct st_file *stv;
 
-  length = video_get_length (file);
+  file = g_array_index (find->files, fd_path_id, index);
+  length = find->lengths[index];
   if (length <= 0)
     {
-      g_warning ("Can't get duration of %s", file);
+      path = path_dup (file);
+      g_warning ("Can't get duration of %s", path);
+      g_free (path);
       return;
     }
 
@@ -263,14 +526,45 @@ vfind_prepare (const gchar *file, struct st_find *find)
 
       g_ptr_array_add (find->ptr[i], stv);
     }
+}
 
-  ++ find->step->now;
-  find->cb (find->step, find->arg);
+/* the orientations of a dhash are not a permutation, dihedral takes ahash */
+int
+image_screen ()
+{
+  return g_ini->phash_dihedral ? FDUPVES_HASH_HASH : g_ini->image_screen;
+}
+
+int
+image_verify_distance (const hash_t *a, const hash_t *b)
+{
+  int bits;
+
+  bits = hash_bits (FDUPVES_HASH_PHASH);
+  if (g_ini->phash_dihedral)
+    {
+      return phash_cmp_dihedral (a, b, bits);
+    }
+
+  return hash_cmp_kernel (bits) (a, b);
 }
 
 static gboolean
-is_image_same (const gchar *afile, const gchar *bfile)
+is_image_same (struct st_find *find, gsize a, gsize b)
 {
+  int dist;
+
+  stats_add (FD_STAT_PAIRS_VERIFIED, 1);
+
+  dist = image_verify_distance (find->phashs + a, find->phashs + b);
+  if (dist >= hash_limit (hash_bits (FDUPVES_HASH_PHASH),
+			  g_ini->verify_image_distance))
+    {
+      return FALSE;
+    }
+
+  stats_add (FD_STAT_PAIRS_SAME, 1);
+
   return TRUE;
 }
 
@@ -278,8 +572,11 @@ static gboolean
 is_video_same (struct st_file *afile, struct st_file *bfile, gboolean tail)
 {
   int seeka[FD_VIDEO_COMP_CNT], seekb[FD_VIDEO_COMP_CNT];
-  int i, rate, length;
+  int i, rate, length, bits;
   hash_t hasha, hashb;
+  gchar apath[PATH_MAX], bpath[PATH_MAX];
+
+  stats_add (FD_STAT_PAIRS_VERIFIED, 1);
 
   if (tail)
     {
@@ -304,31 +601,40 @@ is_video_same (struct st_file *afile, struct st_file *bfile, gboolean tail)
 	}
     }
 
+  path_copy (afile->file, apath, sizeof apath);
+  path_copy (bfile->file, bpath, sizeof bpath);
+  bits = hash_bits (FDUPVES_HASH_HASH);
   for (i = 0; i < FD_VIDEO_COMP_CNT; ++ i)
     {
-      hasha = video_time_hash (afile->file, seeka[i]);
-      hashb = video_time_hash (bfile->file, seekb[i]);
-      if (hash_cmp (hasha, hashb) >= g_ini->same_video_distance)
+      hasha = video_time_hash (apath, seeka[i]);
+      hashb = video_time_hash (bpath, seekb[i]);
+      if (hash_cmp_kernel (bits) (&hasha, &hashb)
+	  >= hash_limit (bits, g_ini->same_video_distance))
 	{
 	  return FALSE;
 	}
     }
 
+  stats_add (FD_STAT_PAIRS_SAME, 1);
+
   return TRUE;
 }
 
 static int
 vfind_time_hash (struct st_file *file, int seek, int tail)
 {
+  gchar path[PATH_MAX];
+
+  path_copy (file->file, path, sizeof path);
   if (tail)
     {
       file->tail->seek = seek;
-      file->tail->hash = video_time_hash (file->file, seek);
+      file->tail->hash = video_time_hash (path, seek);
     }
   else
     {
       file->head->seek = seek;
-      file->head->hash = video_time_hash (file->file, seek);
+      file->head->hash = video_time_hash (path, seek);
     }
 
   return 0;
@@ -27,6 +27,9 @@
 #ifndef _FDUPVES_FIND_H_
 #define _FDUPVES_FIND_H_
 
+#include "path.h"
+#include "hash.h"
+
 #include <glib.h>
 
 typedef enum
@@ -43,14 +46,26 @@ typedef struct
   const gchar *doing;
   gboolean found;
   same_type type;
-  const gchar *afile;
-  const gchar *bfile;
+  fd_path_id afile;
+  fd_path_id bfile;
 } find_step;
 
 typedef void (*find_step_cb) (const find_step *, gpointer);
 
-int find_images (GPtrArray *, find_step_cb, gpointer);
+/* the fd_path_id of the image and video files under the dir */
+void find_list (const gchar *, GArray *, GArray *);
+
+int find_images (GArray *, find_step_cb, gpointer);
+
+int find_videos (GArray *, find_step_cb, gpointer);
+
+/*
+ * images are screened by the hash of image_screen at the loose
+ * screen_image_distance, then verified by image_verify_distance of
+ * their phashes at verify_image_distance, as find_images does.
+ * */
+int image_screen ();
 
-int find_videos (GPtrArray *, find_step_cb, gpointer);
+int image_verify_distance (const hash_t *, const hash_t *);
 
 #endif
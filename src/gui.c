@@ -32,6 +32,13 @@
 #include "find.h"
 #include "gui.h"
 #include "cache.h"
+#include "result.h"
+#include "filter.h"
+#include "thumb.h"
+#include "trace.h"
+#include "cost.h"
+#include "stats.h"
+#include "metrics.h"
 
 #include <glib/gstdio.h>
 #include <glib.h>
@@ -42,58 +49,25 @@
 #include <windows.h>
 #endif
 
+/* a found pair, queued from the find thread to the main loop */
 typedef struct
 {
   same_type type;
-  GSList *files;
-  GtkTreeRowReference *treerowref;
-  gboolean show;
-} same_node;
+  fd_path_id afile;
+  fd_path_id bfile;
+} same_pair;
 
-void same_node_free (same_node *);
-void same_list_free (GSList *);
+static void same_pair_free (same_pair *);
 
-typedef struct
-{
-  /* same node */
-  same_node *node;
-
-  gchar *path;
-  gchar *name;
-  gchar *dir;
-
-  /* FD_IMAGE FD_VIDEO */
-  gint type;
-
-  /* format desc */
-  gchar *format;
-
-  /* file size */
-  gint size;
-
-  /* image/screenshot size */
-  gint width, height;
-
-  /* video length */
-  gdouble length;
-
-  /* bool select */
-  gboolean selected;
-} file_node;
-
-static file_node * file_node_new (same_node *,
-				  const gchar *, gint);
-static void file_node_free (file_node *);
 /* free the file node and same_node if necesstity */
-static void file_node_free_full (file_node *);
-static void file_node_to_tree_iter (file_node *,
-				    GtkTreeStore *, GtkTreeIter *);
+static void gui_remove_file (same_type, fd_path_id, const gchar *);
 
 typedef struct
 {
   GtkWidget *widget;
   GtkWidget *mainvbox;
   GtkWidget *progress;
+  GtkWidget *stats;
 
   GtkToolItem *but_add;
   GtkToolItem *but_find;
@@ -101,19 +75,38 @@ typedef struct
 
   GtkListStore *dirliststore;
 
-  GPtrArray *images;
-  GPtrArray *videos;
-  GSList *same_images;
-  GSList *same_videos;
-  GSList *same_list;
+  GPtrArray *dirs;
+  /* fd_path_id */
+  GArray *images;
+  GArray *videos;
+
+  /* written by the find thread, polled by the main loop */
+  volatile gint finding;
+  volatile gint prog_total;
+  volatile gint prog_now;
+  gpointer volatile prog_doing;
+  GAsyncQueue *founds;
+  GAsyncQueue *logs;
+
+  /* main loop only */
+  gboolean busy;
+  gpointer shown_doing;
+  gint shown_now;
 
   GtkWidget *logtree;
   GtkListStore *logliststore;
 
   GtkWidget *restree;
-  GtkTreeStore *restreestore;
+  ResultModel *resmodel;
+  fd_filter *filter;
+  /* ids of the groups matching filtertext, NULL for all */
+  GArray *filtered;
+  gchar *filtertext;
   GtkTreeSelection *resselect;
   file_node **resselfiles;
+  GtkWidget *selcombo;
+  /* selection waiting for the probes, 0 for none */
+  gint selpending;
 } gui_t;
 
 typedef struct
@@ -134,6 +127,9 @@ typedef struct
   gint alen;
   gint blen;
 
+  /* thumb_request ids of the shown pictures */
+  GArray *thumbs;
+
   gui_t *gui;
 } diff_dialog;
 
@@ -144,6 +140,12 @@ static void diffdia_onseekchanged (GtkEntry *, diff_dialog *);
 static void diffdia_onheadtail (GtkToggleButton *, diff_dialog *);
 static void diffdia_onnext (GtkWidget *, diff_dialog *);
 static void diffdia_onprev (GtkWidget *, diff_dialog *);
+static GtkWidget *diffdia_thumb_new (diff_dialog *, const file_node *, gint);
+static void diffdia_thumb_ready (GdkPixbuf *, GtkWidget *);
+static void diffdia_thumb_cancel (diff_dialog *);
+static gint diff_video_seek (const file_node *, const file_node *,
+			     const file_node *, gint, gboolean);
+static void restree_prefetch_pair (const file_node *, const file_node *);
 
 static void toolbar_new (gui_t *);
 static void mainframe_new (gui_t *);
@@ -156,9 +158,11 @@ static void gui_pref_cb (GtkWidget *, gui_t *);
 static void gui_help_cb (GtkWidget *, gui_t *);
 
 static void gui_find_step_cb (const find_step *, gui_t *);
-static GSList *gui_append_same_slist (gui_t *, GSList *,
-				      const gchar *, const gchar *,
-				      same_type);
+static gboolean gui_progress_poll (gui_t *);
+static void gui_find_done (gui_t *);
+static void gui_append_same (gui_t *,
+			     fd_path_id, fd_path_id,
+			     same_type);
 
 static gui_t gui[1];
 static void gui_destroy (gui_t *);
@@ -171,10 +175,10 @@ static gboolean dir_find_item (GtkTreeModel *,
 			       GtkTreePath *,
 			       GtkTreeIter *,
 			       gui_t *);
-static void gui_list_dir (gui_t *, const gchar *);
-static void gui_list_file (gui_t *, const gchar *);
-static void gui_list_link (gui_t *, const gchar *);
 
+static void restree_select_file (gui_t *, file_node *, gboolean);
+static void restree_select_by (gui_t *, gint);
+static void restree_probed (ResultModel *, gui_t *);
 static void restree_sel_small_file (same_node *node, gui_t *);
 static void restree_sel_big_file (same_node *node, gui_t *);
 static void restree_sel_small_image (same_node *node, gui_t *);
@@ -183,6 +187,10 @@ static void restree_sel_short_video (same_node *node, gui_t *);
 static void restree_sel_long_video (same_node *node, gui_t *);
 static void restree_sel_others (same_node *node, gui_t *);
 
+static void restree_refilter (gui_t *);
+static void restree_expand (GtkTreeModel *, GtkTreePath *, GtkTreeIter *,
+			    gui_t *);
+static void restree_reindex (gui_t *);
 static void restree_filter_changed (GtkEntry *, gui_t *);
 static void restree_filter_focusin (GtkEntry *, gui_t *);
 static void restree_selcombo_changed (GtkComboBox *, gui_t *);
@@ -209,25 +217,26 @@ static void restree_opendir (GtkMenuItem *, gui_t *);
 static void restree_delete (GtkMenuItem *, gui_t *);
 static void restree_diff (GtkMenuItem *, gui_t *);
 
-#ifndef FDUPVES_THREAD_STACK_SIZE
-#define FDUPVES_THREAD_STACK_SIZE (1024 * 1024 * 10)
-#endif
-
 #ifndef FDUPVES_MAXLOG
 #define FDUPVES_MAXLOG 1000
 #endif
 
+/* 10 Hz */
+#ifndef FDUPVES_PROGRESS_INTERVAL
+#define FDUPVES_PROGRESS_INTERVAL 100
+#endif
+
+/* found pairs appended to the model per progress tick */
+#ifndef GUI_FOUNDS_PER_TICK
+#define GUI_FOUNDS_PER_TICK 256
+#endif
+
 gboolean
 gui_init (int argc, char *argv[])
 {
   int i;
   gchar *insdir, *iconfile;
 
-  if (ini_new_with_file (FD_USR_CONF_FILE) == FALSE)
-    {
-      ini_new ();
-    }
-
   gui->widget = gtk_window_new (GTK_WINDOW_TOPLEVEL);
 
   gtk_window_set_title (GTK_WINDOW (gui->widget), PACKAGE_STRING);
@@ -245,6 +254,9 @@ gui_init (int argc, char *argv[])
   g_signal_connect (G_OBJECT (gui->widget), "destroy-event", G_CALLBACK (gui_destroy_cb), gui);
   g_signal_connect (G_OBJECT (gui->widget), "delete-event", G_CALLBACK (gui_destroy_cb), gui);
 
+  gui->founds = g_async_queue_new ();
+  gui->logs = g_async_queue_new ();
+
   gui->mainvbox = gtk_vbox_new (FALSE, FALSE);
   gtk_container_add (GTK_CONTAINER (gui->widget), gui->mainvbox);
 
@@ -254,6 +266,9 @@ gui_init (int argc, char *argv[])
 
   gtk_widget_show_all (gui->widget);
 
+  gdk_threads_add_timeout (FDUPVES_PROGRESS_INTERVAL,
+			   (GSourceFunc) gui_progress_poll, gui);
+
   for (i = 1; i < argc; ++ i)
     {
       gui_add_dir (gui, argv[i]);
@@ -352,13 +367,20 @@ gui_log (const gchar *log_domain,
 	 const gchar *message,
 	 gpointer user_data)
 {
-  GtkTreeIter itr[1];
-  GtkTreePath *path;
   gui_t *gui;
 
   gui = (gui_t *) user_data;
 
-  gdk_threads_enter ();
+  /* may be called from any thread, shown by gui_progress_poll */
+  g_async_queue_push (gui->logs, g_strdup (message));
+}
+
+static void
+gui_log_append (gui_t *gui, const gchar *message)
+{
+  GtkTreeIter itr[1];
+  GtkTreePath *path;
+
   gtk_list_store_append (gui->logliststore, itr);
   gtk_list_store_set (gui->logliststore, itr, 0, message, -1);
 
@@ -377,7 +399,6 @@ gui_log (const gchar *log_domain,
 				     itr);
       gtk_list_store_remove (gui->logliststore, itr);
     }
-  gdk_threads_leave ();
 }
 
 static void
@@ -525,6 +546,7 @@ mainframe_new (gui_t *gui)
   gtk_combo_box_set_active (GTK_COMBO_BOX (combo), 0);
   g_signal_connect (G_OBJECT (combo), "changed",
 		    G_CALLBACK (restree_selcombo_changed), gui);
+  gui->selcombo = combo;
 
   /* result tree */
   win = gtk_scrolled_window_new (NULL, NULL);
@@ -533,55 +555,63 @@ mainframe_new (gui_t *gui)
 				  GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
   gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW (win),
 				       GTK_SHADOW_IN);
-  gui->restreestore = gtk_tree_store_new (6,
-					  G_TYPE_STRING,
-					  G_TYPE_STRING,
-					  G_TYPE_STRING,
-					  G_TYPE_STRING,
-					  G_TYPE_STRING,
-					  G_TYPE_POINTER
-					  );
-  gui->restree = gtk_tree_view_new_with_model (GTK_TREE_MODEL (gui->restreestore));
+  gui->resmodel = result_model_new ();
+  gui->resmodel->drained = (void (*) (ResultModel *, gpointer)) restree_probed;
+  gui->resmodel->drained_data = gui;
+  gui->filter = filter_new ();
+  gui->restree = gtk_tree_view_new_with_model (GTK_TREE_MODEL (gui->resmodel));
+  /* all rows have the same height, the view needn't measure them all */
+  gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW (gui->restree), TRUE);
   gtk_container_add (GTK_CONTAINER (win), gui->restree);
 
   /* path */
   renderer = gtk_cell_renderer_text_new ();
   column = gtk_tree_view_column_new_with_attributes
     (_ ("File Path"),
-     renderer, "text", 0,
+     renderer, "text", RESULT_COL_PATH,
      NULL);
+  gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (column, 400);
   gtk_tree_view_column_set_resizable (column, TRUE);
   gtk_tree_view_append_column (GTK_TREE_VIEW (gui->restree), column);
   /* image size */
   renderer = gtk_cell_renderer_text_new ();
   column = gtk_tree_view_column_new_with_attributes
     (_ ("Image Size"),
-     renderer, "text", 1,
+     renderer, "text", RESULT_COL_IMAGE_SIZE,
      NULL);
+  gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (column, 80);
   gtk_tree_view_column_set_resizable (column, TRUE);
   gtk_tree_view_append_column (GTK_TREE_VIEW (gui->restree), column);
   /* file size */
   renderer = gtk_cell_renderer_text_new ();
   column = gtk_tree_view_column_new_with_attributes
     (_ ("File Size"),
-     renderer, "text", 2,
+     renderer, "text", RESULT_COL_FILE_SIZE,
      NULL);
+  gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (column, 80);
   gtk_tree_view_column_set_resizable (column, TRUE);
   gtk_tree_view_append_column (GTK_TREE_VIEW (gui->restree), column);
   /* video length */
   renderer = gtk_cell_renderer_text_new ();
   column = gtk_tree_view_column_new_with_attributes
     (_ ("Video Length"),
-     renderer, "text", 3,
+     renderer, "text", RESULT_COL_LENGTH,
      NULL);
+  gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (column, 80);
   gtk_tree_view_column_set_resizable (column, TRUE);
   gtk_tree_view_append_column (GTK_TREE_VIEW (gui->restree), column);
   /* format */
   renderer = gtk_cell_renderer_text_new ();
   column = gtk_tree_view_column_new_with_attributes
     (_ ("Format"),
-     renderer, "text", 4,
+     renderer, "text", RESULT_COL_FORMAT,
      NULL);
+  gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (column, 80);
   gtk_tree_view_column_set_resizable (column, TRUE);
   gtk_tree_view_append_column (GTK_TREE_VIEW (gui->restree), column);
 
@@ -590,6 +620,9 @@ mainframe_new (gui_t *gui)
 		    G_CALLBACK (restree_onbutpress), gui);
   g_signal_connect (G_OBJECT (gui->restree), "row-activated",
 		    G_CALLBACK (restree_onactivated), gui);
+  /* a group is shown expanded when it comes, after the view saw it */
+  g_signal_connect_after (G_OBJECT (gui->resmodel), "row-has-child-toggled",
+			  G_CALLBACK (restree_expand), gui);
   gui->resselect = gtk_tree_view_get_selection (GTK_TREE_VIEW (gui->restree));
   gtk_tree_selection_set_mode (gui->resselect, GTK_SELECTION_MULTIPLE);
   g_signal_connect (G_OBJECT (gui->resselect), "changed",
@@ -601,6 +634,10 @@ progressbar_new (gui_t *gui)
 {
   gui->progress = gtk_progress_bar_new ();
   gtk_box_pack_end (GTK_BOX (gui->mainvbox), gui->progress, FALSE, FALSE, 2);
+
+  gui->stats = gtk_label_new (NULL);
+  gtk_misc_set_alignment (GTK_MISC (gui->stats), 0, 0.5);
+  gtk_box_pack_end (GTK_BOX (gui->mainvbox), gui->stats, FALSE, FALSE, 2);
 }
 
 static void
@@ -645,29 +682,12 @@ gui_add_cb (GtkWidget *wid, gui_t *gui)
 static void
 gui_find_cb (GtkWidget *wid, gui_t *gui)
 {
-#if GLIB_CHECK_VERSION(2, 32, 0)
-  GThread *th;
-
-  th = g_thread_try_new ("find", (GThreadFunc) gui_find_thread, gui, NULL);
-  g_thread_unref (th);
-#else
-  g_thread_create_full ((GThreadFunc) gui_find_thread,
-			gui,
-			FDUPVES_THREAD_STACK_SIZE,
-			FALSE,
-			FALSE,
-			0,
-			NULL);
-#endif
-}
-
-static void
-gui_find_thread (gui_t *gui)
-{
-  int fimage, fvideo;
+  if (g_atomic_int_get (&gui->finding))
+    {
+      return;
+    }
 
   /* disable the add/find tool time */
-  gdk_threads_enter ();
   gtk_widget_set_sensitive (GTK_WIDGET (gui->but_add), FALSE);
   gtk_widget_set_sensitive (GTK_WIDGET (gui->but_find), FALSE);
   gtk_widget_set_sensitive (GTK_WIDGET (gui->but_del), FALSE);
@@ -675,47 +695,202 @@ gui_find_thread (gui_t *gui)
   gtk_progress_bar_set_text (GTK_PROGRESS_BAR (gui->progress), "");
   gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (gui->progress), 0);
 
-  gtk_tree_store_clear (gui->restreestore);
-  if (gui->same_list)
+  gtk_tree_view_set_model (GTK_TREE_VIEW (gui->restree), NULL);
+  result_model_clear (gui->resmodel);
+  filter_clear (gui->filter);
+  if (gui->filtered)
     {
-      same_list_free (gui->same_list);
-      gui->same_list = NULL;
+      g_array_free (gui->filtered, TRUE);
+      gui->filtered = NULL;
     }
-  gdk_threads_leave ();
-
-  gui->images = g_ptr_array_new_with_free_func (g_free);
-  gui->videos = g_ptr_array_new_with_free_func (g_free);
+  gtk_tree_view_set_model (GTK_TREE_VIEW (gui->restree),
+			   GTK_TREE_MODEL (gui->resmodel));
 
+  gui->dirs = g_ptr_array_new_with_free_func (g_free);
   gtk_tree_model_foreach (GTK_TREE_MODEL (gui->dirliststore),
 			  (GtkTreeModelForeachFunc) dir_find_item,
 			  gui);
 
-  fimage = 0;
+  g_atomic_int_set (&gui->prog_total, 0);
+  g_atomic_int_set (&gui->prog_now, 0);
+  g_atomic_pointer_set (&gui->prog_doing, NULL);
+  g_atomic_int_set (&gui->finding, TRUE);
+  gui->busy = TRUE;
+  gui->shown_doing = NULL;
+  gui->shown_now = -1;
+  stats_reset ();
+
+  if (!fd_thread_run ("find", (GThreadFunc) gui_find_thread, gui))
+    {
+      g_atomic_int_set (&gui->finding, FALSE);
+    }
+}
+
+static void
+gui_find_thread (gui_t *gui)
+{
+  guint i;
+  gint64 t;
+  gboolean serving;
+
+  /* never touch the widgets here, see gui_progress_poll */
+  t = trace_begin ();
+  if (g_ini->cost_top > 0)
+    {
+      cost_start ();
+    }
+  serving = g_ini->metrics_listen && g_ini->metrics_listen[0]
+    && metrics_start (g_ini->metrics_listen);
+  gui->images = g_array_new (FALSE, FALSE, sizeof (fd_path_id));
+  gui->videos = g_array_new (FALSE, FALSE, sizeof (fd_path_id));
+
+  for (i = 0; i < gui->dirs->len; ++ i)
+    {
+      find_list (g_ptr_array_index (gui->dirs, i),
+		 gui->images, gui->videos);
+    }
+  g_ptr_array_free (gui->dirs, TRUE);
+  gui->dirs = NULL;
+
   if (g_ini->proc_image && gui->images->len > 0)
     {
       g_message (_ ("find %d images to process"), gui->images->len);
 
       find_images (gui->images, (find_step_cb) gui_find_step_cb, gui);
-      fimage = g_slist_length (gui->same_list);
-      g_message (_ ("find %d groups same images"), fimage);
     }
 
-  fvideo = 0;
   if (g_ini->proc_video && gui->videos->len > 0)
     {
       g_message (_ ("find %d videos to process"), gui->videos->len);
 
       find_videos (gui->videos, (find_step_cb) gui_find_step_cb, gui);
-      fvideo = g_slist_length (gui->same_list);
-      fvideo -= fimage;
+    }
+
+  g_array_free (gui->images, TRUE);
+  g_array_free (gui->videos, TRUE);
+  trace_end (t, "scan", NULL);
+
+  /* logged before the finding flag is cleared, see gui_progress_poll */
+  cost_finish (g_ini->cost_top, g_ini->cost_file);
+
+  stats_set_stage ("done");
+  if (serving)
+    {
+      metrics_stop ();
+    }
+
+  g_atomic_int_set (&gui->finding, FALSE);
+}
+
+static gboolean
+gui_progress_poll (gui_t *gui)
+{
+  gboolean finding;
+  gpointer doing;
+  gchar *message, *text;
+  same_pair *pair;
+  gint now, total, n;
+  gint64 t;
+
+  /* read the flag first, all the results are queued before it's cleared */
+  finding = g_atomic_int_get (&gui->finding);
+
+  while ((message = g_async_queue_try_pop (gui->logs)) != NULL)
+    {
+      gui_log_append (gui, message);
+      g_free (message);
+    }
+
+  /* a burst of pairs is spread over the ticks, the rest waits */
+  t = 0;
+  for (n = 0;
+       n < GUI_FOUNDS_PER_TICK
+	 && (pair = g_async_queue_try_pop (gui->founds)) != NULL;
+       ++ n)
+    {
+      if (t == 0)
+	{
+	  t = trace_begin ();
+	}
+      gui_append_same (gui, pair->afile, pair->bfile, pair->type);
+      same_pair_free (pair);
+    }
+  trace_end (t, "append results", NULL);
+
+  if (finding)
+    {
+      doing = g_atomic_pointer_get (&gui->prog_doing);
+      if (doing && doing != gui->shown_doing)
+	{
+	  gtk_progress_bar_set_text (GTK_PROGRESS_BAR (gui->progress),
+				     doing);
+	  gui->shown_doing = doing;
+	}
+
+      total = g_atomic_int_get (&gui->prog_total);
+      now = g_atomic_int_get (&gui->prog_now);
+      if (total > 0 && now < total && now != gui->shown_now)
+	{
+	  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (gui->progress),
+					 (gdouble) now / (gdouble) total);
+	  gui->shown_now = now;
+	}
+
+      text = stats_to_text ("    ");
+      gtk_label_set_text (GTK_LABEL (gui->stats), text);
+      g_free (text);
+    }
+  else if (gui->busy && n < GUI_FOUNDS_PER_TICK)
+    {
+      gui->busy = FALSE;
+      gui_find_done (gui);
+    }
+
+  return TRUE;
+}
+
+static void
+gui_find_done (gui_t *gui)
+{
+  guint i;
+  same_node *node;
+  int fimage, fvideo;
+  gchar *text, **lines;
+
+  fimage = fvideo = 0;
+  for (i = 0; i < gui->resmodel->groups->len; ++ i)
+    {
+      node = g_ptr_array_index (gui->resmodel->groups, i);
+      if (node->type == FD_SAME_IMAGE)
+	{
+	  ++ fimage;
+	}
+      else
+	{
+	  ++ fvideo;
+	}
+    }
+  if (g_ini->proc_image)
+    {
+      g_message (_ ("find %d groups same images"), fimage);
+    }
+  if (g_ini->proc_video)
+    {
       g_message (_ ("find %d groups same videos"), fvideo);
     }
 
-  g_ptr_array_free (gui->images, TRUE);
-  g_ptr_array_free (gui->videos, TRUE);
+  text = stats_to_text ("\n");
+  lines = g_strsplit (text, "\n", -1);
+  g_free (text);
+  for (i = 0; lines[i]; ++ i)
+    {
+      g_message ("%s", lines[i]);
+    }
+  g_strfreev (lines);
 
-  gdk_threads_enter ();
-  gtk_tree_view_expand_all (GTK_TREE_VIEW (gui->restree));
+  text = stats_to_text ("    ");
+  gtk_label_set_text (GTK_LABEL (gui->stats), text);
+  g_free (text);
 
   gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (gui->progress), 0);
   gtk_progress_bar_set_text (GTK_PROGRESS_BAR (gui->progress), "");
@@ -724,7 +899,6 @@ gui_find_thread (gui_t *gui)
   gtk_widget_set_sensitive (GTK_WIDGET (gui->but_add), TRUE);
   gtk_widget_set_sensitive (GTK_WIDGET (gui->but_find), TRUE);
   gtk_widget_set_sensitive (GTK_WIDGET (gui->but_del), TRUE);
-  gdk_threads_leave ();
 }
 
 static void
@@ -773,120 +947,12 @@ dir_find_item (GtkTreeModel *model,
   gtk_tree_model_get (model, itr, 0, &path, -1);
   if (path)
     {
-      if (g_file_test (path, G_FILE_TEST_IS_DIR))
-	{
-	  gui_list_dir (gui, path);
-	}
-      else if (g_file_test (path, G_FILE_TEST_IS_REGULAR))
-	{
-	  gui_list_file (gui, path);
-	}
-      else if (g_file_test (path, G_FILE_TEST_IS_SYMLINK))
-	{
-	  gui_list_link (gui, path);
-	}
-
-      g_free (path);
+      g_ptr_array_add (gui->dirs, path);
     }
 
   return FALSE;
 }
 
-static void
-gui_list_dir (gui_t *gui, const gchar *path)
-{
-  GQueue stack[1];
-  GDir *gdir;
-  GError *err;
-  gchar *dir, *curpath;
-  const gchar *cur;
-
-  g_queue_init (stack);
-  dir = g_strdup (path);
-  g_queue_push_tail (stack, dir);
-
-  while ((dir = g_queue_pop_tail (stack)) != NULL)
-    {
-      err = NULL;
-      gdir = g_dir_open (dir, 0, &err);
-      if (err)
-	{
-	  g_warning ("Can't open dir: %s: %s", dir, err->message);
-	  g_error_free (err);
-	}
-
-      while ((cur = g_dir_read_name (gdir)) != NULL)
-	{
-	  if (strcmp (cur, ".") == 0
-	      || strcmp (cur, "..") == 0)
-	    {
-	      continue;
-	    }
-
-	  curpath = g_build_filename (dir, cur, NULL);
-	  if (g_file_test (curpath, G_FILE_TEST_IS_DIR))
-	    {
-	      g_queue_push_tail (stack, curpath);
-	    }
-	  else if (g_file_test (curpath, G_FILE_TEST_IS_REGULAR))
-	    {
-	      gui_list_file (gui, curpath);
-	      g_free (curpath);
-	    }
-	  else if (g_file_test (curpath, G_FILE_TEST_IS_SYMLINK))
-	    {
-	      gui_list_link (gui, curpath);
-	      g_free (curpath);
-	    }
-	}
-
-      g_dir_close (gdir);
-      g_free (dir);
-    }
-}
-
-static void
-gui_list_file (gui_t *gui, const gchar *path)
-{
-  gchar *p;
-
-  if (is_image (path))
-    {
-      if (g_ini->proc_image)
-	{
-	  p = g_strdup (path);
-	  g_ptr_array_add (gui->images, p);
-	  return;
-	}
-    }
-
-  else if (is_video (path))
-    {
-      if (g_ini->proc_video)
-	{
-	  p = g_strdup (path);
-	  g_ptr_array_add (gui->videos, p);
-	  return;
-	}
-    }
-
-  else
-    {
-      if (g_ini->proc_other)
-	{
-	}
-      else
-	{
-	  g_debug ("%s is not image/video, skipped", path);
-	}
-    }
-}
-
-static void
-gui_list_link (gui_t *gui, const gchar *path)
-{
-}
-
 static void
 gui_destroy_cb (GtkWidget *but, GdkEvent *ev, gui_t *gui)
 {
@@ -1046,6 +1112,9 @@ restreesel_onchanged (GtkTreeSelection *sel, gui_t *gui)
   GList *list, *cur;
   gsize i, cnt;
   GtkTreeIter itr[1];
+  file_node *fn;
+  same_node *node;
+  guint row;
 
   if (gui->resselfiles)
     {
@@ -1064,25 +1133,74 @@ restreesel_onchanged (GtkTreeSelection *sel, gui_t *gui)
 
   for (i = 0, cur = list; cur; ++ i, cur = g_list_next (cur))
     {
-      gtk_tree_model_get_iter (GTK_TREE_MODEL (gui->restreestore),
+      gtk_tree_model_get_iter (GTK_TREE_MODEL (gui->resmodel),
 			       itr,
 			       cur->data);
-      gtk_tree_model_get (GTK_TREE_MODEL (gui->restreestore), itr,
-			  5, gui->resselfiles + i,
+      gtk_tree_model_get (GTK_TREE_MODEL (gui->resmodel), itr,
+			  RESULT_COL_NODE, gui->resselfiles + i,
 			  -1);
       gtk_tree_path_free (cur->data);
     }
   g_list_free (list);
+
+  /* warm the loader for the diff dialog, only for a hand selection */
+  if (cnt <= 2)
+    {
+      fn = gui->resselfiles[0];
+      if (cnt == 2)
+	{
+	  restree_prefetch_pair (fn, gui->resselfiles[1]);
+	}
+
+      /* and the next group, the user is going through them */
+      row = fn->node->row + 1;
+      if (fn->node->row >= 0 && row < gui->resmodel->rows->len)
+	{
+	  node = g_ptr_array_index (gui->resmodel->rows, row);
+	  if (node->files && node->files->next)
+	    {
+	      restree_prefetch_pair (node->files->data,
+				     node->files->next->data);
+	    }
+	}
+    }
+}
+
+static void
+restree_prefetch_pair (const file_node *afn, const file_node *bfn)
+{
+  gchar apath[PATH_MAX], bpath[PATH_MAX];
+
+  path_copy (afn->id, apath, sizeof apath);
+  path_copy (bfn->id, bpath, sizeof bpath);
+  if (afn->type == FD_IMAGE && bfn->type == FD_IMAGE)
+    {
+      thumb_prefetch (apath, -1,
+		      g_ini->thumb_size[0], g_ini->thumb_size[1]);
+      thumb_prefetch (bpath, -1,
+		      g_ini->thumb_size[0], g_ini->thumb_size[1]);
+    }
+  /* the seeks need the lengths */
+  else if (afn->type == FD_VIDEO && bfn->type == FD_VIDEO
+	   && afn->probed && bfn->probed)
+    {
+      thumb_prefetch (apath, diff_video_seek (afn, bfn, afn, 1, FALSE),
+		      g_ini->thumb_size[0], g_ini->thumb_size[1]);
+      thumb_prefetch (bpath, diff_video_seek (afn, bfn, bfn, 1, FALSE),
+		      g_ini->thumb_size[0], g_ini->thumb_size[1]);
+    }
 }
 
 static void
 restree_open (GtkMenuItem *item, gui_t *gui)
 {
+  gchar path[PATH_MAX];
 #ifndef WIN32
   gchar *uri;
   GError *err;
 
-  uri = g_filename_to_uri (gui->resselfiles[0]->path, NULL, NULL);
+  path_copy (gui->resselfiles[0]->id, path, sizeof path);
+  uri = g_filename_to_uri (path, NULL, NULL);
   err = NULL;
   gtk_show_uri (NULL, uri, GDK_CURRENT_TIME, &err);
   if (err)
@@ -1095,7 +1213,8 @@ restree_open (GtkMenuItem *item, gui_t *gui)
 #else
   gchar *filename;
 
-  filename = g_win32_locale_filename_from_utf8 (gui->resselfiles[0]->path);
+  path_copy (gui->resselfiles[0]->id, path, sizeof path);
+  filename = g_win32_locale_filename_from_utf8 (path);
   if (filename)
     {
       ShellExecute (NULL, "open", filename, NULL, NULL, SW_SHOW);
@@ -1103,7 +1222,7 @@ restree_open (GtkMenuItem *item, gui_t *gui)
     }
   else
     {
-      ShellExecute (NULL, "open", gui->resselfiles[0]->path, NULL, NULL, SW_SHOW);
+      ShellExecute (NULL, "open", path, NULL, NULL, SW_SHOW);
     }
 #endif
 }
@@ -1119,10 +1238,10 @@ restree_opendir (GtkMenuItem *item, gui_t *gui)
   gchar *dirname;
 #endif
 
-  dir = g_path_get_dirname (gui->resselfiles[0]->path);
+  dir = path_dup_dir (gui->resselfiles[0]->id);
   if (dir == NULL)
     {
-      g_warning ("get file: %s dirname failed", gui->resselfiles[0]->path);
+      g_warning ("get file: %u dirname failed", gui->resselfiles[0]->id);
       return;
     }
 
@@ -1158,80 +1277,67 @@ restree_opendir (GtkMenuItem *item, gui_t *gui)
 static void
 gui_filter_result (gui_t *gui, const gchar *filter)
 {
-  GtkTreeIter itr[1], itrc[1];
-  GtkTreePath *path;
-  GSList *nodelist, *filelist;
-  same_node *node;
-  file_node *fn;
-  gboolean match;
-
-  gtk_tree_store_clear (gui->restreestore);
+  if (gui->filtered)
+    {
+      g_array_free (gui->filtered, TRUE);
+    }
+  gui->filtered = filter_query (gui->filter, filter);
 
-  for (nodelist = gui->same_list;
-       nodelist != NULL;
-       nodelist = g_slist_next (nodelist))
+  if (filter != gui->filtertext)
     {
-      node = (same_node *) nodelist->data;
+      g_free (gui->filtertext);
+      gui->filtertext = g_strdup (filter);
+    }
 
-      if (node->treerowref)
-	{
-	  gtk_tree_row_reference_free (node->treerowref);
-	  node->treerowref = NULL;
-	}
-      node->show = FALSE;
+  restree_refilter (gui);
+}
 
-      if (node->files == NULL)
-	{
-	  continue;
-	}
+static void
+restree_refilter (gui_t *gui)
+{
+  /* only the rows which come and go are signaled, the others keep
+   * their expansion. the selection is read once after */
+  g_signal_handlers_block_by_func (gui->resselect,
+				   restreesel_onchanged, gui);
+  result_model_refilter (gui->resmodel, gui->filtered);
+  g_signal_handlers_unblock_by_func (gui->resselect,
+				     restreesel_onchanged, gui);
+  restreesel_onchanged (gui->resselect, gui);
+}
 
-      if (filter == NULL)
-	{
-	  match = TRUE;
-	}
-      else
-	{
-	  match = FALSE;
+static void
+restree_expand (GtkTreeModel *model, GtkTreePath *tpath,
+		GtkTreeIter *itr, gui_t *gui)
+{
+  if (gtk_tree_view_get_model (GTK_TREE_VIEW (gui->restree)) == model
+      && gtk_tree_path_get_depth (tpath) == 1
+      && gtk_tree_model_iter_has_child (model, itr))
+    {
+      gtk_tree_view_expand_row (GTK_TREE_VIEW (gui->restree), tpath, FALSE);
+    }
+}
 
-	  for (filelist = node->files;
-	       filelist != NULL;
-	       filelist = g_slist_next (filelist))
-	    {
-	      fn = filelist->data;
+static void
+restree_reindex (gui_t *gui)
+{
+  GSList *filelist;
+  same_node *node;
+  file_node *fn;
+  guint i;
 
-	      if (strstr (fn->path, filter))
-		{
-		  match = TRUE;
-		  break;
-		}
-	    }
-	}
+  filter_clear (gui->filter);
+  for (i = 0; i < gui->resmodel->groups->len; ++ i)
+    {
+      node = g_ptr_array_index (gui->resmodel->groups, i);
 
-      if (match)
+      for (filelist = node->files;
+	   filelist != NULL;
+	   filelist = g_slist_next (filelist))
 	{
-	  gtk_tree_store_append (gui->restreestore, itr, NULL);
-	  fn = node->files->data;
-	  file_node_to_tree_iter (fn, gui->restreestore, itr);
-
-	  path = gtk_tree_model_get_path (GTK_TREE_MODEL (gui->restreestore),
-					  itr);
-	  node->treerowref = gtk_tree_row_reference_new (GTK_TREE_MODEL (gui->restreestore), path);
-	  gtk_tree_path_free (path);
-
-	  for (filelist = g_slist_next (node->files);
-	       filelist != NULL;
-	       filelist = g_slist_next (filelist))
-	    {
-	      gtk_tree_store_append (gui->restreestore, itrc, itr);
-	      fn = filelist->data;
-	      file_node_to_tree_iter (fn, gui->restreestore, itrc);
-	    }
-
-	  node->show = TRUE;
+	  fn = filelist->data;
+	  filter_add (gui->filter, node->id, fn->id);
 	}
     }
-
-  gtk_tree_view_expand_all (GTK_TREE_VIEW (gui->restree));
 }
 
 #ifdef WIN32
@@ -1365,15 +1471,37 @@ gui_delete_dialog_ask (gui_t *gui, const gchar *filename, gint *pflags)
 static void
 restree_delete (GtkMenuItem *item, gui_t *gui)
 {
-  gint i, res, ret, flags;
+  gint i, n, res, ret, flags;
+  same_type *types;
+  fd_path_id *ids;
+  gchar *path;
+
+  /* removing a file frees the last one of its group too, which may be
+   * selected as well, so the selection is kept as ids and looked up
+   * again at each removal */
+  for (n = 0; gui->resselfiles[n]; ++ n)
+    ;
+  types = g_new (same_type, n);
+  ids = g_new (fd_path_id, n);
+  for (i = 0; i < n; ++ i)
+    {
+      types[i] = gui->resselfiles[i]->node->type;
+      ids[i] = gui->resselfiles[i]->id;
+    }
+
+  /* the model changes without row signals, see result_model_remove_file */
+  gtk_tree_view_set_model (GTK_TREE_VIEW (gui->restree), NULL);
+  g_free (gui->resselfiles);
+  gui->resselfiles = NULL;
 
   res = 0;
   flags = 0;
-  for (i = 0; gui->resselfiles[i]; ++ i)
+  for (i = 0; i < n; ++ i)
     {
+      path = path_dup (ids[i]);
       if (res == 0)
 	{
-	  res = gui_delete_dialog_ask (gui, gui->resselfiles[i]->path, &flags);
+	  res = gui_delete_dialog_ask (gui, path, &flags);
 	}
 
       if (res == GTK_RESPONSE_YES)
@@ -1381,65 +1509,64 @@ restree_delete (GtkMenuItem *item, gui_t *gui)
 #ifdef WIN32
 	  if (flags & FDUPVES_DEL_TOTRASH)
 	    {
-	      ret = win32_remove (gui, gui->resselfiles[i]->path, TRUE);
+	      ret = win32_remove (gui, path, TRUE);
 	    }
 	  else
 	    {
-	      ret = win32_remove (gui, gui->resselfiles[i]->path, FALSE);
+	      ret = win32_remove (gui, path, FALSE);
 	    }
 #else
-	  ret = g_remove (gui->resselfiles[i]->path);
+	  ret = g_remove (path);
 #endif
 	  if (ret == 0)
 	    {
-	      file_node_free_full (gui->resselfiles[i]);
+	      gui_remove_file (types[i], ids[i], path);
 	    }
 	}
+      g_free (path);
 
       if (!(flags & FDUPVES_DEL_ALL))
 	{
 	  res = 0;
 	}
     }
+  g_free (types);
+  g_free (ids);
+
+  /* the deleted paths must not match any more */
+  restree_reindex (gui);
+  gui_filter_result (gui, gui->filtertext);
 
-  gui_filter_result (gui, NULL);
+  gtk_tree_view_set_model (GTK_TREE_VIEW (gui->restree),
+			   GTK_TREE_MODEL (gui->resmodel));
+  gtk_tree_view_expand_all (GTK_TREE_VIEW (gui->restree));
 }
 
 static GtkWidget *
-image2widget (const file_node *fn)
+image2widget (diff_dialog *dia, const file_node *fn)
 {
-  gchar *desc;
+  gchar *name, *dir, *desc;
   GtkWidget *vbox, *label, *image;
-  GdkPixbuf *pixbuf;
-  GError *err;
 
+  name = path_dup_name (fn->id);
+  dir = path_dup_dir (fn->id);
   desc = g_strdup_printf ("Name: %s\n"
 			  "Dir: %s\n"
 			  "size: %d:%d\n"
 			  "format: %s",
-			  fn->name,
-			  fn->dir,
+			  name,
+			  dir,
 			  fn->width, fn->height,
 			  fn->format);
+  g_free (name);
+  g_free (dir);
 
   label = gtk_label_new (desc);
   gtk_label_set_max_width_chars (GTK_LABEL (label), 60);
   gtk_label_set_ellipsize (GTK_LABEL (label), PANGO_ELLIPSIZE_MIDDLE);
   g_free (desc);
 
-  err = NULL;
-  pixbuf = fdupves_gdkpixbuf_load_file_at_size (fn->path,
-						g_ini->thumb_size[0],
-						g_ini->thumb_size[1],
-						&err);
-  if (err)
-    {
-      g_warning ("load image: %s error: %s", fn->path, err->message);
-      g_error_free (err);
-      g_free (desc);
-      return NULL;
-    }
-  image = gtk_image_new_from_pixbuf (pixbuf);
+  image = diffdia_thumb_new (dia, fn, -1);
 
   vbox = gtk_vbox_new (FALSE, 2);
   gtk_box_pack_start (GTK_BOX (vbox), label, FALSE, FALSE, 2);
@@ -1456,41 +1583,39 @@ diff_add_image (diff_dialog *dia, const file_node *afn, const file_node *bfn)
   dia->container = gtk_hbox_new (TRUE, 2);
   gtk_box_pack_start (GTK_BOX (dia->content), dia->container, TRUE, TRUE, 0);
 
-  aimage = image2widget (afn);
+  aimage = image2widget (dia, afn);
   gtk_box_pack_start (GTK_BOX (dia->container), aimage, TRUE, TRUE, 0);
 
-  bimage = image2widget (bfn);
+  bimage = image2widget (dia, bfn);
   gtk_box_pack_end (GTK_BOX (dia->container), bimage, TRUE, TRUE, 0);
 }
 
 static GtkWidget *
-video2widget (const file_node *fn, int seek)
+video2widget (diff_dialog *dia, const file_node *fn, int seek)
 {
-  gchar *desc, *tmpfile, tmpname[0x10];
+  gchar *name, *dir, *desc;
   GtkWidget *label, *image, *vbox;
 
+  name = path_dup_name (fn->id);
+  dir = path_dup_dir (fn->id);
   desc = g_strdup_printf ("Name: %s\n"
 			  "Dir: %s\n"
 			  "Format %s\n"
 			  "Length: %f\n"
 			  "Size: %d-%d",
-			  fn->name,
-			  fn->dir,
+			  name,
+			  dir,
 			  fn->format,
 			  fn->length,
 			  fn->width, fn->height);
+  g_free (name);
+  g_free (dir);
   label = gtk_label_new (desc);
   gtk_label_set_max_width_chars (GTK_LABEL (label), 60);
   gtk_label_set_ellipsize (GTK_LABEL (label), PANGO_ELLIPSIZE_MIDDLE);
   g_free (desc);
 
-  g_snprintf (tmpname, sizeof tmpname, "%d.jpg", rand ());
-  tmpfile = g_build_filename (g_get_tmp_dir (), tmpname, NULL);
-  video_time_screenshot_file (fn->path, seek,
-			      g_ini->thumb_size[0], g_ini->thumb_size[1],
-			      tmpfile);
-  image = gtk_image_new_from_file (tmpfile);
-  g_free (tmpfile);
+  image = diffdia_thumb_new (dia, fn, seek);
 
   vbox = gtk_vbox_new (FALSE, 2);
   gtk_box_pack_start (GTK_BOX (vbox), label, FALSE, FALSE, 2);
@@ -1499,35 +1624,114 @@ video2widget (const file_node *fn, int seek)
   return vbox;
 }
 
+static GtkWidget *
+diffdia_thumb_new (diff_dialog *dia, const file_node *fn, gint seek)
+{
+  GtkWidget *image;
+  gchar path[PATH_MAX];
+  guint id;
+
+  /* a placeholder until the loader is done */
+  image = gtk_image_new_from_icon_name ("image-loading", GTK_ICON_SIZE_DIALOG);
+  gtk_widget_set_size_request (image,
+			       g_ini->thumb_size[0], g_ini->thumb_size[1]);
+
+  path_copy (fn->id, path, sizeof path);
+  id = thumb_request (path, seek,
+		      g_ini->thumb_size[0], g_ini->thumb_size[1],
+		      (thumb_ready_cb) diffdia_thumb_ready, image);
+  if (id)
+    {
+      g_array_append_val (dia->thumbs, id);
+    }
+
+  return image;
+}
+
+static void
+diffdia_thumb_ready (GdkPixbuf *pixbuf, GtkWidget *image)
+{
+  if (pixbuf)
+    {
+      gtk_image_set_from_pixbuf (GTK_IMAGE (image), pixbuf);
+    }
+  else
+    {
+      gtk_image_set_from_stock (GTK_IMAGE (image), GTK_STOCK_MISSING_IMAGE,
+				GTK_ICON_SIZE_DIALOG);
+    }
+}
+
+static void
+diffdia_thumb_cancel (diff_dialog *dia)
+{
+  guint i;
+
+  for (i = 0; i < dia->thumbs->len; ++ i)
+    {
+      thumb_cancel (g_array_index (dia->thumbs, guint, i));
+    }
+  g_array_set_size (dia->thumbs, 0);
+}
+
+static gint
+diff_video_seek (const file_node *afn, const file_node *bfn,
+		 const file_node *fn, gint index, gboolean from_tail)
+{
+  int rate;
+
+  rate = (int) ((afn->length < bfn->length ?
+		 afn->length:
+		 bfn->length) / (g_ini->compare_count + 1));
+
+  return from_tail ? (int) (fn->length - rate * index) : rate * index;
+}
+
 static void
 diffdia_refresh_video_pic (diff_dialog *dia)
 {
   GList *list, *cur;
   GtkWidget *avideo, *bvideo;
-  int seek, rate;
+  const file_node *fn;
+  gchar path[PATH_MAX];
+  int seek, i, index;
+
+  diffdia_thumb_cancel (dia);
 
   list = gtk_container_get_children (GTK_CONTAINER (dia->container));
   for (cur = list; cur; cur = g_list_next (cur))
     {
       gtk_container_remove (GTK_CONTAINER (dia->container), cur->data);
     }
+  g_list_free (list);
 
-  rate = (int) ((dia->afn->length < dia->bfn->length ?
-		 dia->afn->length:
-		 dia->bfn->length) / (g_ini->compare_count + 1));
-
-  seek = dia->from_tail ?
-    (int) (dia->afn->length - rate * dia->index) :
-    rate * dia->index;
-  avideo = video2widget (dia->afn, seek);
+  seek = diff_video_seek (dia->afn, dia->bfn, dia->afn,
+			  dia->index, dia->from_tail);
+  avideo = video2widget (dia, dia->afn, seek);
   gtk_box_pack_start (GTK_BOX (dia->container), avideo, TRUE, TRUE, 0);
 
-  seek = dia->from_tail ?
-    (int) (dia->bfn->length - rate * dia->index) :
-    rate * dia->index;
-  bvideo = video2widget (dia->bfn, seek);
+  seek = diff_video_seek (dia->afn, dia->bfn, dia->bfn,
+			  dia->index, dia->from_tail);
+  bvideo = video2widget (dia, dia->bfn, seek);
   gtk_box_pack_end (GTK_BOX (dia->container), bvideo, TRUE, TRUE, 0);
 
+  /* the previous and next positions, for the buttons */
+  for (i = 0; i < 4; ++ i)
+    {
+      index = dia->index + (i < 2 ? -1 : 1);
+      if (index < 1 || index > g_ini->compare_count)
+	{
+	  continue;
+	}
+
+      fn = i % 2 ? dia->bfn : dia->afn;
+      seek = diff_video_seek (dia->afn, dia->bfn, fn,
+			      index, dia->from_tail);
+      path_copy (fn->id, path, sizeof path);
+      thumb_prefetch (path, seek,
+		      g_ini->thumb_size[0], g_ini->thumb_size[1]);
+    }
+
   if (dia->index <= 1)
     {
       gtk_widget_set_sensitive (dia->butprev, FALSE);
@@ -1597,6 +1801,10 @@ diff_add_video (diff_dialog *dia, const file_node *afn, const file_node *bfn)
 static void
 restree_diff (GtkMenuItem *item, gui_t *gui)
 {
+  /* the dialog shows the sizes and lengths */
+  result_model_probe_file (gui->resmodel, gui->resselfiles[0]);
+  result_model_probe_file (gui->resmodel, gui->resselfiles[1]);
+
   diff_dialog_new (gui, gui->resselfiles[0], gui->resselfiles[1]);
 }
 
@@ -1608,6 +1816,7 @@ diff_dialog_new (gui_t *gui, const file_node *afn, const file_node *bfn)
   diffdia = g_malloc0 (sizeof (diff_dialog));
 
   diffdia->gui = gui;
+  diffdia->thumbs = g_array_new (FALSE, FALSE, sizeof (guint));
 
   diffdia->dialog = gtk_dialog_new_with_buttons ("fdupves diff dialog",
 						 GTK_WINDOW (gui->widget),
@@ -1633,13 +1842,15 @@ diff_dialog_new (gui_t *gui, const file_node *afn, const file_node *bfn)
     }
   else
     {
-      gchar *desc;
+      gchar *desc, apath[PATH_MAX], bpath[PATH_MAX];
       GtkWidget *label;
 
+      path_copy (afn->id, apath, sizeof apath);
+      path_copy (bfn->id, bpath, sizeof bpath);
       desc = g_strdup_printf ("file type are not same, can't show diff\n"
 			      "file 1: %s\n"
 			      "file 2: %s\n",
-			      afn->path, bfn->path);
+			      apath, bpath);
       label = gtk_label_new (desc);
       g_free (desc);
       gtk_box_pack_start (GTK_BOX (diffdia->content), label, TRUE, FALSE, 2);
@@ -1666,6 +1877,8 @@ diffdia_onprev (GtkWidget *but, diff_dialog *dialog)
 static void
 diffdia_onclose (GtkWidget *dia, diff_dialog *dialog)
 {
+  diffdia_thumb_cancel (dialog);
+  g_array_free (dialog->thumbs, TRUE);
   gtk_widget_destroy (dialog->dialog);
   g_free (dialog);
 }
@@ -1673,6 +1886,8 @@ diffdia_onclose (GtkWidget *dia, diff_dialog *dialog)
 static void
 diffdia_onresponse (GtkWidget *dia, gint res, diff_dialog *dialog)
 {
+  diffdia_thumb_cancel (dialog);
+  g_array_free (dialog->thumbs, TRUE);
   gtk_widget_destroy (dialog->dialog);
   g_free (dialog);
 }
@@ -1705,161 +1920,72 @@ diffdia_onseekchanged (GtkEntry *entry, diff_dialog *dia)
 static void
 gui_find_step_cb (const find_step *step, gui_t *gui)
 {
+  same_pair *pair;
+
+  /* called from the find thread, no gdk lock here */
   if (step->doing)
     {
-      gdk_threads_enter ();
-      gtk_progress_bar_set_text (GTK_PROGRESS_BAR (gui->progress),
-				 step->doing);
-      gdk_threads_leave ();
+      g_atomic_pointer_set (&gui->prog_doing, (gpointer) step->doing);
     }
 
-  if (step->total > 0 && step->now < step->total)
-    {
-      gdk_threads_enter ();
-      gtk_progress_bar_set_fraction
-	(GTK_PROGRESS_BAR (gui->progress),
-	 (gdouble) step->now / (gdouble) step->total);
-      gdk_threads_leave ();
-    }
+  g_atomic_int_set (&gui->prog_total, step->total);
+  g_atomic_int_set (&gui->prog_now, step->now);
 
   if (step->found)
     {
-      gui->same_list = gui_append_same_slist (gui,
-					      gui->same_list,
-					      step->afile,
-					      step->bfile,
-					      step->type
-					      );
+      pair = g_new (same_pair, 1);
+      pair->type = step->type;
+      pair->afile = step->afile;
+      pair->bfile = step->bfile;
+      g_async_queue_push (gui->founds, pair);
     }
 }
 
-static GSList *
-gui_append_same_slist (gui_t *gui, GSList *slist,
-		       const gchar *afile, const gchar *bfile,
-		       same_type type)
+static void
+same_pair_free (same_pair *pair)
 {
-  GSList *cur, *fslist;
-  same_node *node;
-  file_node *fn, *fn2;
-  gboolean afind, bfind;
-  GtkTreeIter itr[1], itrc[1];
-  GtkTreePath *path;
-
-  for (cur = slist; cur; cur = g_slist_next (cur))
-    {
-      node = cur->data;
-
-      if (node->type != type)
-	{
-	  continue;
-	}
-
-      afind = bfind = FALSE;
-      for (fslist = node->files; fslist; fslist = g_slist_next (fslist))
-	{
-	  fn = fslist->data;
-
-	  if (strcmp (fn->path, afile) == 0)
-	    {
-	      afind = TRUE;
-	    }
-	  else if (strcmp (fn->path, bfile) == 0)
-	    {
-	      bfind = TRUE;
-	    }
-	}
-
-      if (afind && bfind)
-	{
-	  return slist;
-	}
-      else if (afind)
-	{
-	  fn = file_node_new (node,
-			      bfile,
-			      type == FD_SAME_IMAGE ?
-			      FD_IMAGE : FD_VIDEO);
-
-	  gdk_threads_enter ();
-	  if (node->show)
-	    {
-	      path = gtk_tree_row_reference_get_path (node->treerowref);
-	      gtk_tree_model_get_iter (GTK_TREE_MODEL (gui->restreestore), itr, path);
-	      gtk_tree_store_append (gui->restreestore, itrc, itr);
-	      file_node_to_tree_iter (fn, gui->restreestore, itrc);
-	      gtk_tree_path_free (path);
-	    }
-	  gdk_threads_leave ();
+  g_free (pair);
+}
 
-	  return slist;
-	}
-      else if (bfind)
-	{
-	  fn = file_node_new (node,
-			      afile,
-			      type == FD_SAME_IMAGE?
-			      FD_IMAGE : FD_VIDEO);
+static void
+gui_append_same (gui_t *gui,
+		 fd_path_id afile, fd_path_id bfile,
+		 same_type type)
+{
+  same_node *node;
+  file_node *afn, *bfn;
 
-	  gdk_threads_enter ();
-	  if (node->show)
-	    {
-	      path = gtk_tree_row_reference_get_path (node->treerowref);
-	      gtk_tree_model_get_iter (GTK_TREE_MODEL (gui->restreestore), itr, path);
-	      gtk_tree_store_append (gui->restreestore, itrc, itr);
-	      file_node_to_tree_iter (fn, gui->restreestore, itrc);
-	      gtk_tree_path_free (path);
-	    }
-	  gdk_threads_leave ();
+  afn = result_model_lookup (gui->resmodel, type, afile);
+  bfn = result_model_lookup (gui->resmodel, type, bfile);
 
-	  return slist;
-	}
+  if (afn && bfn)
+    {
+      return;
     }
-
-  node = g_malloc0 (sizeof (same_node));
-  g_return_val_if_fail (node, slist);
-
-  node->type = type;
-  fn = file_node_new (node,
-		      afile,
-		      type == FD_SAME_IMAGE ?
-		      FD_IMAGE : FD_VIDEO);
-  fn2 = file_node_new (node,
-		       bfile,
-		       type == FD_SAME_IMAGE ?
-		       FD_IMAGE : FD_VIDEO);
-
-  gdk_threads_enter ();
-  gtk_tree_store_append (gui->restreestore, itr, NULL);
-  file_node_to_tree_iter (fn, gui->restreestore, itr);
-  path = gtk_tree_model_get_path (GTK_TREE_MODEL (gui->restreestore), itr);
-  node->treerowref = gtk_tree_row_reference_new (GTK_TREE_MODEL (gui->restreestore), path);
-  gtk_tree_path_free (path);
-  gtk_tree_store_append (gui->restreestore, itrc, itr);
-  file_node_to_tree_iter (fn2, gui->restreestore, itrc);
-  node->show = TRUE;
-  gdk_threads_leave ();
-
-  return g_slist_append (slist, node);
-}
-
-void
-same_node_free (same_node *node)
-{
-  if (node->treerowref)
+  else if (afn)
     {
-      gtk_tree_row_reference_free (node->treerowref);
-      node->treerowref = NULL;
+      node = afn->node;
+    }
+  else if (bfn)
+    {
+      node = bfn->node;
+    }
+  else
+    {
+      node = result_model_add_group (gui->resmodel, type);
+      g_return_if_fail (node);
     }
-  g_slist_foreach (node->files, (GFunc) file_node_free, NULL);
-  g_slist_free (node->files);
-  g_free (node);
-}
 
-void
-same_list_free (GSList *list)
-{
-  g_slist_foreach (list, (GFunc) same_node_free, NULL);
-  g_slist_free (list);
+  if (afn == NULL)
+    {
+      afn = result_model_add_file (gui->resmodel, node, afile);
+      filter_add (gui->filter, node->id, afn->id);
+    }
+  if (bfn == NULL)
+    {
+      bfn = result_model_add_file (gui->resmodel, node, bfile);
+      filter_add (gui->filter, node->id, bfn->id);
+    }
 }
 
 static void
@@ -1882,31 +2008,63 @@ restree_selcombo_changed (GtkComboBox *comtext, gui_t *gui)
   gint id;
 
   id = gtk_combo_box_get_active (comtext);
+
+  /* the selections by size/length need the metadata of all files,
+     wait for the probe pool rather than loading them here */
+  if (id > 0 && id < 7 && gui->resmodel->probing > 0)
+    {
+      gui->selpending = id;
+      gtk_widget_set_sensitive (gui->selcombo, FALSE);
+      return;
+    }
+
+  restree_select_by (gui, id);
+}
+
+static void
+restree_probed (ResultModel *model, gui_t *gui)
+{
+  gint id;
+
+  if (gui->selpending == 0)
+    {
+      return;
+    }
+
+  id = gui->selpending;
+  gui->selpending = 0;
+  gtk_widget_set_sensitive (gui->selcombo, TRUE);
+  restree_select_by (gui, id);
+}
+
+static void
+restree_select_by (gui_t *gui, gint id)
+{
   switch (id)
     {
     case 0:
       break;
 
     case 1:
-      g_slist_foreach (gui->same_list, (GFunc) restree_sel_small_file, gui);
+      g_ptr_array_foreach (gui->resmodel->groups, (GFunc) restree_sel_small_file, gui);
       break;
     case 2:
-      g_slist_foreach (gui->same_list, (GFunc) restree_sel_big_file, gui);
+      g_ptr_array_foreach (gui->resmodel->groups, (GFunc) restree_sel_big_file, gui);
       break;
     case 3:
-      g_slist_foreach (gui->same_list, (GFunc) restree_sel_small_image, gui);
+      g_ptr_array_foreach (gui->resmodel->groups, (GFunc) restree_sel_small_image, gui);
       break;
     case 4:
-      g_slist_foreach (gui->same_list, (GFunc) restree_sel_big_image, gui);
+      g_ptr_array_foreach (gui->resmodel->groups, (GFunc) restree_sel_big_image, gui);
       break;
     case 5:
-      g_slist_foreach (gui->same_list, (GFunc) restree_sel_short_video, gui);
+      g_ptr_array_foreach (gui->resmodel->groups, (GFunc) restree_sel_short_video, gui);
       break;
     case 6:
-      g_slist_foreach (gui->same_list, (GFunc) restree_sel_long_video, gui);
+      g_ptr_array_foreach (gui->resmodel->groups, (GFunc) restree_sel_long_video, gui);
       break;
     case 7:
-      g_slist_foreach (gui->same_list, (GFunc) restree_sel_others, gui);
+      g_ptr_array_foreach (gui->resmodel->groups, (GFunc) restree_sel_others, gui);
       break;
 
     default:
@@ -1923,152 +2081,44 @@ gui_delsel_cb (GtkWidget *but, gui_t *gui)
     }
 }
 
-static file_node *
-file_node_new (same_node *node, const gchar *path, gint type)
-{
-  file_node *fn;
-#ifdef WIN32
-  struct _stat32 buf[1];
-#else
-  struct stat buf[1];
-#endif
-
-  fn = g_malloc0 (sizeof (file_node));
-  g_return_val_if_fail (fn, NULL);
-
-  fn->path = g_strdup (path);
-  fn->name = g_path_get_basename (path);
-  fn->dir = g_path_get_dirname (path);
-
-  if (g_stat (path, buf) == 0)
-    {
-      fn->size = buf->st_size;
-    }
-
-  fn->type = type;
-
-  if (type == FD_IMAGE)
-    {
-      GdkPixbufFormat *format;
-
-      format = gdk_pixbuf_get_file_info (path,
-					 &fn->width, &fn->height);
-      if (format)
-	{
-	  fn->format = gdk_pixbuf_format_get_name (format);
-	}
-
-    }
-  else if (type == FD_VIDEO)
-    {
-      video_info *info;
-
-      info = video_get_info (path);
-      if (info)
-	{
-	  fn->width = info->size[0];
-	  fn->height = info->size[1];
-	  fn->length = info->length;
-	  fn->format = g_strdup (info->format);
-	  video_info_free (info);
-	}
-    }
-
-  fn->node = node;
-  node->files = g_slist_append (node->files, fn);
-
-  return fn;
-}
-
-static void
-file_node_free (file_node *fn)
-{
-  g_free (fn->path);
-  g_free (fn->name);
-  g_free (fn->dir);
-  g_free (fn->format);
-  g_free (fn);
-}
-
 static void
-file_node_free_full (file_node *fn)
+gui_remove_file (same_type type, fd_path_id id, const gchar *path)
 {
-  same_node *node;
-
-  node = fn->node;
+  file_node *fn;
 
   if (g_cache)
     {
-      cache_remove (g_cache, fn->path);
+      cache_remove (g_cache, path);
     }
 
-  file_node_free (fn);
-  node->files = g_slist_remove (node->files, fn);
-
-  if (g_slist_length (node->files) == 1)
+  /* gone already if its partner was removed before */
+  fn = result_model_lookup (gui->resmodel, type, id);
+  if (fn)
     {
-      file_node_free_full (node->files->data);
+      result_model_remove_file (gui->resmodel, fn);
     }
 }
 
 static void
-file_node_to_tree_iter (file_node *fn, GtkTreeStore *store, GtkTreeIter *itr)
-{
-  gchar isizestr[0x100], vlenstr[0x100], *fsizestr;
-
-  g_snprintf (isizestr, sizeof isizestr, "%u:%u",
-	      fn->width, fn->height);
-  g_snprintf (vlenstr, sizeof vlenstr, "%f",
-	      fn->length);
-#if GLIB_CHECK_VERSION (2, 30, 0)
-  fsizestr = g_format_size (fn->size);
-#else
-  fsizestr = g_strdup_printf ("%d", fn->size);
-#endif
-
-  gtk_tree_store_set (store, itr,
-		      0, fn->path,
-		      1, isizestr,
-		      2, fsizestr,
-		      3, vlenstr,
-		      4, fn->format,
-		      5, fn,
-		      -1);
-  g_free (fsizestr);
-}
-
-static void
-restree_select_rowref_id (gui_t *gui, GtkTreeRowReference *ref, gint id)
+restree_select_file (gui_t *gui, file_node *fn, gboolean select)
 {
   GtkTreePath *path;
 
-  path = gtk_tree_row_reference_get_path (ref);
-  if (id > 0)
+  path = result_model_get_file_path (gui->resmodel, fn);
+  if (path == NULL)
     {
-      gtk_tree_path_down (path);
-      while (-- id)
-	{
-	  gtk_tree_path_next (path);
-	}
+      return;
     }
-  gtk_tree_selection_select_path (gui->resselect, path);
-}
-
-static void
-restree_unselect_rowref_id (gui_t *gui, GtkTreeRowReference *ref, gint id)
-{
-  GtkTreePath *path;
 
-  path = gtk_tree_row_reference_get_path (ref);
-  if (id > 0)
+  if (select)
     {
-      gtk_tree_path_down (path);
-      while (-- id)
-	{
-	  gtk_tree_path_next (path);
-	}
+      gtk_tree_selection_select_path (gui->resselect, path);
+    }
+  else
+    {
+      gtk_tree_selection_unselect_path (gui->resselect, path);
     }
-  gtk_tree_selection_unselect_path (gui->resselect, path);
+  gtk_tree_path_free (path);
 }
 
 static void
@@ -2077,7 +2127,7 @@ restree_sel_small_file (same_node *node, gui_t *gui)
   GSList *slist;
   file_node *fn, *sfn;
 
-  if (!node->show)
+  if (node->row < 0)
     {
       return;
     }
@@ -2089,8 +2139,7 @@ restree_sel_small_file (same_node *node, gui_t *gui)
       fn = slist->data;
 
       fn->selected = FALSE;
-      restree_unselect_rowref_id (gui, node->treerowref,
-				  g_slist_index (node->files, fn));
+      restree_select_file (gui, fn, FALSE);
       if (fn->size < sfn->size)
 	{
 	  sfn = fn;
@@ -2098,8 +2147,7 @@ restree_sel_small_file (same_node *node, gui_t *gui)
     }
 
   sfn->selected = TRUE;
-  restree_select_rowref_id (gui, node->treerowref,
-			    g_slist_index (node->files, sfn));
+  restree_select_file (gui, sfn, TRUE);
 }
 
 static void
@@ -2108,7 +2156,7 @@ restree_sel_big_file (same_node *node, gui_t *gui)
   GSList *slist;
   file_node *fn, *sfn;
 
-  if (!node->show)
+  if (node->row < 0)
     {
       return;
     }
@@ -2120,8 +2168,7 @@ restree_sel_big_file (same_node *node, gui_t *gui)
       fn = slist->data;
 
       fn->selected = FALSE;
-      restree_unselect_rowref_id (gui, node->treerowref,
-				  g_slist_index (node->files, fn));
+      restree_select_file (gui, fn, FALSE);
       if (fn->size > sfn->size)
 	{
 	  sfn = fn;
@@ -2129,8 +2176,7 @@ restree_sel_big_file (same_node *node, gui_t *gui)
     }
 
   sfn->selected = TRUE;
-  restree_select_rowref_id (gui, node->treerowref,
-			    g_slist_index (node->files, sfn));
+  restree_select_file (gui, sfn, TRUE);
 }
 
 static void
@@ -2139,7 +2185,7 @@ restree_sel_small_image (same_node *node, gui_t *gui)
   GSList *slist;
   file_node *fn, *sfn;
 
-  if (!node->show)
+  if (node->row < 0)
     {
       return;
     }
@@ -2151,8 +2197,7 @@ restree_sel_small_image (same_node *node, gui_t *gui)
       fn = slist->data;
 
       fn->selected = FALSE;
-      restree_unselect_rowref_id (gui, node->treerowref,
-				  g_slist_index (node->files, fn));
+      restree_select_file (gui, fn, FALSE);
       if (fn->width * fn->height < sfn->width * sfn->height)
 	{
 	  sfn = fn;
@@ -2160,8 +2205,7 @@ restree_sel_small_image (same_node *node, gui_t *gui)
     }
 
   sfn->selected = TRUE;
-  restree_select_rowref_id (gui, node->treerowref,
-			    g_slist_index (node->files, sfn));
+  restree_select_file (gui, sfn, TRUE);
 }
 
 static void
@@ -2170,7 +2214,7 @@ restree_sel_big_image (same_node *node, gui_t *gui)
   GSList *slist;
   file_node *fn, *sfn;
 
-  if (!node->show)
+  if (node->row < 0)
     {
       return;
     }
@@ -2182,8 +2226,7 @@ restree_sel_big_image (same_node *node, gui_t *gui)
       fn = slist->data;
 
       fn->selected = FALSE;
-      restree_unselect_rowref_id (gui, node->treerowref,
-				  g_slist_index (node->files, fn));
+      restree_select_file (gui, fn, FALSE);
       if (fn->width * fn->height > sfn->width * sfn->height)
 	{
 	  sfn = fn;
@@ -2191,8 +2234,7 @@ restree_sel_big_image (same_node *node, gui_t *gui)
     }
 
   sfn->selected = TRUE;
-  restree_select_rowref_id (gui, node->treerowref,
-			    g_slist_index (node->files, sfn));
+  restree_select_file (gui, sfn, TRUE);
 }
 
 static void
@@ -2201,7 +2243,7 @@ restree_sel_short_video (same_node *node, gui_t *gui)
   GSList *slist;
   file_node *fn, *sfn;
 
-  if (!node->show)
+  if (node->row < 0)
     {
       return;
     }
@@ -2213,8 +2255,7 @@ restree_sel_short_video (same_node *node, gui_t *gui)
       fn = slist->data;
 
       fn->selected = FALSE;
-      restree_unselect_rowref_id (gui, node->treerowref,
-				  g_slist_index (node->files, fn));
+      restree_select_file (gui, fn, FALSE);
       if (fn->length < sfn->length)
 	{
 	  sfn = fn;
@@ -2222,8 +2263,7 @@ restree_sel_short_video (same_node *node, gui_t *gui)
     }
 
   sfn->selected = TRUE;
-  restree_select_rowref_id (gui, node->treerowref,
-			    g_slist_index (node->files, sfn));
+  restree_select_file (gui, sfn, TRUE);
 }
 
 static void
@@ -2232,7 +2272,7 @@ restree_sel_long_video (same_node *node, gui_t *gui)
   GSList *slist;
   file_node *fn, *sfn;
 
-  if (!node->show)
+  if (node->row < 0)
     {
       return;
     }
@@ -2244,8 +2284,7 @@ restree_sel_long_video (same_node *node, gui_t *gui)
       fn = slist->data;
 
       fn->selected = FALSE;
-      restree_unselect_rowref_id (gui, node->treerowref,
-				  g_slist_index (node->files, fn));
+      restree_select_file (gui, fn, FALSE);
       if (fn->length > sfn->length)
 	{
 	  sfn = fn;
@@ -2253,8 +2292,7 @@ restree_sel_long_video (same_node *node, gui_t *gui)
     }
 
   sfn->selected = TRUE;
-  restree_select_rowref_id (gui, node->treerowref,
-			    g_slist_index (node->files, sfn));
+  restree_select_file (gui, sfn, TRUE);
 }
 
 static void
@@ -2263,7 +2301,7 @@ restree_sel_others (same_node *node, gui_t *gui)
   GSList *slist;
   file_node *fn;
 
-  if (!node->show)
+  if (node->row < 0)
     {
       return;
     }
@@ -2277,14 +2315,12 @@ restree_sel_others (same_node *node, gui_t *gui)
       if (fn->selected)
 	{
 	  fn->selected = FALSE;
-	  restree_unselect_rowref_id (gui, node->treerowref,
-				      g_slist_index (node->files, fn));
+	  restree_select_file (gui, fn, FALSE);
 	}
       else
 	{
 	  fn->selected = TRUE;
-	  restree_select_rowref_id (gui, node->treerowref,
-				    g_slist_index (node->files, fn));
+	  restree_select_file (gui, fn, TRUE);
 	}
     }
 }
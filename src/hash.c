@@ -29,6 +29,9 @@
 #include "image.h"
 #include "ini.h"
 #include "cache.h"
+#include "trace.h"
+#include "cost.h"
+#include "stats.h"
 
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <glib.h>
@@ -37,50 +40,236 @@ const char *hash_phrase[] =
   {
     "hash",
     "phash",
+    "dhash",
+    "dphash",
   };
 
-static hash_t pixbuf_hash (GdkPixbuf *);
+static const hash_t hash_null;
 
-#define FDUPVES_HASH_LEN 8
+static inline int hash_popcount (guint64);
+static int hash_cmp_64 (const hash_t *, const hash_t *);
+static int hash_cmp_128 (const hash_t *, const hash_t *);
+static int hash_cmp_256 (const hash_t *, const hash_t *);
+
+int
+hash_bits (int alg)
+{
+  int bits;
+
+  switch (alg)
+    {
+    case FDUPVES_HASH_PHASH:
+    case FDUPVES_HASH_DPHASH:
+      bits = g_ini->phash_bits;
+      break;
+
+    case FDUPVES_HASH_DHASH:
+      bits = g_ini->dhash_bits;
+      break;
+
+    default:
+      bits = g_ini->hash_bits;
+      break;
+    }
+  if (bits != 128 && bits != 256)
+    {
+      bits = 64;
+    }
+
+  return bits;
+}
+
+void
+hash_grid (int bits, int *cols, int *rows)
+{
+  *cols = bits > 64 ? 16 : 8;
+  *rows = bits > 128 ? 16 : 8;
+}
+
+int
+hash_limit (int bits, int distance)
+{
+  return distance * bits / 64;
+}
+
+gchar *
+hash_to_string (const hash_t *h, int bits, gchar *buf, gsize len)
+{
+  gsize off;
+  int i;
+
+  off = 0;
+  for (i = 0; i < bits / 64 && off < len; ++ i)
+    {
+      off += g_snprintf (buf + off, len - off, "%s%" G_GUINT64_FORMAT,
+			 i ? "," : "", h->w[i]);
+    }
+
+  return buf;
+}
+
+int
+hash_from_string (const gchar *str, hash_t *h)
+{
+  gchar *end;
+  int i;
+
+  *h = hash_null;
+  for (i = 0; i < FDUPVES_HASH_WORDS; ++ i)
+    {
+      h->w[i] = g_ascii_strtoull (str, &end, 0);
+      if (end == str)
+	{
+	  return 0;
+	}
+      if (*end != ',')
+	{
+	  break;
+	}
+      str = end + 1;
+    }
+
+  switch (i)
+    {
+    case 0:
+      h->valid = TRUE;
+      return 64;
+
+    case 1:
+      h->valid = TRUE;
+      return 128;
+
+    case 3:
+      h->valid = TRUE;
+      return 256;
+
+    default:
+      return 0;
+    }
+}
 
 hash_t
 file_hash (const char *file)
 {
-  GdkPixbuf *buf;
-  hash_t h;
-  GError *err;
+  hash_t hashs[FDUPVES_HASH_ALGS_CNT];
 
-  if (g_cache)
+  /* the cache key has one producer, see file_hashes */
+  file_hashes (file, 1u << FDUPVES_HASH_HASH, hashs);
+
+  return hashs[FDUPVES_HASH_HASH];
+}
+
+guint
+file_hashes (const char *file, guint algs, hash_t *hashs)
+{
+  GdkPixbuf *master, *buf;
+  GError *err;
+  guint done;
+  int alg, bits[FDUPVES_HASH_ALGS_CNT], cols, rows, n;
+  int nalgs[FDUPVES_HASH_ALGS_CNT], nbits[FDUPVES_HASH_ALGS_CNT];
+  hash_t nhashs[FDUPVES_HASH_ALGS_CNT];
+  gint64 t, c;
+
+  done = 0;
+  for (alg = 0; alg < FDUPVES_HASH_ALGS_CNT; ++ alg)
     {
-      if (cache_get (g_cache, file, 0, FDUPVES_HASH_HASH, &h))
+      if (!(algs & (1u << alg)))
 	{
-	  return h;
+	  continue;
+	}
+
+      bits[alg] = hash_bits (alg);
+      hashs[alg] = hash_null;
+      if (g_cache
+	  && cache_get (g_cache, file, 0,
+			alg == FDUPVES_HASH_PHASH ? phash_type () : alg,
+			bits[alg], hashs + alg))
+	{
+	  done |= 1u << alg;
 	}
     }
+  if ((algs & ~done) == 0)
+    {
+      return done;
+    }
 
-  buf = fdupves_gdkpixbuf_load_file_at_size (file,
-					     FDUPVES_HASH_LEN,
-					     FDUPVES_HASH_LEN,
-					     &err);
+  err = NULL;
+  c = cost_begin ();
+  t = trace_begin ();
+  master = fdupves_gdkpixbuf_load_file_at_size (file,
+						FDUPVES_HASH_MASTER,
+						FDUPVES_HASH_MASTER,
+						&err);
+  trace_end (t, "load", file);
+  cost_end (c, file, -1, 1, NULL);
   if (err)
     {
       g_warning ("Load file: %s to pixbuf failed: %s", file, err->message);
       g_error_free (err);
-      return 0;
+      return done;
     }
 
-  h = pixbuf_hash (buf);
-  g_object_unref (buf);
-
-  if (g_cache)
+  n = 0;
+  for (alg = 0; alg < FDUPVES_HASH_ALGS_CNT; ++ alg)
     {
-      if (h)
+      if (!(algs & ~done & (1u << alg)))
+	{
+	  continue;
+	}
+
+      hash_grid (bits[alg], &cols, &rows);
+      t = trace_begin ();
+      switch (alg)
+	{
+	case FDUPVES_HASH_HASH:
+	  buf = gdk_pixbuf_scale_simple (master, cols, rows,
+					 GDK_INTERP_BILINEAR);
+	  hashs[alg] = pixbuf_hash (buf);
+	  break;
+
+	case FDUPVES_HASH_PHASH:
+	  buf = gdk_pixbuf_scale_simple (master,
+					 FDUPVES_PHASH_LEN, FDUPVES_PHASH_LEN,
+					 GDK_INTERP_BILINEAR);
+	  hashs[alg] = pixbuf_phash (buf);
+	  break;
+
+	case FDUPVES_HASH_DHASH:
+	  buf = gdk_pixbuf_scale_simple (master, cols + 1, rows,
+					 GDK_INTERP_BILINEAR);
+	  hashs[alg] = pixbuf_dhash (buf);
+	  break;
+
+	default:
+	  /* _DPHASH is asked for as FDUPVES_HASH_PHASH */
+	  buf = NULL;
+	  break;
+	}
+      trace_end (t, hash_phrase[alg], file);
+      if (buf == NULL)
 	{
-	  cache_set (g_cache, file, 0, FDUPVES_HASH_HASH, h);
+	  continue;
+	}
+      g_object_unref (buf);
+      stats_add (FD_STAT_HASHES, 1);
+
+      if (!HASH_IS_NULL (hashs[alg]))
+	{
+	  done |= 1u << alg;
+	  nalgs[n] = alg == FDUPVES_HASH_PHASH ? phash_type () : alg;
+	  nbits[n] = bits[alg];
+	  nhashs[n] = hashs[alg];
+	  ++ n;
 	}
     }
+  g_object_unref (master);
 
-  return h;
+  if (g_cache)
+    {
+      cache_set_n (g_cache, file, 0, n, nalgs, nbits, nhashs);
+    }
+
+  return done;
 }
 
 hash_t
@@ -89,22 +278,26 @@ buffer_hash (const char *buffer, int size)
   GdkPixbuf *buf;
   GError *err;
   hash_t h;
+  int cols, rows;
+
+  hash_grid (hash_bits (FDUPVES_HASH_HASH), &cols, &rows);
+  g_return_val_if_fail (size >= cols * rows * 3, hash_null);
 
   err = NULL;
   buf = gdk_pixbuf_new_from_data ((const guchar *) buffer,
 				  GDK_COLORSPACE_RGB,
 				  FALSE,
 				  8,
-				  FDUPVES_HASH_LEN,
-				  FDUPVES_HASH_LEN,
-				  FDUPVES_HASH_LEN * 3,
+				  cols,
+				  rows,
+				  cols * 3,
 				  NULL,
 				  &err);
   if (err)
     {
       g_warning ("Load inline data to pixbuf failed: %s", err->message);
       g_error_free (err);
-      return 0;
+      return hash_null;
     }
 
   h = pixbuf_hash (buf);
@@ -113,12 +306,13 @@ buffer_hash (const char *buffer, int size)
   return h;
 }
 
-static hash_t
+/* one bit per pixel, the width of the hash is the pixel count */
+hash_t
 pixbuf_hash (GdkPixbuf *pixbuf)
 {
   int width, height, rowstride, n_channels;
   guchar *pixels, *p;
-  int *grays, sum, avg, x, y, off;
+  int grays[FDUPVES_HASH_BITS_MAX], sum, avg, x, y, off;
   hash_t hash;
 
   n_channels = gdk_pixbuf_get_n_channels (pixbuf);
@@ -128,11 +322,11 @@ pixbuf_hash (GdkPixbuf *pixbuf)
 
   width = gdk_pixbuf_get_width (pixbuf);
   height = gdk_pixbuf_get_height (pixbuf);
+  g_return_val_if_fail (width * height <= FDUPVES_HASH_BITS_MAX, hash_null);
 
   rowstride = gdk_pixbuf_get_rowstride (pixbuf);
   pixels = gdk_pixbuf_get_pixels (pixbuf);
 
-  grays = g_new0 (int, width * height);
   off = 0;
   for (y = 0; y < height; ++ y)
     {
@@ -151,32 +345,116 @@ pixbuf_hash (GdkPixbuf *pixbuf)
     }
   avg = sum / off;
 
-  hash = 0;
+  hash = hash_null;
   for (x = 0; x < off; ++ x)
     {
       if (grays[x] >= avg)
 	{
-	  hash |= ((hash_t) 1 << x);
+	  hash.w[x >> 6] |= (guint64) 1 << (x & 63);
 	}
     }
-
-  g_free (grays);
+  hash.valid = !HASH_WORDS_ZERO (hash);
 
   return hash;
 }
 
 int
-hash_cmp (hash_t a, hash_t b)
+hash_cmp (const hash_t *a, const hash_t *b)
 {
-  hash_t c;
-  int cmp;
+  if ((a->w[1] | a->w[2] | a->w[3] | b->w[1] | b->w[2] | b->w[3]) == 0)
+    {
+      return hash_cmp_64 (a, b);
+    }
 
-  if (!a || !b)
+  return hash_cmp_256 (a, b);
+}
+
+hash_cmp_func
+hash_cmp_kernel (int bits)
+{
+  switch (bits)
     {
-      return FDUPVES_HASH_LEN * FDUPVES_HASH_LEN; /* max invalid distance */
+    case 128:
+      return hash_cmp_128;
+
+    case 256:
+      return hash_cmp_256;
+
+    default:
+      return hash_cmp_64;
     }
+}
+
+int
+hash_orient_count (int bits)
+{
+  return bits == 128 ? 4 : FDUPVES_DIHEDRAL_CNT;
+}
 
-  c = a ^ b;
+hash_t
+hash_orient (const hash_t *h, int bits, int variant)
+{
+  hash_t o;
+  int cols, rows, r, c, sr, sc, bit;
+
+  hash_grid (bits, &cols, &rows);
+  o = hash_null;
+  o.valid = h->valid;
+  for (r = 0; r < rows; ++ r)
+    {
+      for (c = 0; c < cols; ++ c)
+	{
+	  sr = variant & 4 ? c : r;
+	  sc = variant & 4 ? r : c;
+	  if (variant & 1)
+	    {
+	      sc = cols - 1 - sc;
+	    }
+	  if (variant & 2)
+	    {
+	      sr = rows - 1 - sr;
+	    }
+	  bit = sr * cols + sc;
+	  if ((h->w[bit >> 6] >> (bit & 63)) & 1)
+	    {
+	      bit = r * cols + c;
+	      o.w[bit >> 6] |= (guint64) 1 << (bit & 63);
+	    }
+	}
+    }
+
+  return o;
+}
+
+static inline int
+hash_popcount (guint64 v)
+{
+#if defined(__GNUC__)
+  return __builtin_popcountll (v);
+#else
+  int n;
+
+  for (n = 0; v; v &= v - 1)
+    {
+      ++ n;
+    }
+
+  return n;
+#endif
+}
+
+/* compare_area selects rows of the 8x8 grid, only for 64 bits */
+static int
+hash_cmp_64 (const hash_t *a, const hash_t *b)
+{
+  guint64 c;
+
+  if (!a->valid || !b->valid)
+    {
+      return 64; /* max invalid distance */
+    }
+
+  c = a->w[0] ^ b->w[0];
   switch (g_ini->compare_area)
     {
     case 1:
@@ -198,15 +476,34 @@ hash_cmp (hash_t a, hash_t b)
     default:
       break;
     }
-  for (cmp = 0; c; c = c >> 1)
+
+  return hash_popcount (c);
+}
+
+static int
+hash_cmp_128 (const hash_t *a, const hash_t *b)
+{
+  if (!a->valid || !b->valid)
     {
-      if (c & 1)
-	{
-	  ++ cmp;
-	}
+      return 128;
+    }
+
+  return hash_popcount (a->w[0] ^ b->w[0])
+    + hash_popcount (a->w[1] ^ b->w[1]);
+}
+
+static int
+hash_cmp_256 (const hash_t *a, const hash_t *b)
+{
+  if (HASH_IS_NULL (*a) || HASH_IS_NULL (*b))
+    {
+      return 256;
     }
 
-  return cmp;
+  return hash_popcount (a->w[0] ^ b->w[0])
+    + hash_popcount (a->w[1] ^ b->w[1])
+    + hash_popcount (a->w[2] ^ b->w[2])
+    + hash_popcount (a->w[3] ^ b->w[3]);
 }
 
 hash_t
@@ -215,25 +512,27 @@ video_time_hash (const char *file, int time)
   hash_t h;
   gchar *buffer;
   gsize len;
+  gint64 t;
+  int bits, cols, rows;
 #ifdef _DEBUG
   gchar *basename, outfile[4096];
 #endif
 
+  bits = hash_bits (FDUPVES_HASH_HASH);
   if (g_cache)
     {
-      if (cache_get (g_cache, file, time, FDUPVES_HASH_HASH, &h))
+      if (cache_get (g_cache, file, time, FDUPVES_HASH_HASH, bits, &h))
 	{
 	  return h;
 	}
     }
 
-  len = FDUPVES_HASH_LEN * FDUPVES_HASH_LEN * 3;
+  hash_grid (bits, &cols, &rows);
+  len = cols * rows * 3;
   buffer = g_malloc (len);
-  g_return_val_if_fail (buffer, 0);
+  g_return_val_if_fail (buffer, hash_null);
 
-  video_time_screenshot (file, time,
-			 FDUPVES_HASH_LEN, FDUPVES_HASH_LEN,
-			 buffer, len);
+  video_time_screenshot (file, time, cols, rows, buffer, len);
 #ifdef _DEBUG
   basename = g_path_get_basename (file);
   g_snprintf (outfile, sizeof outfile, "%s/%s-%d.png",
@@ -241,19 +540,22 @@ video_time_hash (const char *file, int time)
 	      basename, time);
   g_free (basename);
   video_time_screenshot_file (file, time,
-			      FDUPVES_HASH_LEN * 100,
-			      FDUPVES_HASH_LEN * 100,
+			      cols * 100,
+			      rows * 100,
 			      outfile);
 #endif
 
+  t = trace_begin ();
   h = buffer_hash (buffer, len);
+  trace_end (t, "hash", file);
+  stats_add (FD_STAT_HASHES, 1);
   g_free (buffer);
 
   if (g_cache)
     {
-      if (h)
+      if (!HASH_IS_NULL (h))
 	{
-	  cache_set (g_cache, file, time, FDUPVES_HASH_HASH, h);
+	  cache_set (g_cache, file, time, FDUPVES_HASH_HASH, bits, h);
 	}
     }
 
@@ -27,15 +27,60 @@
 #ifndef _FDUPVES_HASH_H_
 #define _FDUPVES_HASH_H_
 
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
 enum hash_type
   {
     FDUPVES_HASH_HASH,
     FDUPVES_HASH_PHASH,
+    FDUPVES_HASH_DHASH,
+    /* the phash of phash_dihedral, cached apart */
+    FDUPVES_HASH_DPHASH,
     FDUPVES_HASH_ALGS_CNT,
   };
 extern const char *hash_phrase[];
 
-typedef unsigned long long hash_t;
+/* the side of the image a phash is the dct of */
+#define FDUPVES_PHASH_LEN 32
+
+/* the side of the master image of file_hashes */
+#define FDUPVES_HASH_MASTER 64
+
+/* the widest hash, in 64 bit words */
+#define FDUPVES_HASH_WORDS 4
+#define FDUPVES_HASH_BITS_MAX (FDUPVES_HASH_WORDS * 64)
+
+/*
+ * a hash of 64, 128 or 256 bits, see hash_bits. the words past the
+ * width are 0. valid is FALSE when the file could not be hashed: a
+ * zero dhash or phash is a real hash, of a flat image for one, the
+ * zero average hash of a flat frame is still left invalid so blank
+ * video frames never match.
+ * */
+typedef struct
+{
+  guint64 w[FDUPVES_HASH_WORDS];
+  gboolean valid;
+} hash_t;
+
+#define HASH_IS_NULL(h) (!(h).valid)
+#define HASH_WORDS_ZERO(h) \
+  (((h).w[0] | (h).w[1] | (h).w[2] | (h).w[3]) == 0)
+
+/* the width in bits of an algorithm, hash_bits/phash_bits/dhash_bits */
+int hash_bits (int);
+
+/* the grid of a width: 8x8, 16x8 or 16x16 */
+void hash_grid (int, int *, int *);
+
+/* the distance limit of 64 bit hashes scaled to a width */
+int hash_limit (int, int);
+
+/* "%llu" for 64 bits, the words joined by ',' for wider hashes */
+gchar * hash_to_string (const hash_t *, int, gchar *, gsize);
+
+/* returns the width in bits, 0 if invalid */
+int hash_from_string (const gchar *, hash_t *);
 
 hash_t file_hash (const char *);
 
@@ -49,6 +94,55 @@ hash_t buffer_phash (const char *, int);
 
 hash_t video_time_phash (const char *, int);
 
-int hash_cmp (hash_t, hash_t);
+hash_t file_dhash (const char *);
+
+/*
+ * the hashes of the algorithms in a mask of (1 << hash_type) of an
+ * image, indexed by hash_type. one decode to a FDUPVES_HASH_MASTER
+ * master serves all the missing ones, they are cached in one batch.
+ * returns the mask of the valid hashes.
+ * */
+guint file_hashes (const char *, guint, hash_t *);
+
+/* FDUPVES_HASH_PHASH or _DPHASH, the phash cached by phash_dihedral */
+int phash_type ();
+
+hash_t buffer_dhash (const char *, int);
+
+hash_t video_time_dhash (const char *, int);
+
+/* the distance over all the words, for hashes of any width */
+int hash_cmp (const hash_t *, const hash_t *);
+
+typedef int (*hash_cmp_func) (const hash_t *, const hash_t *);
+
+/* the compare kernel specialised for a width */
+hash_cmp_func hash_cmp_kernel (int);
+
+/* the kernels, exported for fdupves-bench */
+hash_t pixbuf_hash (GdkPixbuf *);
+
+hash_t pixbuf_phash (GdkPixbuf *);
+
+hash_t pixbuf_dhash (GdkPixbuf *);
+
+/*
+ * the rotations and flips of a hash, variant & 1 mirrors, & 2 flips and
+ * & 4 transposes. a 128 bit grid is not square, it has only the first
+ * hash_orient_count variants.
+ * */
+#define FDUPVES_DIHEDRAL_CNT 8
+
+int hash_orient_count (int);
+
+/* of an average hash, a permutation of the grid */
+hash_t hash_orient (const hash_t *, int, int);
+
+/* of a phash_dihedral hash */
+hash_t phash_orient (const hash_t *, int, int);
+
+int phash_cmp_dihedral (const hash_t *, const hash_t *, int);
+
+gboolean buffer_dct (const unsigned char *, unsigned char *, gsize);
 
 #endif
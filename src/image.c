@@ -25,51 +25,768 @@
  */
 
 #include "image.h"
+#include "ini.h"
+#include "util.h"
+#include "stats.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
 #ifdef WIN32
 #include "image-win.h"
 #endif
 
+/* an EXIF APP1 segment is at most 64 KB */
+#define EXIF_HEAD_MAX 0x10000
+
+struct exif_info
+{
+  gboolean motorola;
+  guint32 offset;		/* of the JPEG thumbnail, from the TIFF header */
+  guint32 length;
+  guint width;			/* of the main image */
+  guint height;
+};
+
+static GdkPixbuf *exif_thumb_at_size (const gchar *, int, int);
+static gboolean exif_parse (const guchar *, gsize, struct exif_info *);
+static void exif_ifd (const guchar *, gsize, guint32, gboolean,
+		      struct exif_info *, guint32 *);
+
+/* box filter of decoded rows into a w x h accumulator, the decoders
+   below stream through it and never hold the whole image */
+struct image_box
+{
+  int w;
+  int h;
+  guint src_w;
+  guint src_h;
+  guint64 *sums;
+  guint *colx;
+  guint *coln;
+  guint *rown;
+};
+
+static struct image_box *image_box_new (guint, guint, int, int);
+static void image_box_row (struct image_box *, guint, const guchar *);
+static GdkPixbuf *image_box_pixbuf (struct image_box *);
+static void image_box_free (struct image_box *);
+
+#if defined (FDUPVES_ENABLE_JPEG) || defined (FDUPVES_ENABLE_PNG)
+#include <setjmp.h>
+#endif
+#ifdef FDUPVES_ENABLE_JPEG
+#include <jpeglib.h>
+
+static GdkPixbuf *jpeg_load_at_size (const gchar *, int, int);
+#endif
+#ifdef FDUPVES_ENABLE_PNG
+#include <png.h>
+
+static GdkPixbuf *png_load_at_size (const gchar *, int, int);
+#endif
+
 GdkPixbuf *
 fdupves_gdkpixbuf_load_file_at_size (const gchar *file, int w, int h, GError **error)
 {
   GdkPixbuf *buf;
-#ifdef WIN32
+  struct stat st[1];
   int width, height;
+  guint64 limit;
   GdkPixbufFormat *format;
 
-  width = 0;
-  height = 0;
+  if (error)
+    {
+      *error = NULL;
+    }
 
-  format = gdk_pixbuf_get_file_info (file,
-				     &width, &height);
-  if (format == NULL)
+  if (g_ini->image_exif_thumb)
     {
-      g_warning ("Get file: %s infomation failed.", file);
+      buf = exif_thumb_at_size (file, w, h);
+      if (buf)
+	{
+	  return buf;
+	}
     }
-#endif
 
-  if (error)
+  buf = NULL;
+#ifdef FDUPVES_ENABLE_JPEG
+  buf = jpeg_load_at_size (file, w, h);
+#endif
+#ifdef FDUPVES_ENABLE_PNG
+  if (buf == NULL)
     {
-      *error = NULL;
+      buf = png_load_at_size (file, w, h);
     }
-#ifdef WIN32
-  if (width > 2000 && height > 2000)
+#endif
+
+  if (buf == NULL)
     {
-      buf = gdk_pixbuf_new_from_file_at_scale_wic (file,
+      width = 0;
+      height = 0;
+      format = NULL;
+      limit = (guint64) g_ini->image_memory_limit << 20;
+#ifndef WIN32
+      if (limit > 0)
+#endif
+	{
+	  format = gdk_pixbuf_get_file_info (file, &width, &height);
+	  if (format == NULL)
+	    {
+	      g_warning ("Get file: %s infomation failed.", file);
+	    }
+	}
+
+      /* gdk-pixbuf holds the whole image at its size, 4 bytes a pixel
+         at most, before scaling it down */
+      if (format && limit > 0 && (guint64) width * height * 4 > limit)
+	{
+	  g_set_error (error, GDK_PIXBUF_ERROR,
+		       GDK_PIXBUF_ERROR_INSUFFICIENT_MEMORY,
+		       _("%dx%d image is over the %d MB decode limit"),
+		       width, height, g_ini->image_memory_limit);
+	  return NULL;
+	}
+
+#ifdef WIN32
+      if (width > 2000 && height > 2000)
+	{
+	  buf = gdk_pixbuf_new_from_file_at_scale_wic (file,
+						       w,
+						       h,
+						       FALSE,
+						       error);
+	}
+      else
+#endif
+	{
+	  buf = gdk_pixbuf_new_from_file_at_scale (file,
 						   w,
 						   h,
 						   FALSE,
 						   error);
+	}
+    }
+
+  /* every decoder reads the whole file */
+  stats_add (FD_STAT_DECODES, 1);
+  if (g_stat (file, st) == 0)
+    {
+      stats_add (FD_STAT_BYTES, (gssize) st->st_size);
+    }
+
+  return buf;
+}
+
+static struct image_box *
+image_box_new (guint src_w, guint src_h, int w, int h)
+{
+  struct image_box *box;
+  guint x;
+
+  box = g_new0 (struct image_box, 1);
+  box->w = w;
+  box->h = h;
+  box->src_w = src_w;
+  box->src_h = src_h;
+  box->sums = g_new0 (guint64, (gsize) w * h * 3);
+  box->colx = g_new (guint, src_w);
+  box->coln = g_new0 (guint, w);
+  box->rown = g_new0 (guint, h);
+  for (x = 0; x < src_w; ++x)
+    {
+      box->colx[x] = (guint64) x * w / src_w;
+      ++box->coln[box->colx[x]];
+    }
+
+  return box;
+}
+
+/* add the RGB row y, of src_h rows, to its row of the box */
+static void
+image_box_row (struct image_box *box, guint y, const guchar *rgb)
+{
+  guint64 *sums;
+  guint x, ty;
+
+  if (y >= box->src_h)
+    {
+      return;
+    }
+  ty = (guint64) y * box->h / box->src_h;
+  ++box->rown[ty];
+  sums = box->sums + (gsize) ty * box->w * 3;
+  for (x = 0; x < box->src_w; ++x)
+    {
+      sums[box->colx[x] * 3] += rgb[x * 3];
+      sums[box->colx[x] * 3 + 1] += rgb[x * 3 + 1];
+      sums[box->colx[x] * 3 + 2] += rgb[x * 3 + 2];
+    }
+}
+
+/* the averages, NULL if some pixel got no row */
+static GdkPixbuf *
+image_box_pixbuf (struct image_box *box)
+{
+  GdkPixbuf *buf;
+  guchar *pixels, *p;
+  const guint64 *sums;
+  guint64 n;
+  int x, y, c, stride;
+
+  for (y = 0; y < box->h; ++y)
+    {
+      if (box->rown[y] == 0)
+	{
+	  return NULL;
+	}
+    }
+  for (x = 0; x < box->w; ++x)
+    {
+      if (box->coln[x] == 0)
+	{
+	  return NULL;
+	}
+    }
+
+  buf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, box->w, box->h);
+  if (buf == NULL)
+    {
+      return NULL;
+    }
+  pixels = gdk_pixbuf_get_pixels (buf);
+  stride = gdk_pixbuf_get_rowstride (buf);
+  sums = box->sums;
+  for (y = 0; y < box->h; ++y)
+    {
+      p = pixels + (gsize) y * stride;
+      for (x = 0; x < box->w; ++x)
+	{
+	  n = (guint64) box->coln[x] * box->rown[y];
+	  for (c = 0; c < 3; ++c)
+	    {
+	      *p++ = (*sums++ + n / 2) / n;
+	    }
+	}
+    }
+
+  return buf;
+}
+
+static void
+image_box_free (struct image_box *box)
+{
+  if (box)
+    {
+      g_free (box->sums);
+      g_free (box->colx);
+      g_free (box->coln);
+      g_free (box->rown);
+      g_free (box);
+    }
+}
+
+static guint
+exif_get16 (const guchar *p, gboolean motorola)
+{
+  return motorola ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+static guint32
+exif_get32 (const guchar *p, gboolean motorola)
+{
+  return motorola
+    ? ((guint32) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+    : ((guint32) p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+/* the entries of the IFD at offset: image size from IFD0 and the EXIF
+   sub IFD, thumbnail from IFD1.  *next is the offset of the next IFD,
+   or 0; the sub IFD is passed a NULL next and is only followed from
+   IFD0, so pointers that loop are not */
+static void
+exif_ifd (const guchar *tiff, gsize len, guint32 offset, gboolean first,
+	  struct exif_info *info, guint32 *next)
+{
+  const guchar *e;
+  guint i, n, tag, type;
+  guint32 value, sub;
+
+  if (next)
+    {
+      *next = 0;
+    }
+  if (offset < 8 || (gsize) offset + 2 > len)
+    {
+      return;
+    }
+  n = exif_get16 (tiff + offset, info->motorola);
+  if ((gsize) offset + 2 + (gsize) n * 12 + 4 > len)
+    {
+      return;
+    }
+
+  sub = 0;
+  for (i = 0; i < n; ++i)
+    {
+      e = tiff + offset + 2 + i * 12;
+      tag = exif_get16 (e, info->motorola);
+      type = exif_get16 (e + 2, info->motorola);
+      if (type == 3)		/* SHORT */
+	{
+	  value = exif_get16 (e + 8, info->motorola);
+	}
+      else if (type == 4)	/* LONG */
+	{
+	  value = exif_get32 (e + 8, info->motorola);
+	}
+      else
+	{
+	  continue;
+	}
+
+      switch (tag)
+	{
+	case 0x0100:		/* ImageWidth */
+	case 0xa002:		/* PixelXDimension */
+	  if (first)
+	    {
+	      info->width = value;
+	    }
+	  break;
+	case 0x0101:		/* ImageLength */
+	case 0xa003:		/* PixelYDimension */
+	  if (first)
+	    {
+	      info->height = value;
+	    }
+	  break;
+	case 0x8769:		/* ExifIFDPointer */
+	  if (first)
+	    {
+	      sub = value;
+	    }
+	  break;
+	case 0x0201:		/* JPEGInterchangeFormat */
+	  if (!first)
+	    {
+	      info->offset = value;
+	    }
+	  break;
+	case 0x0202:		/* JPEGInterchangeFormatLength */
+	  if (!first)
+	    {
+	      info->length = value;
+	    }
+	  break;
+	}
+    }
+
+  if (next)
+    {
+      *next = exif_get32 (tiff + offset + 2 + n * 12, info->motorola);
+    }
+  if (sub && next)
+    {
+      exif_ifd (tiff, len, sub, first, info, NULL);
+    }
+}
+
+/* a TIFF structure, as in an EXIF segment or at the head of a TIFF or
+   most RAW files; TRUE when IFD1 has a JPEG thumbnail */
+static gboolean
+exif_parse (const guchar *tiff, gsize len, struct exif_info *info)
+{
+  guint32 ifd1;
+
+  if (len < 8)
+    {
+      return FALSE;
+    }
+  if (memcmp (tiff, "MM\0*", 4) == 0)
+    {
+      info->motorola = TRUE;
+    }
+  else if (memcmp (tiff, "II*\0", 4) == 0)
+    {
+      info->motorola = FALSE;
+    }
+  else
+    {
+      return FALSE;
+    }
+
+  exif_ifd (tiff, len, exif_get32 (tiff + 4, info->motorola), TRUE,
+	    info, &ifd1);
+  exif_ifd (tiff, len, ifd1, FALSE, info, NULL);
+
+  return info->offset > 0 && info->length > 0;
+}
+
+/* the embedded EXIF thumbnail scaled to w x h, read from the first KBs
+   of the file.  NULL when there is none, when it is smaller than w x h
+   or when its aspect ratio is not the main image's, as the letterboxed
+   thumbnails of 3:2 cameras */
+static GdkPixbuf *
+exif_thumb_at_size (const gchar *file, int w, int h)
+{
+  FILE *fp;
+  guchar *head, mark[4], sof[5];
+  gsize len, base;
+  guint seg, marker;
+  guint64 tw, th;
+  struct exif_info info[1];
+  GdkPixbufLoader *loader;
+  GdkPixbuf *thumb, *buf;
+
+  if (w <= 0 || h <= 0)
+    {
+      return NULL;
+    }
+
+  fp = g_fopen (file, "rb");
+  if (fp == NULL)
+    {
+      return NULL;
+    }
+
+  memset (info, 0, sizeof (struct exif_info));
+  head = g_malloc (EXIF_HEAD_MAX);
+  len = 0;
+  base = 0;
+  if (fread (mark, 1, 2, fp) == 2 && mark[0] == 0xff && mark[1] == 0xd8)
+    {
+      /* JPEG: the APP1 segment for the thumbnail, the SOF for the
+         real size, which EXIF editors do not always keep */
+      while (fread (mark, 1, 4, fp) == 4 && mark[0] == 0xff)
+	{
+	  marker = mark[1];
+	  seg = (mark[2] << 8) | mark[3];
+	  if (seg < 2 || marker == 0xda || marker == 0xd9)
+	    {
+	      break;
+	    }
+	  seg -= 2;
+	  if (marker == 0xe1 && len == 0 && seg > 6)
+	    {
+	      if (fread (head, 1, seg, fp) != seg
+		  || memcmp (head, "Exif\0\0", 6) != 0)
+		{
+		  break;
+		}
+	      len = seg;
+	      base = 6;
+	      exif_parse (head + base, len - base, info);
+	    }
+	  else if (marker >= 0xc0 && marker <= 0xcf
+		   && marker != 0xc4 && marker != 0xc8 && marker != 0xcc)
+	    {
+	      /* precision, height, width */
+	      if (seg >= 5 && fread (sof, 1, 5, fp) == 5)
+		{
+		  info->height = (sof[1] << 8) | sof[2];
+		  info->width = (sof[3] << 8) | sof[4];
+		}
+	      break;
+	    }
+	  else if (fseek (fp, seg, SEEK_CUR) != 0)
+	    {
+	      break;
+	    }
+	}
+    }
+  else
+    {
+      rewind (fp);
+      len = fread (head, 1, EXIF_HEAD_MAX, fp);
+      exif_parse (head, len, info);
+    }
+  stats_add (FD_STAT_BYTES, ftell (fp));
+  fclose (fp);
+
+  buf = NULL;
+  if (info->offset == 0 || info->width == 0 || info->height == 0
+      || base + info->offset + info->length > len)
+    {
+      g_free (head);
+      return NULL;
+    }
+
+  loader = gdk_pixbuf_loader_new ();
+  thumb = NULL;
+  if (gdk_pixbuf_loader_write (loader, head + base + info->offset,
+			       info->length, NULL)
+      && gdk_pixbuf_loader_close (loader, NULL))
+    {
+      thumb = gdk_pixbuf_loader_get_pixbuf (loader);
     }
   else
+    {
+      gdk_pixbuf_loader_close (loader, NULL);
+    }
+  g_free (head);
+
+  if (thumb)
+    {
+      tw = gdk_pixbuf_get_width (thumb);
+      th = gdk_pixbuf_get_height (thumb);
+      /* within 2% of the main image's aspect ratio */
+      if (tw >= (guint64) w && th >= (guint64) h
+	  && 50 * (tw * info->height > th * info->width
+		   ? tw * info->height - th * info->width
+		   : th * info->width - tw * info->height)
+	  <= tw * info->height)
+	{
+	  buf = gdk_pixbuf_scale_simple (thumb, w, h, GDK_INTERP_BILINEAR);
+	  stats_add (FD_STAT_DECODES, 1);
+	}
+    }
+  g_object_unref (loader);
+
+  return buf;
+}
+
+#ifdef FDUPVES_ENABLE_JPEG
+/* everything jpeg_load_at_size must free after a longjmp, kept in
+   memory rather than in locals that setjmp may not restore */
+struct jpeg_scale
+{
+  struct jpeg_error_mgr pub;
+  jmp_buf jump;
+  FILE *fp;
+  struct image_box *box;
+};
+
+static void
+jpeg_scale_exit (j_common_ptr cinfo)
+{
+  struct jpeg_scale *scale;
+
+  scale = (struct jpeg_scale *) cinfo->err;
+  longjmp (scale->jump, 1);
+}
+
+static void
+jpeg_scale_message (j_common_ptr cinfo)
+{
+  /* warnings of corrupt data, gdk-pixbuf reports the real errors */
+}
+
+/* decode a JPEG straight from the DCT at 1/2, 1/4 or 1/8 scale, the
+   largest reduction that keeps at least w x h pixels, and box filter
+   the scanlines into w x h as they arrive.  returns NULL when the file
+   is not a JPEG or libjpeg can not decode it within image_memory_limit
+   (progressive files keep all their coefficients), gdk-pixbuf then
+   tries */
+static GdkPixbuf *
+jpeg_load_at_size (const gchar *file, int w, int h)
+{
+  struct jpeg_decompress_struct cinfo[1];
+  struct jpeg_scale scale[1];
+  guchar magic[3];
+  JSAMPARRAY row;
+  GdkPixbuf *buf;
+  int denom;
+
+  if (w <= 0 || h <= 0)
+    {
+      return NULL;
+    }
+
+  memset (scale, 0, sizeof (struct jpeg_scale));
+  scale->fp = g_fopen (file, "rb");
+  if (scale->fp == NULL)
+    {
+      return NULL;
+    }
+  if (fread (magic, 1, 3, scale->fp) != 3
+      || magic[0] != 0xff || magic[1] != 0xd8 || magic[2] != 0xff)
+    {
+      fclose (scale->fp);
+      return NULL;
+    }
+  rewind (scale->fp);
+
+  cinfo->err = jpeg_std_error (&scale->pub);
+  scale->pub.error_exit = jpeg_scale_exit;
+  scale->pub.output_message = jpeg_scale_message;
+  jpeg_create_decompress (cinfo);
+  if (setjmp (scale->jump))
+    {
+      jpeg_destroy_decompress (cinfo);
+      fclose (scale->fp);
+      image_box_free (scale->box);
+      return NULL;
+    }
+  if (g_ini->image_memory_limit > 0)
+    {
+      cinfo->mem->max_memory_to_use = (long) g_ini->image_memory_limit << 20;
+    }
+
+  jpeg_stdio_src (cinfo, scale->fp);
+  jpeg_read_header (cinfo, TRUE);
+
+  for (denom = 8; denom > 1; denom /= 2)
+    {
+      if ((cinfo->image_width + denom - 1) / denom >= (JDIMENSION) w
+	  && (cinfo->image_height + denom - 1) / denom >= (JDIMENSION) h)
+	{
+	  break;
+	}
+    }
+  cinfo->scale_num = 1;
+  cinfo->scale_denom = denom;
+  cinfo->out_color_space = JCS_RGB;
+  cinfo->dct_method = JDCT_IFAST;
+  cinfo->do_fancy_upsampling = FALSE;
+  cinfo->do_block_smoothing = FALSE;
+  jpeg_start_decompress (cinfo);
+
+  if (cinfo->output_components != 3
+      || cinfo->output_width < (JDIMENSION) w
+      || cinfo->output_height < (JDIMENSION) h)
+    {
+      /* smaller than asked, let gdk-pixbuf scale it up */
+      longjmp (scale->jump, 1);
+    }
+
+  row = (*cinfo->mem->alloc_sarray) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				     cinfo->output_width * 3, 1);
+  scale->box = image_box_new (cinfo->output_width, cinfo->output_height,
+			      w, h);
+  while (cinfo->output_scanline < cinfo->output_height)
+    {
+      jpeg_read_scanlines (cinfo, row, 1);
+      image_box_row (scale->box, cinfo->output_scanline - 1, row[0]);
+    }
+  jpeg_finish_decompress (cinfo);
+  jpeg_destroy_decompress (cinfo);
+  fclose (scale->fp);
+
+  buf = image_box_pixbuf (scale->box);
+  image_box_free (scale->box);
+
+  return buf;
+}
 #endif
+
+#ifdef FDUPVES_ENABLE_PNG
+/* freed after a longjmp, as struct jpeg_scale */
+struct png_scale
+{
+  FILE *fp;
+  struct image_box *box;
+  guchar *row;
+};
+
+static void
+png_scale_error (png_structp png, png_const_charp message)
+{
+  png_longjmp (png, 1);
+}
+
+static void
+png_scale_warning (png_structp png, png_const_charp message)
+{
+}
+
+/* decode a PNG a row at a time into the box filter: the memory is a
+   few rows whatever the image size.  an interlaced PNG is sampled by
+   the odd rows of its last pass, the only rows complete there.
+   returns NULL when the file is not a PNG or is smaller than w x h */
+static GdkPixbuf *
+png_load_at_size (const gchar *file, int w, int h)
+{
+  png_structp png;
+  png_infop info;
+  struct png_scale scale[1];
+  guchar magic[8];
+  png_uint_32 width, height, rows, y;
+  int depth, color, interlace, passes, pass;
+  GdkPixbuf *buf;
+
+  if (w <= 0 || h <= 0)
+    {
+      return NULL;
+    }
+
+  memset (scale, 0, sizeof (struct png_scale));
+  scale->fp = g_fopen (file, "rb");
+  if (scale->fp == NULL)
+    {
+      return NULL;
+    }
+  if (fread (magic, 1, 8, scale->fp) != 8 || png_sig_cmp (magic, 0, 8))
+    {
+      fclose (scale->fp);
+      return NULL;
+    }
+
+  png = png_create_read_struct (PNG_LIBPNG_VER_STRING, NULL,
+				png_scale_error, png_scale_warning);
+  info = png ? png_create_info_struct (png) : NULL;
+  if (info == NULL)
+    {
+      png_destroy_read_struct (&png, NULL, NULL);
+      fclose (scale->fp);
+      return NULL;
+    }
+  if (setjmp (png_jmpbuf (png)))
     {
-      buf = gdk_pixbuf_new_from_file_at_scale (file,
-					       w,
-					       h,
-					       FALSE,
-					       error);
+      png_destroy_read_struct (&png, &info, NULL);
+      fclose (scale->fp);
+      image_box_free (scale->box);
+      g_free (scale->row);
+      return NULL;
     }
 
+  png_init_io (png, scale->fp);
+  png_set_sig_bytes (png, 8);
+  png_read_info (png, info);
+  png_get_IHDR (png, info, &width, &height, &depth, &color, &interlace,
+		NULL, NULL);
+  png_set_expand (png);
+  png_set_strip_16 (png);
+  png_set_strip_alpha (png);
+  png_set_gray_to_rgb (png);
+  passes = png_set_interlace_handling (png);
+  png_read_update_info (png, info);
+
+  rows = passes > 1 ? height / 2 : height;
+  if (png_get_rowbytes (png, info) != (png_size_t) width * 3
+      || width < (png_uint_32) w || rows < (png_uint_32) h)
+    {
+      png_longjmp (png, 1);
+    }
+
+  scale->box = image_box_new (width, rows, w, h);
+  scale->row = g_malloc ((gsize) width * 3);
+  for (pass = 0; pass < passes; ++pass)
+    {
+      for (y = 0; y < height; ++y)
+	{
+	  png_read_row (png, scale->row, NULL);
+	  if (pass < passes - 1)
+	    {
+	      continue;
+	    }
+	  if (passes == 1)
+	    {
+	      image_box_row (scale->box, y, scale->row);
+	    }
+	  else if (y & 1)
+	    {
+	      image_box_row (scale->box, y / 2, scale->row);
+	    }
+	}
+    }
+  png_destroy_read_struct (&png, &info, NULL);
+  fclose (scale->fp);
+
+  buf = image_box_pixbuf (scale->box);
+  image_box_free (scale->box);
+  g_free (scale->row);
+
   return buf;
 }
+#endif
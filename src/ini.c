@@ -27,6 +27,7 @@
 
 #include "ini.h"
 #include "util.h"
+#include "hash.h"
 
 #include <glib.h>
 
@@ -113,14 +114,41 @@ ini_new ()
 
   ini->compare_area = 0;
 
+  ini->hash_bits = 64;
+  ini->phash_bits = 64;
+  ini->dhash_bits = 64;
+
   ini->compare_count = 4;
 
+#if GLIB_CHECK_VERSION(2, 36, 0)
+  ini->jobs = g_get_num_processors ();
+#else
+  ini->jobs = 1;
+#endif
+
   ini->same_image_distance = 5;
   ini->same_video_distance = 5;
 
+  ini->image_screen = FDUPVES_HASH_HASH;
+  ini->screen_image_distance = 12;
+  ini->verify_image_distance = 10;
+  ini->phash_dihedral = FALSE;
+  ini->image_exif_thumb = FALSE;
+  ini->image_memory_limit = 0;
+
   ini->thumb_size[0] = 512;
   ini->thumb_size[1] = 384;
 
+  ini->thumb_dir = g_build_filename (g_get_user_cache_dir (),
+				     "fdupves-thumbnails",
+				     NULL);
+  ini->thumb_cache_size = 256;
+
+  ini->cost_file = g_build_filename (g_get_user_cache_dir (),
+				     "fdupves-cost.txt",
+				     NULL);
+  ini->cost_top = 20;
+
   ini->video_timers[0][0] = 10;
   ini->video_timers[0][1] = 120;
   ini->video_timers[0][2] = 4;
@@ -202,6 +230,86 @@ ini_load (ini_t *ini, const gchar *file)
                                                   NULL);
     }
 
+  if (g_key_file_has_key (ini->keyfile, "_", "hash_bits", NULL))
+    {
+      ini->hash_bits = g_key_file_get_integer (ini->keyfile,
+					       "_",
+					       "hash_bits",
+					       NULL);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "phash_bits", NULL))
+    {
+      ini->phash_bits = g_key_file_get_integer (ini->keyfile,
+						"_",
+						"phash_bits",
+						NULL);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "dhash_bits", NULL))
+    {
+      ini->dhash_bits = g_key_file_get_integer (ini->keyfile,
+						"_",
+						"dhash_bits",
+						NULL);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "image_screen", NULL))
+    {
+      gchar *phrase;
+
+      phrase = g_key_file_get_string (ini->keyfile, "_", "image_screen", NULL);
+      if (g_strcmp0 (phrase, hash_phrase[FDUPVES_HASH_DHASH]) == 0)
+	{
+	  ini->image_screen = FDUPVES_HASH_DHASH;
+	}
+      else
+	{
+	  ini->image_screen = FDUPVES_HASH_HASH;
+	}
+      g_free (phrase);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "screen_image_distance", NULL))
+    {
+      ini->screen_image_distance = g_key_file_get_integer (ini->keyfile,
+							   "_",
+							   "screen_image_distance",
+							   NULL);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "verify_image_distance", NULL))
+    {
+      ini->verify_image_distance = g_key_file_get_integer (ini->keyfile,
+							   "_",
+							   "verify_image_distance",
+							   NULL);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "phash_dihedral", NULL))
+    {
+      ini->phash_dihedral = g_key_file_get_boolean (ini->keyfile,
+						    "_",
+						    "phash_dihedral",
+						    NULL);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "image_exif_thumb", NULL))
+    {
+      ini->image_exif_thumb = g_key_file_get_boolean (ini->keyfile,
+						      "_",
+						      "image_exif_thumb",
+						      NULL);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "image_memory_limit", NULL))
+    {
+      ini->image_memory_limit = g_key_file_get_integer (ini->keyfile,
+							"_",
+							"image_memory_limit",
+							NULL);
+    }
+
   if (g_key_file_has_key (ini->keyfile, "_", "compare_count", NULL))
     {
       ini->compare_count = g_key_file_get_integer (ini->keyfile,
@@ -210,6 +318,57 @@ ini_load (ini_t *ini, const gchar *file)
 						   NULL);
     }
 
+  if (g_key_file_has_key (ini->keyfile, "_", "jobs", NULL))
+    {
+      ini->jobs = g_key_file_get_integer (ini->keyfile,
+					  "_",
+					  "jobs",
+					  NULL);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "thumb_dir", NULL))
+    {
+      g_free (ini->thumb_dir);
+      ini->thumb_dir = g_key_file_get_string (ini->keyfile,
+					      "_",
+					      "thumb_dir",
+					      NULL);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "thumb_cache_size", NULL))
+    {
+      ini->thumb_cache_size = g_key_file_get_integer (ini->keyfile,
+						      "_",
+						      "thumb_cache_size",
+						      NULL);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "cost_file", NULL))
+    {
+      g_free (ini->cost_file);
+      ini->cost_file = g_key_file_get_string (ini->keyfile,
+					      "_",
+					      "cost_file",
+					      NULL);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "cost_top", NULL))
+    {
+      ini->cost_top = g_key_file_get_integer (ini->keyfile,
+					      "_",
+					      "cost_top",
+					      NULL);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "metrics_listen", NULL))
+    {
+      g_free (ini->metrics_listen);
+      ini->metrics_listen = g_key_file_get_string (ini->keyfile,
+						   "_",
+						   "metrics_listen",
+						   NULL);
+    }
+
   return TRUE;
 }
 
@@ -225,7 +384,25 @@ ini_save (ini_t *ini, const gchar *file)
   g_key_file_set_boolean (ini->keyfile, "_", "proc_image", ini->proc_image);
   g_key_file_set_boolean (ini->keyfile, "_", "proc_video", ini->proc_video);
   g_key_file_set_integer (ini->keyfile, "_", "compare_area", ini->compare_area);
+  g_key_file_set_integer (ini->keyfile, "_", "hash_bits", ini->hash_bits);
+  g_key_file_set_integer (ini->keyfile, "_", "phash_bits", ini->phash_bits);
+  g_key_file_set_integer (ini->keyfile, "_", "dhash_bits", ini->dhash_bits);
+  g_key_file_set_string (ini->keyfile, "_", "image_screen", hash_phrase[ini->image_screen]);
+  g_key_file_set_integer (ini->keyfile, "_", "screen_image_distance", ini->screen_image_distance);
+  g_key_file_set_integer (ini->keyfile, "_", "verify_image_distance", ini->verify_image_distance);
+  g_key_file_set_boolean (ini->keyfile, "_", "phash_dihedral", ini->phash_dihedral);
+  g_key_file_set_boolean (ini->keyfile, "_", "image_exif_thumb", ini->image_exif_thumb);
+  g_key_file_set_integer (ini->keyfile, "_", "image_memory_limit", ini->image_memory_limit);
   g_key_file_set_integer (ini->keyfile, "_", "compare_count", ini->compare_count);
+  g_key_file_set_integer (ini->keyfile, "_", "jobs", ini->jobs);
+  g_key_file_set_string (ini->keyfile, "_", "thumb_dir", ini->thumb_dir);
+  g_key_file_set_integer (ini->keyfile, "_", "thumb_cache_size", ini->thumb_cache_size);
+  g_key_file_set_string (ini->keyfile, "_", "cost_file", ini->cost_file);
+  g_key_file_set_integer (ini->keyfile, "_", "cost_top", ini->cost_top);
+  if (ini->metrics_listen)
+    {
+      g_key_file_set_string (ini->keyfile, "_", "metrics_listen", ini->metrics_listen);
+    }
 
   data = g_key_file_to_data (ini->keyfile, &len, NULL);
   g_file_set_contents (path, data, len, NULL);
@@ -244,5 +421,8 @@ void ini_free (ini_t *ini)
     }
 
   g_key_file_free (ini->keyfile);
+  g_free (ini->thumb_dir);
+  g_free (ini->cost_file);
+  g_free (ini->metrics_listen);
   g_free (ini);
 }
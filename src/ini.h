@@ -42,15 +42,52 @@ typedef struct
 
   gint compare_area;
 
+  /* width of the hash/phash/dhash values, 64, 128 or 256 bits */
+  gint hash_bits;
+  gint phash_bits;
+  gint dhash_bits;
+
   gboolean proc_other;
 
   gint compare_count;
 
+  gint jobs;
+
   gint same_video_distance;
   gint same_image_distance;
 
+  /*
+   * images are screened by image_screen (FDUPVES_HASH_HASH or _DHASH)
+   * at the loose screen_image_distance, the candidates are verified by
+   * phash at verify_image_distance
+   * */
+  gint image_screen;
+  gint screen_image_distance;
+  gint verify_image_distance;
+
+  /* match the rotated and mirrored copies too */
+  gboolean phash_dihedral;
+
+  /* hash the thumbnail embedded in EXIF, not the decoded image */
+  gboolean image_exif_thumb;
+
+  /* images gdk-pixbuf would decode in more MB are skipped, 0 (the
+     default) no limit */
+  gint image_memory_limit;
+
   gint thumb_size[2];
 
+  /* thumbnail cache on disk, size in MB, 0 to disable */
+  gchar *thumb_dir;
+  gint thumb_cache_size;
+
+  /* slowest files report of a scan, 0 files to disable */
+  gchar *cost_file;
+  gint cost_top;
+
+  /* prometheus endpoint while scanning, "[host]:port" or a socket path */
+  gchar *metrics_listen;
+
   gint video_timers[0x10][3];
 
   gchar *cache_file;
@@ -25,14 +25,16 @@
  */
 /* @date Created: 2013/01/16 10:12:33 Alf*/
 
-#include "gui.h"
-#include "ini.h"
+#include "cli.h"
+#include "fdupves.h"
 #include "util.h"
-#include "cache.h"
-
-#include <libavformat/avformat.h>
+#ifndef FDUPVES_HEADLESS
+#include "gui.h"
+#endif
 
+#ifndef FDUPVES_HEADLESS
 #include <gtk/gtk.h>
+#endif
 #include <glib/gstdio.h>
 #include <locale.h>
 
@@ -53,8 +55,6 @@
 #include <google/profiler.h>
 #endif
 
-static void fdupves_cleanup ();
-
 int
 main (int argc, char *argv[])
 {
@@ -80,9 +80,6 @@ main (int argc, char *argv[])
       g_free (localedir);
     }
 
-  /* av format init */
-  av_register_all ();
-
 #ifdef WIN32
   /* com init */
   CoInitializeEx (NULL, COINIT_MULTITHREADED);
@@ -95,13 +92,23 @@ main (int argc, char *argv[])
       g_thread_init (NULL);
     }
 #endif
+
+#ifdef FDUPVES_HEADLESS
+  return cli_main (argc, argv);
+#else
+  /* headless scan never touches the display */
+  if (cli_is_headless (argc, argv))
+    {
+      return cli_main (argc, argv);
+    }
+
   gdk_threads_init ();
 
   gtk_init (&argc, &argv);
 
-  gui_init (argc, argv);
+  fdupves_init (FD_USR_CONF_FILE);
 
-  cache_new (g_ini->cache_file);
+  gui_init (argc, argv);
 
   gdk_threads_enter ();
 #ifdef FDUPVES_ENABLE_PROFILER
@@ -113,17 +120,8 @@ main (int argc, char *argv[])
 #endif
   gdk_threads_leave ();
 
-  fdupves_cleanup ();
+  fdupves_shutdown ();
 
   return 0;
-}
-
-static void
-fdupves_cleanup ()
-{
-  if (g_cache)
-    {
-      cache_save (g_cache, g_ini->cache_file);
-      cache_free (g_cache);
-    }
+#endif
 }
@@ -0,0 +1,453 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE metrics.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "metrics.h"
+#include "stats.h"
+#include "hash.h"
+#include "util.h"
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+static const gchar *metrics_results[] =
+  {
+    "hit",
+    "miss",
+    "stale",
+  };
+
+gchar *
+metrics_text ()
+{
+  GString *text;
+  gssize hit, total;
+  gdouble elapsed;
+  int alg, r;
+
+  text = g_string_new (NULL);
+
+  g_string_append (text,
+		   "# HELP fdupves_files_discovered_total Files found by the directory walk.\n"
+		   "# TYPE fdupves_files_discovered_total counter\n");
+  g_string_append_printf (text,
+			  "fdupves_files_discovered_total{type=\"image\"} %"
+			  G_GSSIZE_FORMAT "\n"
+			  "fdupves_files_discovered_total{type=\"video\"} %"
+			  G_GSSIZE_FORMAT "\n",
+			  stats_get (FD_STAT_IMAGES),
+			  stats_get (FD_STAT_VIDEOS));
+
+  g_string_append_printf (text,
+			  "# HELP fdupves_files_hashed_total Hash values computed, not from the cache.\n"
+			  "# TYPE fdupves_files_hashed_total counter\n"
+			  "fdupves_files_hashed_total %" G_GSSIZE_FORMAT "\n",
+			  stats_get (FD_STAT_HASHES));
+
+  g_string_append_printf (text,
+			  "# HELP fdupves_decodes_total Decoder calls.\n"
+			  "# TYPE fdupves_decodes_total counter\n"
+			  "fdupves_decodes_total %" G_GSSIZE_FORMAT "\n"
+			  "# HELP fdupves_read_bytes_total Bytes read by the decoders.\n"
+			  "# TYPE fdupves_read_bytes_total counter\n"
+			  "fdupves_read_bytes_total %" G_GSSIZE_FORMAT "\n",
+			  stats_get (FD_STAT_DECODES),
+			  stats_get (FD_STAT_BYTES));
+
+  g_string_append (text,
+		   "# HELP fdupves_cache_requests_total Hash cache lookups.\n"
+		   "# TYPE fdupves_cache_requests_total counter\n");
+  hit = total = 0;
+  for (alg = 0; alg < FDUPVES_HASH_ALGS_CNT; ++ alg)
+    {
+      for (r = 0; r < 3; ++ r)
+	{
+	  g_string_append_printf (text,
+				  "fdupves_cache_requests_total{alg=\"%s\","
+				  "result=\"%s\"} %" G_GSSIZE_FORMAT "\n",
+				  hash_phrase[alg], metrics_results[r],
+				  stats_get (FD_STAT_CACHE (alg, r)));
+	  total += stats_get (FD_STAT_CACHE (alg, r));
+	}
+      hit += stats_get (FD_STAT_CACHE (alg, FD_STAT_HIT));
+    }
+  g_string_append_printf (text,
+			  "# HELP fdupves_cache_hit_ratio Cache hits of all the lookups.\n"
+			  "# TYPE fdupves_cache_hit_ratio gauge\n"
+			  "fdupves_cache_hit_ratio %.4f\n",
+			  total ? (gdouble) hit / total : 0);
+
+  g_string_append_printf (text,
+			  "# HELP fdupves_pairs_total Candidate pairs.\n"
+			  "# TYPE fdupves_pairs_total counter\n"
+			  "fdupves_pairs_total{state=\"compared\"} %"
+			  G_GSSIZE_FORMAT "\n"
+			  "fdupves_pairs_total{state=\"verified\"} %"
+			  G_GSSIZE_FORMAT "\n"
+			  "fdupves_pairs_total{state=\"same\"} %"
+			  G_GSSIZE_FORMAT "\n",
+			  stats_get (FD_STAT_PAIRS_COMPARED),
+			  stats_get (FD_STAT_PAIRS_VERIFIED),
+			  stats_get (FD_STAT_PAIRS_SAME));
+
+  g_string_append_printf (text,
+			  "# HELP fdupves_jobs_done_total Files done by the hash and length jobs.\n"
+			  "# TYPE fdupves_jobs_done_total counter\n"
+			  "fdupves_jobs_done_total %" G_GSSIZE_FORMAT "\n"
+			  "# HELP fdupves_queue_depth Files waiting for the hash and length jobs.\n"
+			  "# TYPE fdupves_queue_depth gauge\n"
+			  "fdupves_queue_depth %" G_GSSIZE_FORMAT "\n",
+			  stats_get (FD_STAT_JOBS_DONE),
+			  stats_get (FD_STAT_JOBS_QUEUED));
+
+  elapsed = stats_elapsed ();
+  g_string_append_printf (text,
+			  "# HELP fdupves_scan_seconds Time since the scan started.\n"
+			  "# TYPE fdupves_scan_seconds gauge\n"
+			  "fdupves_scan_seconds %.3f\n"
+			  "# HELP fdupves_throughput_files_per_second Jobs done per second of the scan.\n"
+			  "# TYPE fdupves_throughput_files_per_second gauge\n"
+			  "fdupves_throughput_files_per_second %.3f\n",
+			  elapsed,
+			  elapsed > 0 ? stats_get (FD_STAT_JOBS_DONE) / elapsed : 0);
+
+  g_string_append_printf (text,
+			  "# HELP fdupves_stage The stage the scan is in.\n"
+			  "# TYPE fdupves_stage gauge\n"
+			  "fdupves_stage{stage=\"%s\"} 1\n",
+			  stats_get_stage ());
+
+  return g_string_free (text, FALSE);
+}
+
+#if !defined (WIN32) && GLIB_CHECK_VERSION(2, 32, 0)
+
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifndef FDUPVES_METRICS_BACKLOG
+#define FDUPVES_METRICS_BACKLOG 4
+#endif
+
+/* how often the thread looks at the quit flag, in ms */
+#define METRICS_POLL_INTERVAL 200
+
+static struct
+{
+  int sock;
+  gchar *unix_path;
+  GThread *thread;
+  volatile gint quit;
+} metrics[1] = { { -1, NULL, NULL, 0 } };
+
+static int metrics_listen_tcp (const gchar *);
+static int metrics_listen_unix (const gchar *);
+static gpointer metrics_thread (gpointer);
+static void metrics_client (int);
+static gboolean metrics_send (int, const gchar *);
+
+gboolean
+metrics_start (const gchar *addr)
+{
+  g_return_val_if_fail (metrics->thread == NULL, FALSE);
+
+  if (strchr (addr, '/'))
+    {
+      metrics->sock = metrics_listen_unix (addr);
+    }
+  else
+    {
+      metrics->sock = metrics_listen_tcp (addr);
+    }
+  if (metrics->sock < 0)
+    {
+      return FALSE;
+    }
+
+  g_atomic_int_set (&metrics->quit, FALSE);
+  metrics->thread = g_thread_try_new ("metrics", metrics_thread, NULL, NULL);
+  if (metrics->thread == NULL)
+    {
+      g_warning ("create metrics thread failed");
+      metrics_stop ();
+      return FALSE;
+    }
+
+  g_message (_ ("serve metrics on: %s"), addr);
+
+  return TRUE;
+}
+
+void
+metrics_stop ()
+{
+  if (metrics->thread)
+    {
+      g_atomic_int_set (&metrics->quit, TRUE);
+      g_thread_join (metrics->thread);
+      metrics->thread = NULL;
+    }
+
+  if (metrics->sock >= 0)
+    {
+      close (metrics->sock);
+      metrics->sock = -1;
+    }
+
+  if (metrics->unix_path)
+    {
+      unlink (metrics->unix_path);
+      g_free (metrics->unix_path);
+      metrics->unix_path = NULL;
+    }
+}
+
+static int
+metrics_listen_tcp (const gchar *addr)
+{
+  struct addrinfo hints[1], *res, *ai;
+  gchar *host;
+  const gchar *port;
+  int sock, on, ret;
+
+  port = strrchr (addr, ':');
+  if (port)
+    {
+      host = g_strndup (addr, port - addr);
+      ++ port;
+    }
+  else
+    {
+      host = g_strdup ("");
+      port = addr;
+    }
+
+  memset (hints, 0, sizeof hints);
+  hints->ai_family = AF_UNSPEC;
+  hints->ai_socktype = SOCK_STREAM;
+  hints->ai_flags = AI_PASSIVE;
+  ret = getaddrinfo (host[0] ? host : "127.0.0.1", port, hints, &res);
+  g_free (host);
+  if (ret != 0)
+    {
+      g_warning ("metrics address: %s is invalid: %s",
+		 addr, gai_strerror (ret));
+      return -1;
+    }
+
+  sock = -1;
+  for (ai = res; ai; ai = ai->ai_next)
+    {
+      sock = socket (ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (sock < 0)
+	{
+	  continue;
+	}
+
+      on = 1;
+      setsockopt (sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+      if (bind (sock, ai->ai_addr, ai->ai_addrlen) == 0
+	  && listen (sock, FDUPVES_METRICS_BACKLOG) == 0)
+	{
+	  break;
+	}
+
+      close (sock);
+      sock = -1;
+    }
+  freeaddrinfo (res);
+
+  if (sock < 0)
+    {
+      g_warning ("listen on: %s failed: %s", addr, strerror (errno));
+    }
+
+  return sock;
+}
+
+static int
+metrics_listen_unix (const gchar *path)
+{
+  struct sockaddr_un addr[1];
+  int sock;
+
+  if (strlen (path) >= sizeof addr->sun_path)
+    {
+      g_warning ("socket path: %s is too long", path);
+      return -1;
+    }
+
+  sock = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0)
+    {
+      g_warning ("create socket failed: %s", strerror (errno));
+      return -1;
+    }
+
+  memset (addr, 0, sizeof addr);
+  addr->sun_family = AF_UNIX;
+  g_snprintf (addr->sun_path, sizeof addr->sun_path, "%s", path);
+  unlink (path);
+
+  if (bind (sock, (struct sockaddr *) addr, sizeof addr) < 0
+      || listen (sock, FDUPVES_METRICS_BACKLOG) < 0)
+    {
+      g_warning ("listen on: %s failed: %s", path, strerror (errno));
+      close (sock);
+      return -1;
+    }
+
+  metrics->unix_path = g_strdup (path);
+
+  return sock;
+}
+
+static gpointer
+metrics_thread (gpointer arg)
+{
+  struct pollfd pfd[1];
+  int client;
+
+  pfd->fd = metrics->sock;
+  pfd->events = POLLIN;
+  while (!g_atomic_int_get (&metrics->quit))
+    {
+      if (poll (pfd, 1, METRICS_POLL_INTERVAL) <= 0)
+	{
+	  continue;
+	}
+
+      client = accept (metrics->sock, NULL, NULL);
+      if (client >= 0)
+	{
+	  metrics_client (client);
+	  close (client);
+	}
+    }
+
+  return NULL;
+}
+
+/* one request per connection, the scrapers don't keep it alive */
+static void
+metrics_client (int client)
+{
+  struct pollfd pfd[1];
+  gchar request[0x1000], *body, *head;
+  gsize len;
+  ssize_t n;
+  gboolean found;
+
+  /* the request line and the headers, a slow client is dropped */
+  len = 0;
+  pfd->fd = client;
+  pfd->events = POLLIN;
+  while (len < sizeof request - 1)
+    {
+      if (poll (pfd, 1, 1000) <= 0)
+	{
+	  return;
+	}
+      n = recv (client, request + len, sizeof request - 1 - len, 0);
+      if (n <= 0)
+	{
+	  return;
+	}
+      len += n;
+      request[len] = '\0';
+      if (strstr (request, "\r\n\r\n") || strstr (request, "\n\n"))
+	{
+	  break;
+	}
+    }
+
+  found = strncmp (request, "GET /metrics", 12) == 0
+    || strncmp (request, "GET / ", 6) == 0;
+  body = found ? metrics_text () : g_strdup ("not found\n");
+  head = g_strdup_printf ("HTTP/1.0 %s\r\n"
+			  "Content-Type: text/plain; version=0.0.4\r\n"
+			  "Content-Length: %lu\r\n"
+			  "Connection: close\r\n"
+			  "\r\n",
+			  found ? "200 OK" : "404 Not Found",
+			  (unsigned long) strlen (body));
+
+  if (metrics_send (client, head))
+    {
+      metrics_send (client, body);
+    }
+
+  g_free (head);
+  g_free (body);
+}
+
+static gboolean
+metrics_send (int client, const gchar *data)
+{
+  gsize len;
+  ssize_t n;
+
+  len = strlen (data);
+  while (len > 0)
+    {
+      n = send (client, data, len, MSG_NOSIGNAL);
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    {
+	      continue;
+	    }
+	  return FALSE;
+	}
+      data += n;
+      len -= n;
+    }
+
+  return TRUE;
+}
+
+#else
+
+gboolean
+metrics_start (const gchar *addr)
+{
+  g_warning ("metrics endpoint is not supported on this platform");
+  return FALSE;
+}
+
+void
+metrics_stop ()
+{
+}
+
+#endif
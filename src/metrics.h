@@ -0,0 +1,47 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE metrics.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_METRICS_H_
+#define _FDUPVES_METRICS_H_
+
+#include <glib.h>
+
+/*
+ * Serve the scan statistics in the prometheus text format over HTTP,
+ * from a background thread, on GET /metrics.
+ *
+ * The address is "[host]:port", the host defaults to 127.0.0.1,
+ * or the path of a UNIX domain socket when it has a '/'.
+ * */
+gboolean metrics_start (const gchar *);
+
+/* stop serving, waits for the thread */
+void metrics_stop ();
+
+/* the text served on GET /metrics */
+gchar * metrics_text ();
+
+#endif
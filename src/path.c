@@ -0,0 +1,296 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE path.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "path.h"
+#include "util.h"
+
+#include <glib.h>
+#include <string.h>
+
+typedef struct
+{
+  /* index in arena->dirs */
+  guint32 dir;
+
+  /* offset of the NUL terminated base name in arena->names */
+  guint32 name;
+} path_entry;
+
+/*
+ * a directory is kept with its trailing separator, so a path is the
+ * plain concatenation of the directory and the name, "" for a name
+ * without directory.
+ * */
+static struct
+{
+  GArray *entries;
+  GByteArray *names;
+
+  GPtrArray *dirs;
+  /* dir => index + 1 */
+  GHashTable *dirtable;
+
+  /* entry index, hashed by dir and name */
+  GHashTable *table;
+
+  /* the walk adds the files of a dir in a row */
+  guint32 lastdir;
+} arena[1];
+
+G_LOCK_DEFINE_STATIC (arena);
+
+static void path_setup ();
+static guint32 path_dir_intern (const gchar *, gsize);
+static guint path_entry_hash (gconstpointer);
+static gboolean path_entry_equal (gconstpointer, gconstpointer);
+
+fd_path_id
+path_intern (const gchar *path)
+{
+  path_entry entry;
+  const gchar *name;
+  gpointer orig;
+  fd_path_id id;
+
+  /* the name is after the last separator */
+  for (name = path + strlen (path); name > path; -- name)
+    {
+      if (G_IS_DIR_SEPARATOR (name[-1]))
+	{
+	  break;
+	}
+    }
+
+  G_LOCK (arena);
+  if (arena->entries == NULL)
+    {
+      path_setup ();
+    }
+
+  entry.dir = path_dir_intern (path, name - path);
+  entry.name = arena->names->len;
+  g_byte_array_append (arena->names, (const guint8 *) name,
+		       strlen (name) + 1);
+
+  /* added to look it up, removed if it's there */
+  id = arena->entries->len;
+  g_array_append_val (arena->entries, entry);
+  if (g_hash_table_lookup_extended (arena->table, GUINT_TO_POINTER (id),
+				    &orig, NULL))
+    {
+      g_array_set_size (arena->entries, id);
+      g_byte_array_set_size (arena->names, entry.name);
+      id = GPOINTER_TO_UINT (orig);
+    }
+  else
+    {
+      g_hash_table_insert (arena->table, GUINT_TO_POINTER (id), NULL);
+    }
+  G_UNLOCK (arena);
+
+  return id;
+}
+
+gsize
+path_copy (fd_path_id id, gchar *buf, gsize len)
+{
+  const path_entry *entry;
+  const gchar *dir, *name;
+  gsize dirlen, namelen;
+
+  G_LOCK (arena);
+  if (arena->entries == NULL || id >= arena->entries->len)
+    {
+      G_UNLOCK (arena);
+      g_warning ("Invalid path id: %u", id);
+      if (len > 0)
+	{
+	  buf[0] = '\0';
+	}
+      return 0;
+    }
+
+  entry = &g_array_index (arena->entries, path_entry, id);
+  dir = g_ptr_array_index (arena->dirs, entry->dir);
+  name = (const gchar *) arena->names->data + entry->name;
+  dirlen = strlen (dir);
+  namelen = strlen (name);
+  if (len > 0)
+    {
+      g_strlcpy (buf, dir, len);
+      if (dirlen < len)
+	{
+	  g_strlcpy (buf + dirlen, name, len - dirlen);
+	}
+    }
+  G_UNLOCK (arena);
+
+  return dirlen + namelen;
+}
+
+gchar *
+path_dup (fd_path_id id)
+{
+  gchar buf[PATH_MAX], *path;
+  gsize len;
+
+  len = path_copy (id, buf, sizeof buf);
+  if (len < sizeof buf)
+    {
+      return g_strdup (buf);
+    }
+
+  path = g_malloc (len + 1);
+  path_copy (id, path, len + 1);
+
+  return path;
+}
+
+gchar *
+path_dup_name (fd_path_id id)
+{
+  gchar *path, *name;
+
+  path = path_dup (id);
+  name = g_path_get_basename (path);
+  g_free (path);
+
+  return name;
+}
+
+gchar *
+path_dup_dir (fd_path_id id)
+{
+  gchar *path, *dir;
+
+  path = path_dup (id);
+  dir = g_path_get_dirname (path);
+  g_free (path);
+
+  return dir;
+}
+
+guint
+path_count ()
+{
+  guint n;
+
+  G_LOCK (arena);
+  n = arena->entries ? arena->entries->len : 0;
+  G_UNLOCK (arena);
+
+  return n;
+}
+
+gsize
+path_memory ()
+{
+  gsize n;
+  guint i;
+
+  G_LOCK (arena);
+  n = 0;
+  if (arena->entries)
+    {
+      n = arena->entries->len * sizeof (path_entry) + arena->names->len;
+      for (i = 0; i < arena->dirs->len; ++ i)
+	{
+	  n += strlen (g_ptr_array_index (arena->dirs, i)) + 1;
+	}
+    }
+  G_UNLOCK (arena);
+
+  return n;
+}
+
+static void
+path_setup ()
+{
+  arena->entries = g_array_new (FALSE, FALSE, sizeof (path_entry));
+  arena->names = g_byte_array_new ();
+  arena->dirs = g_ptr_array_new ();
+  arena->dirtable = g_hash_table_new (g_str_hash, g_str_equal);
+  arena->table = g_hash_table_new (path_entry_hash, path_entry_equal);
+  arena->lastdir = G_MAXUINT32;
+}
+
+static guint32
+path_dir_intern (const gchar *path, gsize len)
+{
+  const gchar *last;
+  gchar *dir;
+  guint32 index;
+
+  if (arena->lastdir != G_MAXUINT32)
+    {
+      last = g_ptr_array_index (arena->dirs, arena->lastdir);
+      if (strlen (last) == len && strncmp (last, path, len) == 0)
+	{
+	  return arena->lastdir;
+	}
+    }
+
+  dir = g_strndup (path, len);
+  index = GPOINTER_TO_UINT (g_hash_table_lookup (arena->dirtable, dir));
+  if (index)
+    {
+      g_free (dir);
+      -- index;
+    }
+  else
+    {
+      index = arena->dirs->len;
+      g_ptr_array_add (arena->dirs, dir);
+      g_hash_table_insert (arena->dirtable, dir, GUINT_TO_POINTER (index + 1));
+    }
+  arena->lastdir = index;
+
+  return index;
+}
+
+/* called with the arena locked */
+static guint
+path_entry_hash (gconstpointer key)
+{
+  const path_entry *entry;
+
+  entry = &g_array_index (arena->entries, path_entry, GPOINTER_TO_UINT (key));
+
+  return g_str_hash (arena->names->data + entry->name) * 31 + entry->dir;
+}
+
+static gboolean
+path_entry_equal (gconstpointer a, gconstpointer b)
+{
+  const path_entry *ea, *eb;
+
+  ea = &g_array_index (arena->entries, path_entry, GPOINTER_TO_UINT (a));
+  eb = &g_array_index (arena->entries, path_entry, GPOINTER_TO_UINT (b));
+
+  return ea->dir == eb->dir
+    && strcmp ((const gchar *) arena->names->data + ea->name,
+	       (const gchar *) arena->names->data + eb->name) == 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE path.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_PATH_H_
+#define _FDUPVES_PATH_H_
+
+#include <glib.h>
+
+/*
+ * all the paths of the scans, each stored once and named by a 32 bit
+ * id. the directory of a path is stored once too, a path is its
+ * directory id and its base name.
+ *
+ * the arena only grows, the ids are valid for the process.
+ * */
+typedef guint32 fd_path_id;
+
+#define FD_PATH_NONE G_MAXUINT32
+
+/* the id of the path, the same for the same string */
+fd_path_id path_intern (const gchar *);
+
+/* like g_strlcpy, returns the length of the path */
+gsize path_copy (fd_path_id, gchar *, gsize);
+
+gchar * path_dup (fd_path_id);
+
+/* the base name, like g_path_get_basename */
+gchar * path_dup_name (fd_path_id);
+
+/* the directory with no trailing separator, like g_path_get_dirname */
+gchar * path_dup_dir (fd_path_id);
+
+guint path_count ();
+
+/* bytes held by the arena */
+gsize path_memory ();
+
+#endif
@@ -26,64 +26,34 @@
 
 #include "hash.h"
 #include "util.h"
+#include "ini.h"
 #include "video.h"
 #include "image.h"
 #include "cache.h"
+#include "trace.h"
+#include "stats.h"
 
 #include <glib.h>
 #include <math.h>
+#include <string.h>
 
-#define FDUPVES_PHASH_LEN 32
-#define FDUPVES_DCT_LEN 8
-
-static hash_t pixbuf_phash (GdkPixbuf *);
-static gboolean buffer_dct (const unsigned char *,
-			    unsigned char *, gsize);
+static const gdouble *get_coefficients ();
 static const gdouble *get_coefficient ();
 static const gdouble *get_coefficient_t ();
 static void matrix_mul (const gdouble *, const gdouble *,
 			gdouble *);
+static void dct_coefficients (const unsigned char *, gdouble *);
+static hash_t phash_signs (const gdouble *, int, int);
 
 hash_t
 file_phash (const char *file)
 {
-  GdkPixbuf *buf;
-  hash_t h;
-  GError *err;
-
-  if (g_cache)
-    {
-      if (cache_get (g_cache, file, 0, FDUPVES_HASH_PHASH, &h))
-	{
-	  return h;
-	}
-    }
-
-  err = NULL;
-  buf = fdupves_gdkpixbuf_load_file_at_size (file,
-					     FDUPVES_PHASH_LEN,
-					     FDUPVES_PHASH_LEN,
-					     &err);
-
-  if (err)
-    {
-      g_warning ("Load file: %s to pixbuf failed: %s", file, err->message);
-      g_error_free (err);
-      return 0;
-    }
-
-  h = pixbuf_phash (buf);
-  g_object_unref (buf);
+  hash_t hashs[FDUPVES_HASH_ALGS_CNT];
 
-  if (g_cache)
-    {
-      if (h)
-	{
-	  cache_set (g_cache, file, 0, FDUPVES_HASH_PHASH, h);
-	}
-    }
+  /* the cache key has one producer, see file_hashes */
+  file_hashes (file, 1u << FDUPVES_HASH_PHASH, hashs);
 
-  return h;
+  return hashs[FDUPVES_HASH_PHASH];
 }
 
 hash_t
@@ -107,7 +77,8 @@ buffer_phash (const char *buffer, int size)
     {
       g_warning ("Load inline data to pixbuf failed: %s", err->message);
       g_error_free (err);
-      return 0;
+      memset (&h, 0, sizeof h);
+      return h;
     }
 
   h = pixbuf_phash (buf);
@@ -121,13 +92,16 @@ video_time_phash (const char *file, int time)
 {
   hash_t h;
   gchar buffer[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN * 3];
+  gint64 t;
+  int bits;
 #ifdef _DEBUG
   gchar *basename, outfile[PATH_MAX];
 #endif
 
+  bits = hash_bits (FDUPVES_HASH_PHASH);
   if (g_cache)
     {
-      if (cache_get (g_cache, file, time, FDUPVES_HASH_PHASH, &h))
+      if (cache_get (g_cache, file, time, phash_type (), bits, &h))
 	{
 	  return h;
 	}
@@ -149,29 +123,36 @@ video_time_phash (const char *file, int time)
 			      outfile);
 #endif
 
+  t = trace_begin ();
   h = buffer_phash (buffer, sizeof buffer);
+  trace_end (t, "phash", file);
+  stats_add (FD_STAT_HASHES, 1);
 
   if (g_cache)
     {
-      if (h)
+      if (!HASH_IS_NULL (h))
 	{
-	  cache_set (g_cache, file, time, FDUPVES_HASH_PHASH, h);
+	  cache_set (g_cache, file, time, phash_type (), bits, h);
 	}
     }
 
   return h;
 }
 
-static hash_t
+/* the low frequency block of the dct, its size is the grid of phash_bits */
+hash_t
 pixbuf_phash (GdkPixbuf *pixbuf)
 {
   int width, height, rowstride, n_channels;
   guchar *pixels, *p;
-  int sum, avg, x, y, off;
+  int sum, avg, x, y, off, cols, rows;
   hash_t hash;
   unsigned char *grays,
     dct[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN],
-    dctc[FDUPVES_DCT_LEN * FDUPVES_DCT_LEN];
+    dctc[FDUPVES_HASH_BITS_MAX];
+  gdouble coeffs[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN];
+
+  hash_grid (hash_bits (FDUPVES_HASH_PHASH), &cols, &rows);
 
   n_channels = gdk_pixbuf_get_n_channels (pixbuf);
 
@@ -196,13 +177,20 @@ pixbuf_phash (GdkPixbuf *pixbuf)
 	}
     }
 
+  if (g_ini->phash_dihedral)
+    {
+      dct_coefficients (grays, coeffs);
+      g_free (grays);
+      return phash_signs (coeffs, cols, rows);
+    }
+
   buffer_dct (grays, dct, sizeof dct);
 
   sum = 0;
   off = 0;
-  for (x = 0; x < FDUPVES_DCT_LEN; ++ x)
+  for (x = 0; x < rows; ++ x)
     {
-      for (y = 0; y < FDUPVES_DCT_LEN; ++ y)
+      for (y = 0; y < cols; ++ y)
 	{
 	  sum += dct[x * FDUPVES_PHASH_LEN + y];
 	  dctc[off] = dct[x * FDUPVES_PHASH_LEN + y];
@@ -211,44 +199,30 @@ pixbuf_phash (GdkPixbuf *pixbuf)
     }
   avg = sum / off;
 
-  hash = 0;
+  memset (&hash, 0, sizeof hash);
   for (x = 0; x < off; ++ x)
     {
       if (dctc[x] >= avg)
 	{
-	  hash |= (((hash_t) 1) << x);
+	  hash.w[x >> 6] |= (guint64) 1 << (x & 63);
 	}
     }
+  hash.valid = TRUE;
 
   g_free (grays);
 
   return hash;
 }
 
-static gboolean
+gboolean
 buffer_dct (const unsigned char *pix, unsigned char *out_pix, gsize out_len)
 {
-  const gdouble *quotient, *quotientT;
-  gdouble matrix[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN],
-    temp[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN];
+  gdouble matrix[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN];
   gsize i, j;
 
   g_assert (out_len >= FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN);
 
-  for(i = 0; i < FDUPVES_PHASH_LEN; i ++)
-    {
-      for(j = 0; j < FDUPVES_PHASH_LEN; j ++)
-	{
-	  matrix[i * FDUPVES_PHASH_LEN + j] =
-	    (gdouble) (pix[i * FDUPVES_PHASH_LEN + j]);
-	}
-    }
-
-  quotient = get_coefficient ();
-  quotientT = get_coefficient_t ();
-
-  matrix_mul (quotient, matrix, temp);
-  matrix_mul (temp, quotientT, matrix);
+  dct_coefficients (pix, matrix);
 
   for (i = 0; i < FDUPVES_PHASH_LEN; i ++)
     {
@@ -262,67 +236,171 @@ buffer_dct (const unsigned char *pix, unsigned char *out_pix, gsize out_len)
   return TRUE;
 }
 
-static const gdouble *
-get_coefficient_t ()
+/*
+ * the orientations of a dihedral hash. its bits are the signs of the
+ * coefficients, bit (r, c) of the block is row frequency r and column
+ * frequency c. a mirror negates the odd columns, a vertical flip the
+ * odd rows, a transpose swaps r and c, so an orientation is only bit
+ * flips and a permutation.
+ * * */
+hash_t
+phash_orient (const hash_t *h, int bits, int variant)
 {
-  gsize i, j;
-  static gdouble *coeff_s;
-  const gdouble *c;
+  hash_t o;
+  int cols, rows, r, c, sr, sc, bit;
 
-  if (coeff_s)
+  hash_grid (bits, &cols, &rows);
+  memset (&o, 0, sizeof o);
+  o.valid = h->valid;
+  for (r = 0; r < rows; ++ r)
     {
-      return coeff_s;
+      for (c = 0; c < cols; ++ c)
+	{
+	  sr = variant & 4 ? c : r;
+	  sc = variant & 4 ? r : c;
+	  bit = sr * cols + sc;
+	  if (((h->w[bit >> 6] >> (bit & 63)) & 1)
+	      ^ ((variant & 1) && (sc & 1))
+	      ^ ((variant & 2) && (sr & 1)))
+	    {
+	      bit = r * cols + c;
+	      o.w[bit >> 6] |= (guint64) 1 << (bit & 63);
+	    }
+	}
     }
 
-  coeff_s = g_new (gdouble, FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN);
-  g_assert (coeff_s);
+  return o;
+}
+
+/* the distance of the nearest orientation of a to b */
+int
+phash_cmp_dihedral (const hash_t *a, const hash_t *b, int bits)
+{
+  hash_cmp_func cmp;
+  hash_t o;
+  int cnt, v, dist, min;
 
-  c = get_coefficient ();
+  cmp = hash_cmp_kernel (bits);
+  cnt = hash_orient_count (bits);
 
-  for (i = 0; i < FDUPVES_PHASH_LEN; i ++)
+  min = cmp (a, b);
+  for (v = 1; v < cnt && min > 0; ++ v)
     {
-      for (j = 0; j < FDUPVES_PHASH_LEN; j ++)
+      o = phash_orient (a, bits, v);
+      dist = cmp (&o, b);
+      if (dist < min)
 	{
-	  coeff_s[i * FDUPVES_PHASH_LEN + j] =
-	    c[j * FDUPVES_PHASH_LEN + i];
+	  min = dist;
 	}
     }
 
-  return coeff_s;
+  return min;
 }
 
-static const gdouble *
-get_coefficient ()
+int
+phash_type ()
 {
-  gsize i, j;
-  static gdouble *coeff_s = NULL;
-  gdouble s;
+  return g_ini->phash_dihedral ? FDUPVES_HASH_DPHASH : FDUPVES_HASH_PHASH;
+}
+
+/* the DC bit is always set, it is the positive mean */
+static hash_t
+phash_signs (const gdouble *coeffs, int cols, int rows)
+{
+  hash_t hash;
+  int r, c, bit;
 
-  if (coeff_s)
+  memset (&hash, 0, sizeof hash);
+  for (r = 0; r < rows; ++ r)
     {
-      return coeff_s;
+      for (c = 0; c < cols; ++ c)
+	{
+	  if ((r == 0 && c == 0) || coeffs[r * FDUPVES_PHASH_LEN + c] > 0)
+	    {
+	      bit = r * cols + c;
+	      hash.w[bit >> 6] |= (guint64) 1 << (bit & 63);
+	    }
+	}
     }
+  hash.valid = TRUE;
 
-  coeff_s = g_new (gdouble, FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN);
-  g_assert (coeff_s);
+  return hash;
+}
+
+static void
+dct_coefficients (const unsigned char *pix, gdouble *matrix)
+{
+  gdouble temp[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN];
+  gsize i, j;
 
-  s = 1.0 / sqrt (FDUPVES_PHASH_LEN);
   for (i = 0; i < FDUPVES_PHASH_LEN; i ++)
     {
-      coeff_s[i] = s;
+      for (j = 0; j < FDUPVES_PHASH_LEN; j ++)
+	{
+	  matrix[i * FDUPVES_PHASH_LEN + j] =
+	    (gdouble) (pix[i * FDUPVES_PHASH_LEN + j]);
+	}
     }
-  for (i = 1; i < FDUPVES_PHASH_LEN; i ++)
+
+  matrix_mul (get_coefficient (), matrix, temp);
+  matrix_mul (temp, get_coefficient_t (), matrix);
+}
+
+/* the DCT matrix followed by its transpose, built once: hashing runs
+   on the worker pool, the tables must be complete before any thread
+   sees them */
+static const gdouble *
+get_coefficients ()
+{
+  static gsize coeff_once = 0;
+  static gdouble coeff_s[2 * FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN];
+  gdouble *t;
+  gsize i, j;
+  gdouble s;
+
+  if (g_once_init_enter (&coeff_once))
     {
-      for (j = 0; j < FDUPVES_PHASH_LEN; j ++)
+      s = 1.0 / sqrt (FDUPVES_PHASH_LEN);
+      for (i = 0; i < FDUPVES_PHASH_LEN; i ++)
 	{
-	  coeff_s[i * FDUPVES_PHASH_LEN + j] = sqrt (2.0 / FDUPVES_PHASH_LEN)
-	    * cos (i * M_PI * (j + 0.5) / (gdouble) FDUPVES_PHASH_LEN);
+	  coeff_s[i] = s;
 	}
+      for (i = 1; i < FDUPVES_PHASH_LEN; i ++)
+	{
+	  for (j = 0; j < FDUPVES_PHASH_LEN; j ++)
+	    {
+	      coeff_s[i * FDUPVES_PHASH_LEN + j] = sqrt (2.0 / FDUPVES_PHASH_LEN)
+		* cos (i * M_PI * (j + 0.5) / (gdouble) FDUPVES_PHASH_LEN);
+	    }
+	}
+
+      t = coeff_s + FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN;
+      for (i = 0; i < FDUPVES_PHASH_LEN; i ++)
+	{
+	  for (j = 0; j < FDUPVES_PHASH_LEN; j ++)
+	    {
+	      t[i * FDUPVES_PHASH_LEN + j] = coeff_s[j * FDUPVES_PHASH_LEN + i];
+	    }
+	}
+
+      g_once_init_leave (&coeff_once, 1);
     }
 
   return coeff_s;
 }
 
+static const gdouble *
+get_coefficient_t ()
+{
+  return get_coefficients () + FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN;
+}
+
+static const gdouble *
+get_coefficient ()
+{
+  return get_coefficients ();
+}
+
 static void
 matrix_mul (const gdouble *A, const gdouble *B, gdouble *matrix)
 {
@@ -0,0 +1,895 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE result.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "util.h"
+#include "ini.h"
+#include "video.h"
+#include "result.h"
+
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include <string.h>
+
+static file_node * file_node_new (same_node *,
+				  fd_path_id, gint);
+static void file_node_free (file_node *);
+static void same_node_free (same_node *);
+static gboolean same_node_wanted (same_node *, const GArray *);
+
+/* the metadata of a file, loaded by ResultModel->probe */
+typedef struct
+{
+  same_type type;
+  fd_path_id id;
+
+  gint size;
+  gint width, height;
+  gdouble length;
+  gchar *format;
+} result_probe;
+
+static void result_probe_run (result_probe *, ResultModel *);
+static void result_probe_load (result_probe *);
+static gboolean result_probe_drain (ResultModel *);
+static void result_probe_apply (ResultModel *, result_probe *);
+static void result_probe_free (result_probe *);
+
+static void result_model_tree_model_init (GtkTreeModelIface *);
+static void result_model_finalize (GObject *);
+
+static GtkTreeModelFlags result_model_get_flags (GtkTreeModel *);
+static gint result_model_get_n_columns (GtkTreeModel *);
+static GType result_model_get_column_type (GtkTreeModel *, gint);
+static gboolean result_model_get_iter (GtkTreeModel *, GtkTreeIter *,
+				       GtkTreePath *);
+static GtkTreePath * result_model_get_path (GtkTreeModel *, GtkTreeIter *);
+static void result_model_get_value (GtkTreeModel *, GtkTreeIter *,
+				    gint, GValue *);
+static gboolean result_model_iter_next (GtkTreeModel *, GtkTreeIter *);
+static gboolean result_model_iter_children (GtkTreeModel *, GtkTreeIter *,
+					    GtkTreeIter *);
+static gboolean result_model_iter_has_child (GtkTreeModel *, GtkTreeIter *);
+static gint result_model_iter_n_children (GtkTreeModel *, GtkTreeIter *);
+static gboolean result_model_iter_nth_child (GtkTreeModel *, GtkTreeIter *,
+					     GtkTreeIter *, gint);
+static gboolean result_model_iter_parent (GtkTreeModel *, GtkTreeIter *,
+					  GtkTreeIter *);
+
+/*
+ * iter->user_data is the same_node, iter->user_data2 the GSList link
+ * of the file in same_node->files, the first link is the top row.
+ * */
+#define ITER_NODE(itr) ((same_node *) (itr)->user_data)
+#define ITER_LINK(itr) ((GSList *) (itr)->user_data2)
+#define ITER_IS_TOP(itr) (ITER_LINK (itr) == ITER_NODE (itr)->files)
+
+/* the n-th shown row in rows, the row shown by rows[i], and the count,
+ * see ResultModel->gap */
+#define ROW_INDEX(m, n) ((n) < (m)->gap ? (n) : (n) + (m)->gap_len)
+#define ROW_OF(m, i) ((i) < (m)->gap ? (i) : (i) - (m)->gap_len)
+#define ROW_COUNT(m) ((m)->rows->len - (m)->gap_len)
+
+G_DEFINE_TYPE_WITH_CODE (ResultModel, result_model, G_TYPE_OBJECT,
+			 G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+						result_model_tree_model_init));
+
+static void
+result_model_class_init (ResultModelClass *klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = result_model_finalize;
+}
+
+static void
+result_model_tree_model_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags = result_model_get_flags;
+  iface->get_n_columns = result_model_get_n_columns;
+  iface->get_column_type = result_model_get_column_type;
+  iface->get_iter = result_model_get_iter;
+  iface->get_path = result_model_get_path;
+  iface->get_value = result_model_get_value;
+  iface->iter_next = result_model_iter_next;
+  iface->iter_children = result_model_iter_children;
+  iface->iter_has_child = result_model_iter_has_child;
+  iface->iter_n_children = result_model_iter_n_children;
+  iface->iter_nth_child = result_model_iter_nth_child;
+  iface->iter_parent = result_model_iter_parent;
+}
+
+static void
+result_model_init (ResultModel *model)
+{
+  gint i;
+
+  model->stamp = g_random_int ();
+  model->groups = g_ptr_array_new_with_free_func ((GDestroyNotify) same_node_free);
+  model->rows = g_ptr_array_new ();
+  for (i = 0; i < G_N_ELEMENTS (model->files); ++ i)
+    {
+      model->files[i] = g_hash_table_new (g_direct_hash, g_direct_equal);
+    }
+
+  model->probed = g_async_queue_new ();
+  model->probe = g_thread_pool_new ((GFunc) result_probe_run, model,
+				    g_ini && g_ini->jobs > 1 ? g_ini->jobs : 1,
+				    FALSE, NULL);
+}
+
+static void
+result_model_finalize (GObject *object)
+{
+  ResultModel *model;
+  result_probe *probe;
+  gint i;
+
+  model = RESULT_MODEL (object);
+
+  if (model->probe)
+    {
+      g_thread_pool_free (model->probe, TRUE, TRUE);
+    }
+  /* the workers are done, an idle they scheduled must not run on the
+     freed model */
+  if (g_atomic_int_get (&model->draining))
+    {
+      g_source_remove (model->drain_id);
+    }
+  while ((probe = g_async_queue_try_pop (model->probed)) != NULL)
+    {
+      result_probe_free (probe);
+    }
+  g_async_queue_unref (model->probed);
+
+  result_model_clear (model);
+  g_ptr_array_free (model->rows, TRUE);
+  g_ptr_array_free (model->groups, TRUE);
+  for (i = 0; i < G_N_ELEMENTS (model->files); ++ i)
+    {
+      g_hash_table_destroy (model->files[i]);
+    }
+
+  G_OBJECT_CLASS (result_model_parent_class)->finalize (object);
+}
+
+ResultModel *
+result_model_new ()
+{
+  return g_object_new (RESULT_TYPE_MODEL, NULL);
+}
+
+void
+result_model_clear (ResultModel *model)
+{
+  gint i;
+
+  /* the keys belong to the file_node */
+  for (i = 0; i < G_N_ELEMENTS (model->files); ++ i)
+    {
+      g_hash_table_remove_all (model->files[i]);
+    }
+  g_ptr_array_set_size (model->rows, 0);
+  g_ptr_array_set_size (model->groups, 0);
+
+  ++ model->stamp;
+}
+
+same_node *
+result_model_add_group (ResultModel *model, same_type type)
+{
+  same_node *node;
+
+  node = g_malloc0 (sizeof (same_node));
+  g_return_val_if_fail (node, NULL);
+
+  node->type = type;
+  node->id = model->groups->len;
+  node->row = -1;
+  node->show = TRUE;
+
+  g_ptr_array_add (model->groups, node);
+
+  return node;
+}
+
+file_node *
+result_model_add_file (ResultModel *model,
+		       same_node *node, fd_path_id id)
+{
+  file_node *fn;
+  result_probe *probe;
+  GtkTreePath *tpath;
+  GtkTreeIter itr[1];
+
+  fn = file_node_new (node, id,
+		      node->type == FD_SAME_IMAGE ?
+		      FD_IMAGE : FD_VIDEO);
+  g_hash_table_insert (model->files[node->type], GUINT_TO_POINTER (id), fn);
+
+  if (model->probe)
+    {
+      probe = g_malloc0 (sizeof (result_probe));
+      probe->type = node->type;
+      probe->id = id;
+      ++ model->probing;
+      g_thread_pool_push (model->probe, probe, NULL);
+    }
+  else
+    {
+      result_model_probe_file (model, fn);
+    }
+
+  if (node->files->next == NULL)
+    {
+      /* the first file, a new top row */
+      if (!node->show)
+	{
+	  return fn;
+	}
+
+      node->row = model->rows->len;
+      g_ptr_array_add (model->rows, node);
+
+      itr->stamp = model->stamp;
+      itr->user_data = node;
+      itr->user_data2 = node->files;
+      tpath = gtk_tree_path_new_from_indices (node->row, -1);
+      gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), tpath, itr);
+      gtk_tree_path_free (tpath);
+    }
+  else if (node->row >= 0)
+    {
+      itr->stamp = model->stamp;
+      itr->user_data = node;
+      itr->user_data2 = g_slist_last (node->files);
+      tpath = result_model_get_path (GTK_TREE_MODEL (model), itr);
+      gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), tpath, itr);
+      gtk_tree_path_free (tpath);
+
+      if (node->files->next->next == NULL)
+	{
+	  itr->user_data2 = node->files;
+	  tpath = gtk_tree_path_new_from_indices (node->row, -1);
+	  gtk_tree_model_row_has_child_toggled (GTK_TREE_MODEL (model),
+						tpath, itr);
+	  gtk_tree_path_free (tpath);
+	}
+    }
+
+  return fn;
+}
+
+file_node *
+result_model_lookup (ResultModel *model,
+		     same_type type, fd_path_id id)
+{
+  return g_hash_table_lookup (model->files[type], GUINT_TO_POINTER (id));
+}
+
+void
+result_model_probe_file (ResultModel *model, file_node *fn)
+{
+  result_probe probe[1];
+
+  if (fn->probed)
+    {
+      return;
+    }
+
+  memset (probe, 0, sizeof probe);
+  probe->type = fn->node->type;
+  probe->id = fn->id;
+  result_probe_load (probe);
+  result_probe_apply (model, probe);
+  g_free (probe->format);
+}
+
+void
+result_model_remove_file (ResultModel *model, file_node *fn)
+{
+  same_node *node;
+
+  node = fn->node;
+
+  g_hash_table_remove (model->files[node->type], GUINT_TO_POINTER (fn->id));
+  node->files = g_slist_remove (node->files, fn);
+  file_node_free (fn);
+
+  if (node->files && node->files->next == NULL)
+    {
+      result_model_remove_file (model, node->files->data);
+    }
+
+  ++ model->stamp;
+}
+
+/*
+ * the rows are changed in two passes, the deleted ones forward and the
+ * inserted ones backward, each in place. the rows between are a gap
+ * which is skipped, so the model is right at each signal without
+ * moving the rows after a change.
+ * */
+void
+result_model_refilter (ResultModel *model, const GArray *ids)
+{
+  GPtrArray *want;
+  same_node *node;
+  GtkTreePath *tpath;
+  GtkTreeIter itr[1];
+  guint i, n, r, w;
+
+  /* the new rows, in the order of the ids as the old ones */
+  want = g_ptr_array_new ();
+  n = ids ? ids->len : model->groups->len;
+  for (i = 0; i < n; ++ i)
+    {
+      r = ids ? g_array_index (ids, guint, i) : i;
+      g_return_if_fail (r < model->groups->len);
+
+      node = g_ptr_array_index (model->groups, r);
+      if (node->show && node->files)
+	{
+	  g_ptr_array_add (want, node);
+	}
+    }
+
+  /* rows[0, gap) are kept, rows[gap + gap_len, len) not seen yet */
+  model->gap = 0;
+  model->gap_len = 0;
+  for (r = 0; r < model->rows->len; ++ r)
+    {
+      node = g_ptr_array_index (model->rows, r);
+      if (same_node_wanted (node, ids))
+	{
+	  g_ptr_array_index (model->rows, model->gap) = node;
+	  node->row = model->gap ++;
+	  continue;
+	}
+
+      node->row = -1;
+      ++ model->gap_len;
+      tpath = gtk_tree_path_new_from_indices (model->gap, -1);
+      gtk_tree_model_row_deleted (GTK_TREE_MODEL (model), tpath);
+      gtk_tree_path_free (tpath);
+    }
+
+  /* rows[0, r) are kept, rows[w, len) placed */
+  r = model->gap;
+  w = want->len;
+  g_ptr_array_set_size (model->rows, w);
+  model->gap_len = w - r;
+  for (i = want->len; i -- > 0; )
+    {
+      node = g_ptr_array_index (want, i);
+      if (node->row >= 0)
+	{
+	  g_ptr_array_index (model->rows, -- w) = node;
+	  node->row = w;
+	  model->gap = -- r;
+	  continue;
+	}
+
+      g_ptr_array_index (model->rows, -- w) = node;
+      node->row = w;
+      -- model->gap_len;
+
+      itr->stamp = model->stamp;
+      itr->user_data = node;
+      itr->user_data2 = node->files;
+      tpath = gtk_tree_path_new_from_indices (r, -1);
+      gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), tpath, itr);
+      if (node->files->next)
+	{
+	  gtk_tree_model_row_has_child_toggled (GTK_TREE_MODEL (model),
+						tpath, itr);
+	}
+      gtk_tree_path_free (tpath);
+    }
+
+  model->gap = 0;
+  model->gap_len = 0;
+  g_ptr_array_free (want, TRUE);
+}
+
+GtkTreePath *
+result_model_get_file_path (ResultModel *model, file_node *fn)
+{
+  GtkTreeIter itr[1];
+
+  if (fn->node->row < 0)
+    {
+      return NULL;
+    }
+
+  itr->stamp = model->stamp;
+  itr->user_data = fn->node;
+  itr->user_data2 = g_slist_find (fn->node->files, fn);
+  g_return_val_if_fail (itr->user_data2, NULL);
+
+  return result_model_get_path (GTK_TREE_MODEL (model), itr);
+}
+
+static GtkTreeModelFlags
+result_model_get_flags (GtkTreeModel *tree)
+{
+  return 0;
+}
+
+static gint
+result_model_get_n_columns (GtkTreeModel *tree)
+{
+  return RESULT_N_COLS;
+}
+
+static GType
+result_model_get_column_type (GtkTreeModel *tree, gint column)
+{
+  g_return_val_if_fail (column >= 0 && column < RESULT_N_COLS,
+			G_TYPE_INVALID);
+
+  if (column == RESULT_COL_NODE)
+    {
+      return G_TYPE_POINTER;
+    }
+
+  return G_TYPE_STRING;
+}
+
+static gboolean
+result_model_get_iter (GtkTreeModel *tree, GtkTreeIter *itr,
+		       GtkTreePath *tpath)
+{
+  ResultModel *model;
+  same_node *node;
+  GSList *link;
+  gint depth, *indices;
+
+  model = RESULT_MODEL (tree);
+
+  depth = gtk_tree_path_get_depth (tpath);
+  indices = gtk_tree_path_get_indices (tpath);
+  if (depth < 1 || depth > 2
+      || indices[0] < 0 || indices[0] >= ROW_COUNT (model))
+    {
+      return FALSE;
+    }
+
+  node = g_ptr_array_index (model->rows, ROW_INDEX (model, indices[0]));
+  link = node->files;
+  if (depth == 2)
+    {
+      if (indices[1] < 0)
+	{
+	  return FALSE;
+	}
+      link = g_slist_nth (node->files, indices[1] + 1);
+      if (link == NULL)
+	{
+	  return FALSE;
+	}
+    }
+
+  itr->stamp = model->stamp;
+  itr->user_data = node;
+  itr->user_data2 = link;
+
+  return TRUE;
+}
+
+static GtkTreePath *
+result_model_get_path (GtkTreeModel *tree, GtkTreeIter *itr)
+{
+  GtkTreePath *tpath;
+
+  g_return_val_if_fail (itr->stamp == RESULT_MODEL (tree)->stamp, NULL);
+
+  tpath = gtk_tree_path_new_from_indices (ROW_OF (RESULT_MODEL (tree),
+						  ITER_NODE (itr)->row),
+					  -1);
+  if (!ITER_IS_TOP (itr))
+    {
+      gtk_tree_path_append_index (tpath,
+				  g_slist_position (ITER_NODE (itr)->files,
+						    ITER_LINK (itr)) - 1);
+    }
+
+  return tpath;
+}
+
+static void
+result_model_get_value (GtkTreeModel *tree, GtkTreeIter *itr,
+			gint column, GValue *value)
+{
+  file_node *fn;
+
+  g_return_if_fail (itr->stamp == RESULT_MODEL (tree)->stamp);
+
+  fn = ITER_LINK (itr)->data;
+
+  /* formatted here, only the visible rows are asked for */
+  switch (column)
+    {
+    case RESULT_COL_PATH:
+      g_value_init (value, G_TYPE_STRING);
+      g_value_take_string (value, path_dup (fn->id));
+      break;
+
+    case RESULT_COL_IMAGE_SIZE:
+      g_value_init (value, G_TYPE_STRING);
+      g_value_take_string (value,
+			   g_strdup_printf ("%u:%u",
+					    fn->width, fn->height));
+      break;
+
+    case RESULT_COL_FILE_SIZE:
+      g_value_init (value, G_TYPE_STRING);
+#if GLIB_CHECK_VERSION (2, 30, 0)
+      g_value_take_string (value, g_format_size (fn->size));
+#else
+      g_value_take_string (value, g_strdup_printf ("%d", fn->size));
+#endif
+      break;
+
+    case RESULT_COL_LENGTH:
+      g_value_init (value, G_TYPE_STRING);
+      g_value_take_string (value, g_strdup_printf ("%f", fn->length));
+      break;
+
+    case RESULT_COL_FORMAT:
+      g_value_init (value, G_TYPE_STRING);
+      g_value_set_string (value, fn->format);
+      break;
+
+    case RESULT_COL_NODE:
+      g_value_init (value, G_TYPE_POINTER);
+      g_value_set_pointer (value, fn);
+      break;
+
+    default:
+      g_return_if_reached ();
+    }
+}
+
+static gboolean
+result_model_iter_next (GtkTreeModel *tree, GtkTreeIter *itr)
+{
+  ResultModel *model;
+  same_node *node;
+  guint n;
+
+  model = RESULT_MODEL (tree);
+  g_return_val_if_fail (itr->stamp == model->stamp, FALSE);
+
+  if (ITER_IS_TOP (itr))
+    {
+      n = ROW_OF (model, ITER_NODE (itr)->row) + 1;
+      if (n >= ROW_COUNT (model))
+	{
+	  return FALSE;
+	}
+      node = g_ptr_array_index (model->rows, ROW_INDEX (model, n));
+      itr->user_data = node;
+      itr->user_data2 = node->files;
+    }
+  else
+    {
+      if (ITER_LINK (itr)->next == NULL)
+	{
+	  return FALSE;
+	}
+      itr->user_data2 = ITER_LINK (itr)->next;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+result_model_iter_children (GtkTreeModel *tree, GtkTreeIter *itr,
+			    GtkTreeIter *parent)
+{
+  return result_model_iter_nth_child (tree, itr, parent, 0);
+}
+
+static gboolean
+result_model_iter_has_child (GtkTreeModel *tree, GtkTreeIter *itr)
+{
+  g_return_val_if_fail (itr->stamp == RESULT_MODEL (tree)->stamp, FALSE);
+
+  return ITER_IS_TOP (itr) && ITER_LINK (itr)->next != NULL;
+}
+
+static gint
+result_model_iter_n_children (GtkTreeModel *tree, GtkTreeIter *itr)
+{
+  if (itr == NULL)
+    {
+      return ROW_COUNT (RESULT_MODEL (tree));
+    }
+
+  g_return_val_if_fail (itr->stamp == RESULT_MODEL (tree)->stamp, 0);
+
+  if (!ITER_IS_TOP (itr))
+    {
+      return 0;
+    }
+
+  return g_slist_length (ITER_LINK (itr)) - 1;
+}
+
+static gboolean
+result_model_iter_nth_child (GtkTreeModel *tree, GtkTreeIter *itr,
+			     GtkTreeIter *parent, gint n)
+{
+  ResultModel *model;
+  same_node *node;
+  GSList *link;
+
+  model = RESULT_MODEL (tree);
+
+  if (n < 0)
+    {
+      return FALSE;
+    }
+
+  if (parent == NULL)
+    {
+      if (n >= ROW_COUNT (model))
+	{
+	  return FALSE;
+	}
+      node = g_ptr_array_index (model->rows, ROW_INDEX (model, n));
+      link = node->files;
+    }
+  else
+    {
+      g_return_val_if_fail (parent->stamp == model->stamp, FALSE);
+
+      if (!ITER_IS_TOP (parent))
+	{
+	  return FALSE;
+	}
+      node = ITER_NODE (parent);
+      link = g_slist_nth (node->files, n + 1);
+      if (link == NULL)
+	{
+	  return FALSE;
+	}
+    }
+
+  itr->stamp = model->stamp;
+  itr->user_data = node;
+  itr->user_data2 = link;
+
+  return TRUE;
+}
+
+static gboolean
+result_model_iter_parent (GtkTreeModel *tree, GtkTreeIter *itr,
+			  GtkTreeIter *child)
+{
+  g_return_val_if_fail (child->stamp == RESULT_MODEL (tree)->stamp, FALSE);
+
+  if (ITER_IS_TOP (child))
+    {
+      return FALSE;
+    }
+
+  itr->stamp = child->stamp;
+  itr->user_data = ITER_NODE (child);
+  itr->user_data2 = ITER_NODE (child)->files;
+
+  return TRUE;
+}
+
+static file_node *
+file_node_new (same_node *node, fd_path_id id, gint type)
+{
+  file_node *fn;
+
+  fn = g_malloc0 (sizeof (file_node));
+  g_return_val_if_fail (fn, NULL);
+
+  fn->id = id;
+  fn->type = type;
+
+  fn->node = node;
+  node->files = g_slist_append (node->files, fn);
+
+  return fn;
+}
+
+static void
+result_probe_run (result_probe *probe, ResultModel *model)
+{
+  result_probe_load (probe);
+
+  g_async_queue_push (model->probed, probe);
+  /* one idle applies all the queued results */
+  if (g_atomic_int_compare_and_exchange (&model->draining, FALSE, TRUE))
+    {
+      model->drain_id = gdk_threads_add_idle ((GSourceFunc) result_probe_drain,
+					      model);
+    }
+}
+
+static void
+result_probe_load (result_probe *probe)
+{
+#ifdef WIN32
+  struct _stat32 buf[1];
+#else
+  struct stat buf[1];
+#endif
+  gchar path[PATH_MAX];
+
+  path_copy (probe->id, path, sizeof path);
+  if (g_stat (path, buf) == 0)
+    {
+      probe->size = buf->st_size;
+    }
+
+  if (probe->type == FD_SAME_IMAGE)
+    {
+      GdkPixbufFormat *format;
+
+      format = gdk_pixbuf_get_file_info (path,
+					 &probe->width, &probe->height);
+      if (format)
+	{
+	  probe->format = gdk_pixbuf_format_get_name (format);
+	}
+
+    }
+  else
+    {
+      video_info *info;
+
+      info = video_get_info (path);
+      if (info)
+	{
+	  probe->width = info->size[0];
+	  probe->height = info->size[1];
+	  probe->length = info->length;
+	  probe->format = g_strdup (info->format);
+	  video_info_free (info);
+	}
+    }
+}
+
+static gboolean
+result_probe_drain (ResultModel *model)
+{
+  result_probe *probe;
+
+  /* cleared first, a result pushed after it schedules a new idle */
+  g_atomic_int_set (&model->draining, FALSE);
+
+  while ((probe = g_async_queue_try_pop (model->probed)) != NULL)
+    {
+      result_probe_apply (model, probe);
+      result_probe_free (probe);
+      -- model->probing;
+    }
+
+  if (model->probing == 0 && model->drained)
+    {
+      model->drained (model, model->drained_data);
+    }
+
+  return FALSE;
+}
+
+static void
+result_probe_apply (ResultModel *model, result_probe *probe)
+{
+  file_node *fn;
+  GtkTreePath *tpath;
+  GtkTreeIter itr[1];
+
+  /* the file may be removed or the model cleared since */
+  fn = result_model_lookup (model, probe->type, probe->id);
+  if (fn == NULL || fn->probed)
+    {
+      return;
+    }
+
+  fn->size = probe->size;
+  fn->width = probe->width;
+  fn->height = probe->height;
+  fn->length = probe->length;
+  fn->format = probe->format;
+  probe->format = NULL;
+  fn->probed = TRUE;
+
+  tpath = result_model_get_file_path (model, fn);
+  if (tpath)
+    {
+      if (result_model_get_iter (GTK_TREE_MODEL (model), itr, tpath))
+	{
+	  gtk_tree_model_row_changed (GTK_TREE_MODEL (model), tpath, itr);
+	}
+      gtk_tree_path_free (tpath);
+    }
+}
+
+static void
+result_probe_free (result_probe *probe)
+{
+  g_free (probe->format);
+  g_free (probe);
+}
+
+static void
+file_node_free (file_node *fn)
+{
+  g_free (fn->format);
+  g_free (fn);
+}
+
+static void
+same_node_free (same_node *node)
+{
+  g_slist_foreach (node->files, (GFunc) file_node_free, NULL);
+  g_slist_free (node->files);
+  g_free (node);
+}
+
+/* a binary search of the sorted ids */
+static gboolean
+same_node_wanted (same_node *node, const GArray *ids)
+{
+  guint lo, hi, mid, id;
+
+  if (!node->show || node->files == NULL)
+    {
+      return FALSE;
+    }
+  if (ids == NULL)
+    {
+      return TRUE;
+    }
+
+  lo = 0;
+  hi = ids->len;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      id = g_array_index (ids, guint, mid);
+      if (id == node->id)
+	{
+	  return TRUE;
+	}
+      if (id < node->id)
+	{
+	  lo = mid + 1;
+	}
+      else
+	{
+	  hi = mid;
+	}
+    }
+
+  return FALSE;
+}
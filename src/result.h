@@ -0,0 +1,168 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE result.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_RESULT_H_
+#define _FDUPVES_RESULT_H_
+
+#include "find.h"
+
+#include <gtk/gtk.h>
+
+typedef struct
+{
+  same_type type;
+  GSList *files;
+
+  /* index in ResultModel->groups */
+  guint id;
+
+  /* row in the model, -1 if hidden */
+  gint row;
+
+  gboolean show;
+} same_node;
+
+typedef struct
+{
+  /* same node */
+  same_node *node;
+
+  /* the interned path, see path_copy */
+  fd_path_id id;
+
+  /* FD_IMAGE FD_VIDEO */
+  gint type;
+
+  /* format desc */
+  gchar *format;
+
+  /* file size */
+  gint size;
+
+  /* image/screenshot size */
+  gint width, height;
+
+  /* video length */
+  gdouble length;
+
+  /* bool select */
+  gboolean selected;
+
+  /* size, format... are loaded, see result_model_probe_file */
+  gboolean probed;
+} file_node;
+
+enum
+  {
+    RESULT_COL_PATH,
+    RESULT_COL_IMAGE_SIZE,
+    RESULT_COL_FILE_SIZE,
+    RESULT_COL_LENGTH,
+    RESULT_COL_FORMAT,
+    RESULT_COL_NODE,
+    RESULT_N_COLS,
+  };
+
+/*
+ * A GtkTreeModel over the same groups, the first file of a group is
+ * the top row and the others are its children. The cells are formatted
+ * when the view asks for them.
+ * */
+#define RESULT_TYPE_MODEL (result_model_get_type ())
+#define RESULT_MODEL(o) (G_TYPE_CHECK_INSTANCE_CAST ((o), RESULT_TYPE_MODEL, ResultModel))
+
+typedef struct _ResultModel
+{
+  GObject parent;
+
+  gint stamp;
+
+  /* all the same_node */
+  GPtrArray *groups;
+
+  /* the shown same_node, in the order of their ids */
+  GPtrArray *rows;
+  /* while result_model_refilter moves the rows, rows[gap, gap + gap_len)
+     are not shown, 0 else */
+  guint gap, gap_len;
+
+  /* path id => file_node, one table per same_type */
+  GHashTable *files[FD_SAME_VIDEO_TAIL + 1];
+
+  /* the metadata of the files are loaded by these threads */
+  GThreadPool *probe;
+  GAsyncQueue *probed;
+  volatile gint draining;
+  /* the idle of result_probe_drain while draining is set */
+  guint drain_id;
+
+  /* probes queued and not applied yet, main loop only; drained is
+     called when the last of them is applied */
+  gint probing;
+  void (*drained) (struct _ResultModel *, gpointer);
+  gpointer drained_data;
+} ResultModel;
+
+typedef struct
+{
+  GObjectClass parent_class;
+} ResultModelClass;
+
+GType result_model_get_type ();
+
+ResultModel * result_model_new ();
+
+void result_model_clear (ResultModel *);
+
+same_node * result_model_add_group (ResultModel *, same_type);
+
+file_node * result_model_add_file (ResultModel *, same_node *, fd_path_id);
+
+file_node * result_model_lookup (ResultModel *, same_type, fd_path_id);
+
+/*
+ * the metadata of an added file are loaded in the background and the
+ * row is changed when they are ready, this loads them now.
+ * */
+void result_model_probe_file (ResultModel *, file_node *);
+
+/*
+ * remove the file, and the group if only one file is left. no row
+ * signal is emitted, the view must be detached and the rows refiltered
+ * before it is attached again.
+ * */
+void result_model_remove_file (ResultModel *, file_node *);
+
+/*
+ * show the groups of same_node->show, or only the sorted group ids if
+ * given. the rows which come and go are signaled, a view can stay
+ * attached.
+ * */
+void result_model_refilter (ResultModel *, const GArray *);
+
+GtkTreePath * result_model_get_file_path (ResultModel *, file_node *);
+
+#endif
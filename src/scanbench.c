@@ -0,0 +1,303 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE scanbench.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "fdupves.h"
+#include "ini.h"
+#include "find.h"
+#include "cost.h"
+#include "util.h"
+
+#include <libavformat/avformat.h>
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * fdupves-scanbench: times a cold scan of a corpus written by
+ * fdupves-corpus and scores the pairs found against its truth.tsv.
+ * no cache is loaded, so every file is decoded again.
+ *
+ * the decode time is the sum of the cost records of the scan, the
+ * image loads, video probes and screenshots of all its threads; the
+ * share is of the wall time times the jobs.
+ * */
+
+typedef struct
+{
+  /* path -> group + 1, distractors are 0 */
+  GHashTable *truth;
+  gint64 truth_pairs;
+
+  GArray *images;
+  GArray *videos;
+
+  /* "a\nb" of the pairs found, a < b */
+  GHashTable *found;
+} scanbench;
+
+static gboolean scanbench_json = FALSE;
+static gint scanbench_jobs = 0;
+
+static GOptionEntry scanbench_entries[] =
+  {
+    { "json", 0, 0, G_OPTION_ARG_NONE, &scanbench_json,
+      "Print the result as JSON", NULL },
+    { "jobs", 'j', 0, G_OPTION_ARG_INT, &scanbench_jobs,
+      "Threads of the scan", "N" },
+    { NULL }
+  };
+
+static gboolean scanbench_truth_load (scanbench *, const gchar *);
+static void scanbench_found_cb (const find_step *, gpointer);
+static void scanbench_score (scanbench *, gint64 *, gint64 *);
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *err;
+  scanbench bench[1];
+  gint64 start, scanned, decoded, tp, fp;
+  gdouble threads_s;
+  gdouble scan_s, decode_s, precision, recall;
+  guint files;
+
+#if !GLIB_CHECK_VERSION(2, 32, 0)
+  g_thread_init (NULL);
+#endif
+
+  context = g_option_context_new ("CORPUS - time and score a scan");
+  g_option_context_add_main_entries (context, scanbench_entries, PACKAGE);
+  err = NULL;
+  if (!g_option_context_parse (context, &argc, &argv, &err))
+    {
+      g_printerr ("%s\n", err->message);
+      g_error_free (err);
+      g_option_context_free (context);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (argc != 2)
+    {
+      g_printerr ("No corpus dir given\n");
+      return 1;
+    }
+
+  /* the defaults, not the user configuration, and no cache */
+  av_register_all ();
+  ini_new ();
+  g_ini->proc_image = TRUE;
+  g_ini->proc_video = TRUE;
+  if (scanbench_jobs > 0)
+    {
+      g_ini->jobs = scanbench_jobs;
+    }
+
+  memset (bench, 0, sizeof bench);
+  if (!scanbench_truth_load (bench, argv[1]))
+    {
+      return 1;
+    }
+
+  bench->images = g_array_new (FALSE, FALSE, sizeof (fd_path_id));
+  bench->videos = g_array_new (FALSE, FALSE, sizeof (fd_path_id));
+  bench->found = g_hash_table_new_full (g_str_hash, g_str_equal,
+					g_free, NULL);
+
+  cost_start ();
+  start = g_get_monotonic_time ();
+  find_list (argv[1], bench->images, bench->videos);
+  find_images (bench->images, scanbench_found_cb, bench);
+  find_videos (bench->videos, scanbench_found_cb, bench);
+  scanned = g_get_monotonic_time ();
+  decoded = cost_total ();
+  cost_finish (0, NULL);
+
+  scanbench_score (bench, &tp, &fp);
+
+  files = bench->images->len + bench->videos->len;
+  scan_s = (scanned - start) / 1e6;
+  decode_s = decoded / 1e6;
+  threads_s = scan_s * MAX (g_ini->jobs, 1);
+  precision = tp + fp ? (gdouble) tp / (tp + fp) : 1;
+  recall = bench->truth_pairs ? (gdouble) tp / bench->truth_pairs : 1;
+
+  if (scanbench_json)
+    {
+      printf ("{\"version\":\"%s.%s.%s\",\"images\":%u,\"videos\":%u,"
+	      "\"scan_s\":%.3f,\"files_per_sec\":%.2f,"
+	      "\"decode_s\":%.3f,\"decode_share\":%.3f,"
+	      "\"pairs\":%" G_GINT64_FORMAT ",\"true_pairs\":%" G_GINT64_FORMAT
+	      ",\"false_pairs\":%" G_GINT64_FORMAT ","
+	      "\"precision\":%.4f,\"recall\":%.4f}\n",
+	      PROJECT_MAJOR, PROJECT_MINOR, PROJECT_PATCH,
+	      bench->images->len, bench->videos->len,
+	      scan_s, scan_s > 0 ? files / scan_s : 0,
+	      decode_s, threads_s > 0 ? decode_s / threads_s : 0,
+	      bench->truth_pairs, tp, fp, precision, recall);
+    }
+  else
+    {
+      printf ("files: %u images, %u videos\n",
+	      bench->images->len, bench->videos->len);
+      printf ("scan: %.3f s, %.2f files/s\n",
+	      scan_s, scan_s > 0 ? files / scan_s : 0);
+      printf ("decode: %.3f s in %d jobs, %.1f%% of the scan\n",
+	      decode_s, MAX (g_ini->jobs, 1),
+	      threads_s > 0 ? 100 * decode_s / threads_s : 0);
+      printf ("pairs: %" G_GINT64_FORMAT " found right, %"
+	      G_GINT64_FORMAT " wrong, %" G_GINT64_FORMAT " in truth\n",
+	      tp, fp, bench->truth_pairs);
+      printf ("precision: %.4f, recall: %.4f\n", precision, recall);
+    }
+
+  g_hash_table_destroy (bench->found);
+  g_hash_table_destroy (bench->truth);
+  g_array_free (bench->images, TRUE);
+  g_array_free (bench->videos, TRUE);
+
+  return 0;
+}
+
+static gboolean
+scanbench_truth_load (scanbench *bench, const gchar *dir)
+{
+  GHashTable *sizes;
+  GHashTableIter iter;
+  gpointer value;
+  gchar *file, *content, **lines, **cols;
+  GError *err;
+  gint group, n;
+  int i;
+
+  file = g_build_filename (dir, "truth.tsv", NULL);
+  err = NULL;
+  if (!g_file_get_contents (file, &content, NULL, &err))
+    {
+      g_printerr ("Load: %s failed: %s\n", file, err->message);
+      g_error_free (err);
+      g_free (file);
+      return FALSE;
+    }
+  g_free (file);
+
+  bench->truth = g_hash_table_new_full (g_str_hash, g_str_equal,
+					g_free, NULL);
+  sizes = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  lines = g_strsplit (content, "\n", -1);
+  for (i = 0; lines[i]; ++ i)
+    {
+      cols = g_strsplit (lines[i], "\t", 3);
+      if (g_strv_length (cols) == 3)
+	{
+	  group = atoi (cols[0]);
+	  group = group < 0 ? 0 : group + 1;
+	  g_hash_table_insert (bench->truth,
+			       g_build_filename (dir, cols[2], NULL),
+			       GINT_TO_POINTER (group));
+	  if (group)
+	    {
+	      n = GPOINTER_TO_INT (g_hash_table_lookup (sizes,
+							GINT_TO_POINTER (group)));
+	      g_hash_table_insert (sizes, GINT_TO_POINTER (group),
+				   GINT_TO_POINTER (n + 1));
+	    }
+	}
+      g_strfreev (cols);
+    }
+  g_strfreev (lines);
+  g_free (content);
+
+  bench->truth_pairs = 0;
+  g_hash_table_iter_init (&iter, sizes);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      n = GPOINTER_TO_INT (value);
+      bench->truth_pairs += (gint64) n * (n - 1) / 2;
+    }
+  g_hash_table_destroy (sizes);
+
+  return TRUE;
+}
+
+static void
+scanbench_found_cb (const find_step *step, gpointer arg)
+{
+  scanbench *bench;
+  gchar *key, *afile, *bfile;
+
+  if (!step->found)
+    {
+      return;
+    }
+
+  bench = (scanbench *) arg;
+  afile = path_dup (step->afile);
+  bfile = path_dup (step->bfile);
+  if (strcmp (afile, bfile) < 0)
+    {
+      key = g_strconcat (afile, "\n", bfile, NULL);
+    }
+  else
+    {
+      key = g_strconcat (bfile, "\n", afile, NULL);
+    }
+  g_free (afile);
+  g_free (bfile);
+  /* a pair may be reported by head and by tail */
+  g_hash_table_replace (bench->found, key, NULL);
+}
+
+static void
+scanbench_score (scanbench *bench, gint64 *tp, gint64 *fp)
+{
+  GHashTableIter iter;
+  gpointer key;
+  gchar **files;
+  gint a, b;
+
+  *tp = *fp = 0;
+  g_hash_table_iter_init (&iter, bench->found);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      files = g_strsplit ((const gchar *) key, "\n", 2);
+      a = GPOINTER_TO_INT (g_hash_table_lookup (bench->truth, files[0]));
+      b = GPOINTER_TO_INT (g_hash_table_lookup (bench->truth, files[1]));
+      if (a && a == b)
+	{
+	  ++ *tp;
+	}
+      else
+	{
+	  ++ *fp;
+	}
+      g_strfreev (files);
+    }
+}
@@ -0,0 +1,644 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE server.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "server.h"
+#include "hash.h"
+#include "find.h"
+#include "cache.h"
+#include "ini.h"
+#include "util.h"
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if !defined (WIN32) && GLIB_CHECK_VERSION(2, 32, 0)
+
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifndef FDUPVES_SERVER_BACKLOG
+#define FDUPVES_SERVER_BACKLOG 16
+#endif
+
+/* how often the accept loop looks at the quit flag, in ms. a signal
+   may be taken by any thread, so accept isn't relied on to return */
+#define SERVER_POLL_INTERVAL 200
+
+typedef struct
+{
+  GRWLock lock[1];
+
+  /* path => index + 1 */
+  GHashTable *table;
+  GPtrArray *paths;
+  /* struct server_entry */
+  GArray *hashs;
+} server_index;
+
+/* the hashes of find_images, either may be missing */
+struct server_entry
+{
+  hash_t screen;
+  hash_t phash;
+};
+
+struct server_match
+{
+  int dist;
+  guint index;
+  gchar *path;			/* copied under the lock */
+};
+
+static server_index index_s[1];
+static volatile sig_atomic_t server_quit;
+
+/* the sockets of the running clients, shut down on quit and waited
+   for before the index and the cache go away */
+static GMutex clients_lock[1];
+static GCond clients_cond[1];
+static GArray *clients;
+
+static void server_index_init (server_index *);
+static void server_index_free (server_index *);
+static void server_index_cache (const gchar *, int, int, int, hash_t,
+				server_index *);
+static void server_index_add (server_index *, const gchar *,
+			      const hash_t *, const hash_t *);
+static gboolean server_hash_file (const gchar *, hash_t *, hash_t *);
+static void server_index_query (server_index *, const hash_t *,
+				const hash_t *, const gchar *, FILE *);
+static gpointer server_index_dirs (gchar **);
+static gpointer server_client (gpointer);
+static void server_client_done (int);
+static void server_clients_stop ();
+static gint server_match_cmp (gconstpointer, gconstpointer);
+static void server_on_signal (int);
+
+int
+server_run (const gchar *sockpath, gchar **dirs)
+{
+  struct sockaddr_un addr[1];
+  struct sigaction sa[1];
+  struct pollfd pfd[1];
+  GThread *indexer;
+  int sock, client;
+
+  if (strlen (sockpath) >= sizeof addr->sun_path)
+    {
+      g_warning ("socket path: %s is too long", sockpath);
+      g_strfreev (dirs);
+      return -1;
+    }
+
+  server_index_init (index_s);
+  if (g_cache)
+    {
+      cache_foreach (g_cache, (cache_foreach_func) server_index_cache,
+		     index_s);
+    }
+  g_message (_ ("load %d hash values from cache"), index_s->paths->len);
+
+  sock = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0)
+    {
+      g_warning ("create socket failed: %s", strerror (errno));
+      server_index_free (index_s);
+      g_strfreev (dirs);
+      return -1;
+    }
+
+  memset (addr, 0, sizeof addr);
+  addr->sun_family = AF_UNIX;
+  g_snprintf (addr->sun_path, sizeof addr->sun_path, "%s", sockpath);
+  unlink (sockpath);
+
+  if (bind (sock, (struct sockaddr *) addr, sizeof addr) < 0
+      || listen (sock, FDUPVES_SERVER_BACKLOG) < 0)
+    {
+      g_warning ("listen on: %s failed: %s", sockpath, strerror (errno));
+      close (sock);
+      server_index_free (index_s);
+      g_strfreev (dirs);
+      return -1;
+    }
+
+  /* no SA_RESTART, so accept returns on signals */
+  memset (sa, 0, sizeof sa);
+  sa->sa_handler = server_on_signal;
+  sigemptyset (&sa->sa_mask);
+  sigaction (SIGINT, sa, NULL);
+  sigaction (SIGTERM, sa, NULL);
+  signal (SIGPIPE, SIG_IGN);
+
+  clients = g_array_new (FALSE, FALSE, sizeof (int));
+
+  indexer = NULL;
+  if (dirs && dirs[0])
+    {
+      indexer = g_thread_try_new ("index", (GThreadFunc) server_index_dirs,
+				  dirs, NULL);
+    }
+  if (indexer == NULL)
+    {
+      g_strfreev (dirs);
+    }
+
+  g_message (_ ("listen on: %s"), sockpath);
+  pfd->fd = sock;
+  pfd->events = POLLIN;
+  while (!server_quit)
+    {
+      if (poll (pfd, 1, SERVER_POLL_INTERVAL) <= 0)
+	{
+	  continue;
+	}
+
+      client = accept (sock, NULL, NULL);
+      if (client < 0)
+	{
+	  if (errno != EINTR)
+	    {
+	      g_warning ("accept failed: %s", strerror (errno));
+	    }
+	  continue;
+	}
+
+      g_mutex_lock (clients_lock);
+      g_array_append_val (clients, client);
+      g_mutex_unlock (clients_lock);
+      if (!fd_thread_run ("client", server_client, GINT_TO_POINTER (client)))
+	{
+	  server_client_done (client);
+	  close (client);
+	}
+    }
+
+  close (sock);
+  unlink (sockpath);
+
+  /* nothing may hash or look at the index after this, the caller
+     saves and frees the cache */
+  if (indexer)
+    {
+      g_thread_join (indexer);
+    }
+  server_clients_stop ();
+  g_array_free (clients, TRUE);
+  clients = NULL;
+  server_index_free (index_s);
+
+  return 0;
+}
+
+/* the reads of the clients return at once, they end after the request
+   they are in */
+static void
+server_clients_stop ()
+{
+  guint i;
+
+  g_mutex_lock (clients_lock);
+  for (i = 0; i < clients->len; ++ i)
+    {
+      shutdown (g_array_index (clients, int, i), SHUT_RDWR);
+    }
+  while (clients->len > 0)
+    {
+      g_cond_wait (clients_cond, clients_lock);
+    }
+  g_mutex_unlock (clients_lock);
+}
+
+/* before the socket is closed, so a new client can't get its number */
+static void
+server_client_done (int fd)
+{
+  guint i;
+
+  g_mutex_lock (clients_lock);
+  for (i = 0; i < clients->len; ++ i)
+    {
+      if (g_array_index (clients, int, i) == fd)
+	{
+	  g_array_remove_index_fast (clients, i);
+	  break;
+	}
+    }
+  g_cond_signal (clients_cond);
+  g_mutex_unlock (clients_lock);
+}
+
+static void
+server_on_signal (int sig)
+{
+  server_quit = 1;
+}
+
+static void
+server_index_init (server_index *index)
+{
+  g_rw_lock_init (index->lock);
+  index->table = g_hash_table_new (g_str_hash, g_str_equal);
+  index->paths = g_ptr_array_new_with_free_func (g_free);
+  index->hashs = g_array_new (FALSE, FALSE, sizeof (struct server_entry));
+}
+
+static void
+server_index_free (server_index *index)
+{
+  g_hash_table_destroy (index->table);
+  g_ptr_array_free (index->paths, TRUE);
+  g_array_free (index->hashs, TRUE);
+  g_rw_lock_clear (index->lock);
+}
+
+static void
+server_index_cache (const gchar *file, int off, int alg, int bits, hash_t h,
+		    server_index *index)
+{
+  if (off != 0 || !is_image (file))
+    {
+      return;
+    }
+
+  if (alg == image_screen () && bits == hash_bits (alg))
+    {
+      server_index_add (index, file, &h, NULL);
+    }
+  else if (alg == phash_type ()
+	   && bits == hash_bits (FDUPVES_HASH_PHASH))
+    {
+      server_index_add (index, file, NULL, &h);
+    }
+}
+
+/* a NULL or invalid hash leaves the one in the index */
+static void
+server_index_add (server_index *index, const gchar *file,
+		  const hash_t *screen, const hash_t *phash)
+{
+  struct server_entry *e, ne;
+  gpointer v;
+  gchar *path;
+
+  g_rw_lock_writer_lock (index->lock);
+  v = g_hash_table_lookup (index->table, file);
+  if (v)
+    {
+      e = &g_array_index (index->hashs, struct server_entry,
+			  GPOINTER_TO_UINT (v) - 1);
+    }
+  else
+    {
+      path = g_strdup (file);
+      memset (&ne, 0, sizeof ne);
+      g_ptr_array_add (index->paths, path);
+      g_array_append_val (index->hashs, ne);
+      g_hash_table_insert (index->table, path,
+			   GUINT_TO_POINTER (index->paths->len));
+      e = &g_array_index (index->hashs, struct server_entry,
+			  index->hashs->len - 1);
+    }
+  if (screen && !HASH_IS_NULL (*screen))
+    {
+      e->screen = *screen;
+    }
+  if (phash && !HASH_IS_NULL (*phash))
+    {
+      e->phash = *phash;
+    }
+  g_rw_lock_writer_unlock (index->lock);
+}
+
+/* one decode for both, as ifind_hash */
+static gboolean
+server_hash_file (const gchar *file, hash_t *screen, hash_t *phash)
+{
+  hash_t hashs[FDUPVES_HASH_ALGS_CNT];
+  guint algs;
+  int alg;
+
+  alg = image_screen ();
+  algs = (1u << alg) | (1u << FDUPVES_HASH_PHASH);
+  if ((file_hashes (file, algs, hashs) & algs) != algs)
+    {
+      return FALSE;
+    }
+
+  *screen = hashs[alg];
+  *phash = hashs[FDUPVES_HASH_PHASH];
+
+  return TRUE;
+}
+
+/*
+ * the screen and verify cascade of find_images, the distance is of the
+ * phashes. without a phash, the screen hash alone decides at
+ * same_image_distance.
+ * */
+static void
+server_index_query (server_index *index, const hash_t *screen,
+		    const hash_t *phash, const gchar *self, FILE *out)
+{
+  GArray *matches;
+  struct server_match m;
+  const struct server_entry *entries, *e;
+  hash_t orient[FDUPVES_DIHEDRAL_CNT];
+  hash_cmp_func cmp;
+  guint i;
+  int bits, limit, vlimit, orients, v;
+
+  matches = g_array_new (FALSE, FALSE, sizeof (struct server_match));
+  bits = hash_bits (image_screen ());
+  cmp = hash_cmp_kernel (bits);
+  limit = hash_limit (bits, phash ? g_ini->screen_image_distance
+		      : g_ini->same_image_distance);
+  vlimit = hash_limit (hash_bits (FDUPVES_HASH_PHASH),
+		       g_ini->verify_image_distance);
+
+  /* the rotations and flips of the query, once for all the entries */
+  orients = g_ini->phash_dihedral ? hash_orient_count (bits) : 1;
+  orient[0] = *screen;
+  for (v = 1; v < orients; ++ v)
+    {
+      orient[v] = hash_orient (screen, bits, v);
+    }
+
+  g_rw_lock_reader_lock (index->lock);
+  entries = (const struct server_entry *) index->hashs->data;
+  for (i = 0; i < index->hashs->len; ++ i)
+    {
+      e = entries + i;
+      if (HASH_IS_NULL (e->screen))
+	{
+	  continue;
+	}
+
+      m.dist = cmp (orient, &e->screen);
+      for (v = 1; v < orients && m.dist >= limit; ++ v)
+	{
+	  m.dist = cmp (orient + v, &e->screen);
+	}
+      if (m.dist >= limit)
+	{
+	  continue;
+	}
+
+      if (phash)
+	{
+	  if (HASH_IS_NULL (e->phash))
+	    {
+	      continue;
+	    }
+	  m.dist = image_verify_distance (phash, &e->phash);
+	  if (m.dist >= vlimit)
+	    {
+	      continue;
+	    }
+	}
+
+      m.index = i;
+      m.path = g_ptr_array_index (index->paths, i);
+      if (self && strcmp (m.path, self) == 0)
+	{
+	  continue;
+	}
+      m.path = g_strdup (m.path);
+      g_array_append_val (matches, m);
+    }
+  g_rw_lock_reader_unlock (index->lock);
+
+  /* a slow client must not hold the indexer off */
+  g_array_sort (matches, server_match_cmp);
+  for (i = 0; i < matches->len; ++ i)
+    {
+      m = g_array_index (matches, struct server_match, i);
+      fprintf (out, "%d\t%s\n", m.dist, m.path);
+      g_free (m.path);
+    }
+
+  fprintf (out, "\n");
+  fflush (out);
+
+  g_array_free (matches, TRUE);
+}
+
+static gint
+server_match_cmp (gconstpointer a, gconstpointer b)
+{
+  const struct server_match *ma, *mb;
+
+  ma = a;
+  mb = b;
+  if (ma->dist != mb->dist)
+    {
+      return ma->dist - mb->dist;
+    }
+
+  return ma->index < mb->index ? -1 : ma->index > mb->index;
+}
+
+static gpointer
+server_index_dirs (gchar **dirs)
+{
+  GArray *images, *videos;
+  gchar file[PATH_MAX], *dir;
+  hash_t screen, phash;
+  guint i;
+
+  images = g_array_new (FALSE, FALSE, sizeof (fd_path_id));
+  videos = g_array_new (FALSE, FALSE, sizeof (fd_path_id));
+
+  /* the same paths as a client asks with */
+  for (i = 0; dirs[i] && !server_quit; ++ i)
+    {
+      dir = fd_realpath (dirs[i]);
+      if (dir == NULL)
+	{
+	  g_warning ("directory: %s is not found", dirs[i]);
+	  continue;
+	}
+      find_list (dir, images, videos);
+      g_free (dir);
+    }
+
+  for (i = 0; i < images->len && !server_quit; ++ i)
+    {
+      path_copy (g_array_index (images, fd_path_id, i), file, sizeof file);
+      if (server_hash_file (file, &screen, &phash))
+	{
+	  server_index_add (index_s, file, &screen, &phash);
+	}
+    }
+  g_message (_ ("index %d images"), images->len);
+
+  g_array_free (images, TRUE);
+  g_array_free (videos, TRUE);
+  g_strfreev (dirs);
+
+  return NULL;
+}
+
+static gpointer
+server_client (gpointer arg)
+{
+  FILE *in, *out;
+  gchar line[PATH_MAX + 0x10], *p, *v, *file;
+  int fd;
+  hash_t screen, phash;
+
+  fd = GPOINTER_TO_INT (arg);
+  in = fdopen (fd, "r");
+  out = fdopen (dup (fd), "w");
+  if (in == NULL || out == NULL)
+    {
+      g_warning ("open client stream failed: %s", strerror (errno));
+      server_client_done (fd);
+      if (in)
+	{
+	  fclose (in);
+	}
+      else
+	{
+	  close (fd);
+	}
+      if (out)
+	{
+	  fclose (out);
+	}
+      return NULL;
+    }
+
+  while (fgets (line, sizeof line, in))
+    {
+      if (strchr (line, '\n') == NULL && !feof (in))
+	{
+	  /* longer than any path, drop the rest of the line */
+	  while (fgets (line, sizeof line, in)
+		 && strchr (line, '\n') == NULL)
+	    {
+	    }
+	  fprintf (out, "error request too long\n\n");
+	  fflush (out);
+	  continue;
+	}
+      g_strchomp (line);
+
+      p = strchr (line, ' ');
+      if (p == NULL)
+	{
+	  fprintf (out, "error unknown request\n\n");
+	  fflush (out);
+	  continue;
+	}
+      *p = '\0';
+      v = p + 1;
+
+      if (strcmp (line, "path") == 0 || strcmp (line, "add") == 0)
+	{
+	  /* the index holds the paths as the indexer found them */
+	  file = fd_realpath (v);
+	  if (file == NULL || !g_file_test (file, G_FILE_TEST_IS_REGULAR))
+	    {
+	      g_free (file);
+	      fprintf (out, "error no such file\n\n");
+	      fflush (out);
+	      continue;
+	    }
+
+	  if (!server_hash_file (file, &screen, &phash))
+	    {
+	      g_free (file);
+	      fprintf (out, "error can't hash file\n\n");
+	      fflush (out);
+	      continue;
+	    }
+
+	  /* only add changes the index */
+	  if (line[0] == 'p')
+	    {
+	      server_index_query (index_s, &screen, &phash, file, out);
+	    }
+	  else
+	    {
+	      server_index_add (index_s, file, &screen, &phash);
+	      fprintf (out, "\n");
+	      fflush (out);
+	    }
+	  g_free (file);
+	}
+      else if (strcmp (line, "hash") == 0)
+	{
+	  /* the words of a wider hash are joined by ',', the phash
+	     follows the screen hash after a space */
+	  p = strchr (v, ' ');
+	  if (p)
+	    {
+	      *p ++ = '\0';
+	    }
+	  if (hash_from_string (v, &screen) != hash_bits (image_screen ())
+	      || (p && hash_from_string (p, &phash)
+		  != hash_bits (FDUPVES_HASH_PHASH)))
+	    {
+	      fprintf (out, "error bad hash\n\n");
+	      fflush (out);
+	      continue;
+	    }
+	  server_index_query (index_s, &screen, p ? &phash : NULL, NULL, out);
+	}
+      else
+	{
+	  fprintf (out, "error unknown request\n\n");
+	  fflush (out);
+	}
+    }
+
+  server_client_done (fd);
+  fclose (in);
+  fclose (out);
+
+  return NULL;
+}
+
+#else
+
+int
+server_run (const gchar *sockpath, gchar **dirs)
+{
+  g_warning ("query server is not supported on this platform");
+  g_strfreev (dirs);
+  return -1;
+}
+
+#endif
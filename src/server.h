@@ -0,0 +1,53 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE server.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_SERVER_H_
+#define _FDUPVES_SERVER_H_
+
+#include <glib.h>
+
+/*
+ * Serve near duplicate image queries on a UNIX domain socket.
+ *
+ * Each request is one line, each reply is a list of lines
+ * "<distance>\t<path>" terminated by an empty line:
+ *   path <file>    hash the file, then query, the index is not changed
+ *   hash <screen> [<phash>]
+ *                  query raw hash values, decimal or 0x prefixed hex
+ *   add <file>     hash the file and add it to the index
+ *
+ * A match is screened and verified as find_images does, by the hash of
+ * image_screen and the phash, the distance is of the phashes. A hash
+ * query without the phash is matched by the screen hash alone at
+ * same_image_distance.
+ *
+ * The index is loaded from the cache, the given dirs are added in
+ * background. Returns when SIGINT or SIGTERM is received, after the
+ * indexer and the clients are stopped.
+ * */
+int server_run (const gchar *, gchar **);
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE stats.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "stats.h"
+#include "util.h"
+
+#include <glib.h>
+
+static volatile gssize stats[FD_STAT_CNT];
+
+static gpointer volatile stats_stage;
+
+static volatile gint64 stats_start;
+
+#if !GLIB_CHECK_VERSION(2, 30, 0)
+G_LOCK_DEFINE_STATIC (stats);
+#endif
+
+static const gchar *stats_names[] =
+  {
+    "images",
+    "videos",
+    "cache_hash_hit", "cache_hash_miss", "cache_hash_stale",
+    "cache_phash_hit", "cache_phash_miss", "cache_phash_stale",
+    "cache_dhash_hit", "cache_dhash_miss", "cache_dhash_stale",
+    "cache_dphash_hit", "cache_dphash_miss", "cache_dphash_stale",
+    "hashes",
+    "decodes",
+    "bytes_read",
+    "pairs_compared",
+    "pairs_verified",
+    "pairs_same",
+    "jobs_done",
+    "jobs_queued",
+  };
+
+G_STATIC_ASSERT (G_N_ELEMENTS (stats_names) == FD_STAT_CNT);
+
+void
+stats_add (fd_stat stat, gssize n)
+{
+  if (n == 0)
+    {
+      return;
+    }
+
+#if GLIB_CHECK_VERSION(2, 30, 0)
+  g_atomic_pointer_add (&stats[stat], n);
+#else
+  G_LOCK (stats);
+  stats[stat] += n;
+  G_UNLOCK (stats);
+#endif
+}
+
+gssize
+stats_get (fd_stat stat)
+{
+#if GLIB_CHECK_VERSION(2, 30, 0)
+  return (gssize) g_atomic_pointer_get (&stats[stat]);
+#else
+  gssize n;
+
+  G_LOCK (stats);
+  n = stats[stat];
+  G_UNLOCK (stats);
+
+  return n;
+#endif
+}
+
+void
+stats_reset ()
+{
+  int i;
+
+  for (i = 0; i < FD_STAT_CNT; ++ i)
+    {
+#if GLIB_CHECK_VERSION(2, 30, 0)
+      g_atomic_pointer_set (&stats[i], 0);
+#else
+      G_LOCK (stats);
+      stats[i] = 0;
+      G_UNLOCK (stats);
+#endif
+    }
+
+  stats_set_stage ("idle");
+  stats_start = g_get_monotonic_time ();
+}
+
+void
+stats_set_stage (const gchar *stage)
+{
+  g_atomic_pointer_set (&stats_stage, (gpointer) stage);
+}
+
+const gchar *
+stats_get_stage ()
+{
+  const gchar *stage;
+
+  stage = g_atomic_pointer_get (&stats_stage);
+
+  return stage ? stage : "idle";
+}
+
+gdouble
+stats_elapsed ()
+{
+  return stats_start ? (g_get_monotonic_time () - stats_start) / 1e6 : 0;
+}
+
+gchar *
+stats_to_text (const gchar *sep)
+{
+  GString *text;
+  gssize hit, miss, stale;
+  int alg;
+
+  text = g_string_new (NULL);
+  g_string_append_printf (text, _ ("files: %ld images, %ld videos"),
+			  (long) stats_get (FD_STAT_IMAGES),
+			  (long) stats_get (FD_STAT_VIDEOS));
+
+  for (alg = 0; alg < FDUPVES_HASH_ALGS_CNT; ++ alg)
+    {
+      hit = stats_get (FD_STAT_CACHE (alg, FD_STAT_HIT));
+      miss = stats_get (FD_STAT_CACHE (alg, FD_STAT_MISS));
+      stale = stats_get (FD_STAT_CACHE (alg, FD_STAT_STALE));
+      if (hit + miss + stale == 0)
+	{
+	  continue;
+	}
+      g_string_append (text, sep);
+      g_string_append_printf (text,
+			      _ ("cache %s: %ld hits, %ld misses, %ld stale"
+				 " (%.1f%% hit)"),
+			      hash_phrase[alg], (long) hit, (long) miss,
+			      (long) stale, 100.0 * hit / (hit + miss + stale));
+    }
+
+  g_string_append (text, sep);
+  g_string_append_printf (text, _ ("%ld hashes, %ld decodes, %.1f MB read"),
+			  (long) stats_get (FD_STAT_HASHES),
+			  (long) stats_get (FD_STAT_DECODES),
+			  stats_get (FD_STAT_BYTES) / 1048576.0);
+
+  g_string_append (text, sep);
+  g_string_append_printf (text,
+			  _ ("pairs: %ld compared, %ld verified, %ld same"),
+			  (long) stats_get (FD_STAT_PAIRS_COMPARED),
+			  (long) stats_get (FD_STAT_PAIRS_VERIFIED),
+			  (long) stats_get (FD_STAT_PAIRS_SAME));
+
+  return g_string_free (text, FALSE);
+}
+
+gchar *
+stats_to_json ()
+{
+  GString *json;
+  int i, alg;
+
+  json = g_string_new ("{");
+  for (i = 0; i < FD_STAT_CNT; ++ i)
+    {
+      if (i == FD_STAT_CACHE_FIRST)
+	{
+	  g_string_append (json, "\"cache\":{");
+	  for (alg = 0; alg < FDUPVES_HASH_ALGS_CNT; ++ alg)
+	    {
+	      g_string_append_printf (json,
+				      "%s\"%s\":{\"hit\":%" G_GSSIZE_FORMAT
+				      ",\"miss\":%" G_GSSIZE_FORMAT
+				      ",\"stale\":%" G_GSSIZE_FORMAT "}",
+				      alg ? "," : "", hash_phrase[alg],
+				      stats_get (FD_STAT_CACHE (alg, FD_STAT_HIT)),
+				      stats_get (FD_STAT_CACHE (alg, FD_STAT_MISS)),
+				      stats_get (FD_STAT_CACHE (alg, FD_STAT_STALE)));
+	    }
+	  g_string_append (json, "},");
+	  i = FD_STAT_HASHES - 1;
+	  continue;
+	}
+
+      g_string_append_printf (json, "\"%s\":%" G_GSSIZE_FORMAT "%s",
+			      stats_names[i], stats_get (i),
+			      i + 1 < FD_STAT_CNT ? "," : "");
+    }
+  g_string_append (json, "}");
+
+  return g_string_free (json, FALSE);
+}
@@ -0,0 +1,93 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE stats.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_STATS_H_
+#define _FDUPVES_STATS_H_
+
+#include "hash.h"
+
+#include <glib.h>
+
+/*
+ * counters of a scan, updated from any thread.
+ * */
+typedef enum
+  {
+    FD_STAT_IMAGES,
+    FD_STAT_VIDEOS,
+
+    /* FD_STAT_CACHE (alg, FD_STAT_HIT) ... */
+    FD_STAT_CACHE_FIRST,
+    FD_STAT_HASHES = FD_STAT_CACHE_FIRST + FDUPVES_HASH_ALGS_CNT * 3,
+
+    FD_STAT_DECODES,
+    FD_STAT_BYTES,
+
+    /* hash distance computed, checked by is_video_same, found same */
+    FD_STAT_PAIRS_COMPARED,
+    FD_STAT_PAIRS_VERIFIED,
+    FD_STAT_PAIRS_SAME,
+
+    /* files done by the hash and length jobs, and still queued */
+    FD_STAT_JOBS_DONE,
+    FD_STAT_JOBS_QUEUED,
+
+    FD_STAT_CNT,
+  } fd_stat;
+
+/*
+ * a miss has no entry for the file, a stale entry has the file
+ * but not the seek, e.g. after video_timers changed.
+ * */
+#define FD_STAT_HIT 0
+#define FD_STAT_MISS 1
+#define FD_STAT_STALE 2
+
+#define FD_STAT_CACHE(alg, result) \
+  (FD_STAT_CACHE_FIRST + (alg) * 3 + (result))
+
+void stats_add (fd_stat, gssize);
+
+gssize stats_get (fd_stat);
+
+/* and the stage, the elapsed time */
+void stats_reset ();
+
+/* what the scan does now, a static string */
+void stats_set_stage (const gchar *);
+
+const gchar * stats_get_stage ();
+
+/* seconds since stats_reset */
+gdouble stats_elapsed ();
+
+/* the counters as lines joined by the separator */
+gchar * stats_to_text (const gchar *);
+
+/* {"images":1,...,"cache":{"hash":{"hit":1,...},...},...} */
+gchar * stats_to_json ();
+
+#endif
@@ -0,0 +1,685 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE thumb.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "util.h"
+#include "ini.h"
+#include "image.h"
+#include "video.h"
+#include "thumb.h"
+
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include <string.h>
+
+#ifndef FDUPVES_THUMB_THREADS
+#define FDUPVES_THUMB_THREADS 2
+#endif
+
+/* thumbnails kept in memory */
+#ifndef FDUPVES_THUMB_CACHE
+#define FDUPVES_THUMB_CACHE 64
+#endif
+
+/* trim the disk cache to this percent of the limit */
+#ifndef FDUPVES_THUMB_TRIM
+#define FDUPVES_THUMB_TRIM 90
+#endif
+
+typedef struct
+{
+  gchar *key;
+  gchar *path;
+  gint seek;
+  gint width, height;
+
+  /* requests run before prefetches */
+  gboolean prefetch;
+  guint seq;
+
+  GSList *waiters;
+
+  /* set by the worker */
+  GdkPixbuf *pixbuf;
+} thumb_job;
+
+typedef struct
+{
+  guint id;
+  thumb_ready_cb cb;
+  gpointer arg;
+  thumb_job *job;
+} thumb_waiter;
+
+typedef struct
+{
+  gchar *key;
+  GdkPixbuf *pixbuf;
+  GList *link;
+} thumb_entry;
+
+/* all the state is only touched in the main loop */
+static struct
+{
+  GThreadPool *pool;
+
+  /* key => thumb_job, decoding or queued */
+  GHashTable *jobs;
+
+  /* id => thumb_waiter */
+  GHashTable *waiters;
+
+  /* key => thumb_entry, lru in order */
+  GHashTable *entries;
+  GQueue lru[1];
+
+  guint seq;
+  guint id;
+} thumb[1];
+
+static gboolean thumb_setup ();
+static gchar * thumb_key (const gchar *, gint, gint, gint);
+static thumb_job * thumb_job_get (const gchar *, gint, gint, gint, gboolean);
+static void thumb_job_free (thumb_job *);
+static gint thumb_job_cmp (thumb_job *, thumb_job *, gpointer);
+static void thumb_decode (thumb_job *, gpointer);
+static void thumb_decode_source (thumb_job *);
+static gboolean thumb_done (thumb_job *);
+static GdkPixbuf * thumb_cache_get (const gchar *);
+static void thumb_cache_add (const gchar *, GdkPixbuf *);
+static void thumb_entry_free (thumb_entry *);
+
+typedef struct
+{
+  gchar *file;
+  time_t mtime;
+  goffset size;
+} thumb_disk_file;
+
+static gchar * thumb_disk_uri (thumb_job *);
+static gchar * thumb_disk_name (thumb_job *, const gchar *);
+static GdkPixbuf * thumb_disk_load (const gchar *, const gchar *,
+				    gint64, gint64);
+static void thumb_disk_save (GdkPixbuf *, const gchar *, const gchar *,
+			     gint64, gint64);
+static void thumb_disk_trim (goffset);
+static gint thumb_disk_file_cmp (const thumb_disk_file *,
+				 const thumb_disk_file *);
+
+/* bytes of the disk cache, -1 before it's counted */
+static goffset thumb_disk_total = -1;
+G_LOCK_DEFINE_STATIC (thumb_disk);
+
+guint
+thumb_request (const gchar *path, gint seek, gint width, gint height,
+	       thumb_ready_cb cb, gpointer arg)
+{
+  GdkPixbuf *pixbuf;
+  thumb_job *job;
+  thumb_waiter *waiter;
+  gchar *key;
+
+  g_return_val_if_fail (thumb_setup (), 0);
+
+  key = thumb_key (path, seek, width, height);
+  pixbuf = thumb_cache_get (key);
+  g_free (key);
+  if (pixbuf)
+    {
+      cb (pixbuf, arg);
+      g_object_unref (pixbuf);
+      return 0;
+    }
+
+  job = thumb_job_get (path, seek, width, height, FALSE);
+  g_return_val_if_fail (job, 0);
+
+  waiter = g_malloc0 (sizeof (thumb_waiter));
+  g_return_val_if_fail (waiter, 0);
+
+  waiter->id = ++ thumb->id;
+  waiter->cb = cb;
+  waiter->arg = arg;
+  waiter->job = job;
+  job->waiters = g_slist_prepend (job->waiters, waiter);
+  g_hash_table_insert (thumb->waiters, GUINT_TO_POINTER (waiter->id), waiter);
+
+  return waiter->id;
+}
+
+void
+thumb_cancel (guint id)
+{
+  thumb_waiter *waiter;
+
+  if (id == 0 || thumb->waiters == NULL)
+    {
+      return;
+    }
+
+  waiter = g_hash_table_lookup (thumb->waiters, GUINT_TO_POINTER (id));
+  if (waiter)
+    {
+      /* the job goes on, its result is cached for the next time */
+      g_hash_table_remove (thumb->waiters, GUINT_TO_POINTER (id));
+      waiter->job->waiters = g_slist_remove (waiter->job->waiters, waiter);
+      g_free (waiter);
+    }
+}
+
+void
+thumb_prefetch (const gchar *path, gint seek, gint width, gint height)
+{
+  GdkPixbuf *pixbuf;
+  gchar *key;
+
+  g_return_if_fail (thumb_setup ());
+
+  key = thumb_key (path, seek, width, height);
+  pixbuf = thumb_cache_get (key);
+  g_free (key);
+  if (pixbuf)
+    {
+      g_object_unref (pixbuf);
+      return;
+    }
+
+  thumb_job_get (path, seek, width, height, TRUE);
+}
+
+static gboolean
+thumb_setup ()
+{
+  GError *err;
+
+  if (thumb->pool)
+    {
+      return TRUE;
+    }
+
+  err = NULL;
+  thumb->pool = g_thread_pool_new ((GFunc) thumb_decode, NULL,
+				   FDUPVES_THUMB_THREADS, FALSE, &err);
+  if (thumb->pool == NULL)
+    {
+      g_warning ("create thumbnail threads error: %s", err->message);
+      g_error_free (err);
+      return FALSE;
+    }
+  g_thread_pool_set_sort_function (thumb->pool,
+				   (GCompareDataFunc) thumb_job_cmp, NULL);
+
+  thumb->jobs = g_hash_table_new (g_str_hash, g_str_equal);
+  thumb->waiters = g_hash_table_new (g_direct_hash, g_direct_equal);
+  thumb->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+					  NULL,
+					  (GDestroyNotify) thumb_entry_free);
+  g_queue_init (thumb->lru);
+
+  return TRUE;
+}
+
+static gchar *
+thumb_key (const gchar *path, gint seek, gint width, gint height)
+{
+  return g_strdup_printf ("%d:%dx%d:%s", seek, width, height, path);
+}
+
+static thumb_job *
+thumb_job_get (const gchar *path, gint seek, gint width, gint height,
+	       gboolean prefetch)
+{
+  thumb_job *job;
+  gchar *key;
+
+  key = thumb_key (path, seek, width, height);
+  job = g_hash_table_lookup (thumb->jobs, key);
+  if (job)
+    {
+      g_free (key);
+      if (job->prefetch && !prefetch)
+	{
+	  job->prefetch = FALSE;
+#if GLIB_CHECK_VERSION (2, 46, 0)
+	  g_thread_pool_move_to_front (thumb->pool, job);
+#endif
+	}
+      return job;
+    }
+
+  job = g_malloc0 (sizeof (thumb_job));
+  g_return_val_if_fail (job, NULL);
+
+  job->key = key;
+  job->path = g_strdup (path);
+  job->seek = seek;
+  job->width = width;
+  job->height = height;
+  job->prefetch = prefetch;
+  job->seq = ++ thumb->seq;
+
+  g_hash_table_insert (thumb->jobs, job->key, job);
+  g_thread_pool_push (thumb->pool, job, NULL);
+
+  return job;
+}
+
+static void
+thumb_job_free (thumb_job *job)
+{
+  if (job->pixbuf)
+    {
+      g_object_unref (job->pixbuf);
+    }
+  g_free (job->key);
+  g_free (job->path);
+  g_free (job);
+}
+
+static gint
+thumb_job_cmp (thumb_job *a, thumb_job *b, gpointer unused)
+{
+  if (a->prefetch != b->prefetch)
+    {
+      return a->prefetch ? 1 : -1;
+    }
+
+  /* the newest request first, the user is looking at it */
+  if (!a->prefetch)
+    {
+      return a->seq > b->seq ? -1 : a->seq < b->seq;
+    }
+
+  return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+static void
+thumb_decode (thumb_job *job, gpointer unused)
+{
+  gchar *uri, *name;
+#ifdef WIN32
+  struct _stat32 buf[1];
+#else
+  struct stat buf[1];
+#endif
+
+  uri = name = NULL;
+  if (g_ini->thumb_cache_size > 0 && g_stat (job->path, buf) == 0)
+    {
+      uri = thumb_disk_uri (job);
+      name = thumb_disk_name (job, uri);
+      job->pixbuf = thumb_disk_load (name, uri,
+				     buf->st_mtime, buf->st_size);
+    }
+
+  if (job->pixbuf == NULL)
+    {
+      thumb_decode_source (job);
+
+      if (name && job->pixbuf)
+	{
+	  thumb_disk_save (job->pixbuf, name, uri,
+			   buf->st_mtime, buf->st_size);
+	}
+    }
+  g_free (uri);
+  g_free (name);
+
+  gdk_threads_add_idle ((GSourceFunc) thumb_done, job);
+}
+
+static void
+thumb_decode_source (thumb_job *job)
+{
+  GError *err;
+
+  if (job->seek < 0)
+    {
+      err = NULL;
+      job->pixbuf = fdupves_gdkpixbuf_load_file_at_size (job->path,
+							 job->width,
+							 job->height,
+							 &err);
+      if (err)
+	{
+	  g_warning ("load image: %s error: %s", job->path, err->message);
+	  g_error_free (err);
+	}
+    }
+  else
+    {
+      job->pixbuf = video_time_screenshot_pixbuf (job->path, job->seek,
+						  job->width, job->height);
+    }
+}
+
+static gboolean
+thumb_done (thumb_job *job)
+{
+  GSList *cur;
+  thumb_waiter *waiter;
+
+  g_hash_table_remove (thumb->jobs, job->key);
+
+  if (job->pixbuf)
+    {
+      thumb_cache_add (job->key, job->pixbuf);
+    }
+
+  for (cur = job->waiters; cur; cur = g_slist_next (cur))
+    {
+      waiter = cur->data;
+
+      g_hash_table_remove (thumb->waiters, GUINT_TO_POINTER (waiter->id));
+      waiter->cb (job->pixbuf, waiter->arg);
+      g_free (waiter);
+    }
+  g_slist_free (job->waiters);
+
+  thumb_job_free (job);
+
+  return FALSE;
+}
+
+static GdkPixbuf *
+thumb_cache_get (const gchar *key)
+{
+  thumb_entry *entry;
+
+  entry = g_hash_table_lookup (thumb->entries, key);
+  if (entry == NULL)
+    {
+      return NULL;
+    }
+
+  g_queue_unlink (thumb->lru, entry->link);
+  g_queue_push_tail_link (thumb->lru, entry->link);
+
+  return g_object_ref (entry->pixbuf);
+}
+
+static void
+thumb_cache_add (const gchar *key, GdkPixbuf *pixbuf)
+{
+  thumb_entry *entry;
+
+  if (g_hash_table_lookup (thumb->entries, key))
+    {
+      return;
+    }
+
+  while (thumb->lru->length >= FDUPVES_THUMB_CACHE)
+    {
+      entry = g_queue_peek_head (thumb->lru);
+      g_hash_table_remove (thumb->entries, entry->key);
+    }
+
+  entry = g_malloc0 (sizeof (thumb_entry));
+  g_return_if_fail (entry);
+
+  entry->key = g_strdup (key);
+  entry->pixbuf = g_object_ref (pixbuf);
+  g_queue_push_tail (thumb->lru, entry);
+  entry->link = g_queue_peek_tail_link (thumb->lru);
+
+  g_hash_table_insert (thumb->entries, entry->key, entry);
+}
+
+static void
+thumb_entry_free (thumb_entry *entry)
+{
+  g_queue_delete_link (thumb->lru, entry->link);
+  g_object_unref (entry->pixbuf);
+  g_free (entry->key);
+  g_free (entry);
+}
+
+/*
+ * the disk cache follows the freedesktop thumbnail layout:
+ * <thumb_dir>/<width>x<height>/<md5 of the uri>.png, with Thumb::URI,
+ * Thumb::MTime and Thumb::Size of the source file. a video frame has
+ * the time as a media fragment in its uri, file:///a.mp4#t=60.
+ * */
+static gchar *
+thumb_disk_uri (thumb_job *job)
+{
+  gchar *uri, *furi;
+
+  uri = g_filename_to_uri (job->path, NULL, NULL);
+  if (uri == NULL || job->seek < 0)
+    {
+      return uri;
+    }
+
+  furi = g_strdup_printf ("%s#t=%d", uri, job->seek);
+  g_free (uri);
+
+  return furi;
+}
+
+static gchar *
+thumb_disk_name (thumb_job *job, const gchar *uri)
+{
+  gchar *md5, *base, *size, *name;
+
+  if (uri == NULL)
+    {
+      return NULL;
+    }
+
+  md5 = g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+  base = g_strconcat (md5, ".png", NULL);
+  size = g_strdup_printf ("%dx%d", job->width, job->height);
+  name = g_build_filename (g_ini->thumb_dir, size, base, NULL);
+  g_free (size);
+  g_free (base);
+  g_free (md5);
+
+  return name;
+}
+
+static GdkPixbuf *
+thumb_disk_load (const gchar *name, const gchar *uri,
+		 gint64 mtime, gint64 size)
+{
+  GdkPixbuf *pixbuf;
+  const gchar *turi, *tmtime, *tsize;
+
+  if (name == NULL)
+    {
+      return NULL;
+    }
+
+  pixbuf = gdk_pixbuf_new_from_file (name, NULL);
+  if (pixbuf == NULL)
+    {
+      return NULL;
+    }
+
+  turi = gdk_pixbuf_get_option (pixbuf, "tEXt::Thumb::URI");
+  tmtime = gdk_pixbuf_get_option (pixbuf, "tEXt::Thumb::MTime");
+  tsize = gdk_pixbuf_get_option (pixbuf, "tEXt::Thumb::Size");
+  if (turi == NULL || strcmp (turi, uri) != 0
+      || tmtime == NULL || g_ascii_strtoll (tmtime, NULL, 10) != mtime
+      || tsize == NULL || g_ascii_strtoll (tsize, NULL, 10) != size)
+    {
+      /* the file was changed, thumb_disk_save will replace it */
+      g_object_unref (pixbuf);
+      return NULL;
+    }
+
+  /* the mtime of a thumbnail is its last use, see thumb_disk_trim */
+  g_utime (name, NULL);
+
+  return pixbuf;
+}
+
+static void
+thumb_disk_save (GdkPixbuf *pixbuf, const gchar *name, const gchar *uri,
+		 gint64 mtime, gint64 size)
+{
+  gchar *dir, *tmp, smtime[0x20], ssize[0x20];
+  GError *err;
+  goffset limit;
+#ifdef WIN32
+  struct _stat32 tbuf[1];
+#else
+  struct stat tbuf[1];
+#endif
+
+  dir = g_path_get_dirname (name);
+  if (g_mkdir_with_parents (dir, 0700) != 0)
+    {
+      g_warning ("create thumbnail dir: %s failed", dir);
+      g_free (dir);
+      return;
+    }
+  g_free (dir);
+
+  g_snprintf (smtime, sizeof smtime, "%" G_GINT64_FORMAT, mtime);
+  g_snprintf (ssize, sizeof ssize, "%" G_GINT64_FORMAT, size);
+
+  /* written aside and renamed, a reader never sees a partial file */
+  tmp = g_strdup_printf ("%s.%u.tmp", name, g_random_int ());
+  err = NULL;
+  gdk_pixbuf_save (pixbuf, tmp, "png", &err,
+		   "tEXt::Thumb::URI", uri,
+		   "tEXt::Thumb::MTime", smtime,
+		   "tEXt::Thumb::Size", ssize,
+		   "tEXt::Software", PACKAGE_STRING,
+		   NULL);
+  if (err)
+    {
+      g_warning ("save thumbnail: %s error: %s", tmp, err->message);
+      g_error_free (err);
+      g_unlink (tmp);
+      g_free (tmp);
+      return;
+    }
+  if (g_rename (tmp, name) != 0)
+    {
+      g_unlink (tmp);
+      g_free (tmp);
+      return;
+    }
+  g_free (tmp);
+
+  limit = (goffset) g_ini->thumb_cache_size * 1024 * 1024;
+
+  G_LOCK (thumb_disk);
+  if (thumb_disk_total >= 0 && g_stat (name, tbuf) == 0)
+    {
+      thumb_disk_total += tbuf->st_size;
+    }
+  if (thumb_disk_total < 0 || thumb_disk_total > limit)
+    {
+      thumb_disk_trim (limit);
+    }
+  G_UNLOCK (thumb_disk);
+}
+
+/* count the cache and remove the least recently used, with the lock */
+static void
+thumb_disk_trim (goffset limit)
+{
+  GDir *top, *sub;
+  const gchar *tname, *sname;
+  gchar *dir;
+  GArray *files;
+  thumb_disk_file file[1];
+  goffset total;
+  guint i;
+#ifdef WIN32
+  struct _stat32 buf[1];
+#else
+  struct stat buf[1];
+#endif
+
+  top = g_dir_open (g_ini->thumb_dir, 0, NULL);
+  if (top == NULL)
+    {
+      thumb_disk_total = 0;
+      return;
+    }
+
+  files = g_array_new (FALSE, FALSE, sizeof (thumb_disk_file));
+  total = 0;
+  while ((tname = g_dir_read_name (top)) != NULL)
+    {
+      dir = g_build_filename (g_ini->thumb_dir, tname, NULL);
+      sub = g_dir_open (dir, 0, NULL);
+      if (sub == NULL)
+	{
+	  g_free (dir);
+	  continue;
+	}
+
+      while ((sname = g_dir_read_name (sub)) != NULL)
+	{
+	  file->file = g_build_filename (dir, sname, NULL);
+	  if (!g_str_has_suffix (sname, ".png")
+	      || g_stat (file->file, buf) != 0)
+	    {
+	      g_free (file->file);
+	      continue;
+	    }
+	  file->mtime = buf->st_mtime;
+	  file->size = buf->st_size;
+	  total += file->size;
+	  g_array_append_val (files, file[0]);
+	}
+      g_dir_close (sub);
+      g_free (dir);
+    }
+  g_dir_close (top);
+
+  if (total > limit)
+    {
+      g_array_sort (files, (GCompareFunc) thumb_disk_file_cmp);
+      for (i = 0;
+	   i < files->len && total > limit / 100 * FDUPVES_THUMB_TRIM;
+	   ++ i)
+	{
+	  if (g_unlink (g_array_index (files, thumb_disk_file, i).file) == 0)
+	    {
+	      total -= g_array_index (files, thumb_disk_file, i).size;
+	    }
+	}
+    }
+
+  for (i = 0; i < files->len; ++ i)
+    {
+      g_free (g_array_index (files, thumb_disk_file, i).file);
+    }
+  g_array_free (files, TRUE);
+
+  thumb_disk_total = total;
+}
+
+static gint
+thumb_disk_file_cmp (const thumb_disk_file *a, const thumb_disk_file *b)
+{
+  return a->mtime < b->mtime ? -1 : a->mtime > b->mtime;
+}
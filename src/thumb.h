@@ -0,0 +1,51 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE thumb.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_THUMB_H_
+#define _FDUPVES_THUMB_H_
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+/*
+ * background thumbnail loader, the callback is called in the main loop
+ * with a pixbuf it doesn't own, NULL if the file can't be decoded.
+ * */
+typedef void (*thumb_ready_cb) (GdkPixbuf *, gpointer);
+
+/*
+ * seek is the time of the video frame, -1 for an image.
+ * returns 0 if the thumbnail was cached and the callback already called,
+ * or an id for thumb_cancel.
+ * */
+guint thumb_request (const gchar *, gint, gint, gint,
+		     thumb_ready_cb, gpointer);
+
+void thumb_cancel (guint);
+
+/* load it with a lower priority, for a thumb_request later */
+void thumb_prefetch (const gchar *, gint, gint, gint);
+
+#endif
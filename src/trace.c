@@ -0,0 +1,277 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE trace.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "trace.h"
+#include "util.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+/* events of a thread, the oldest are overwritten */
+#define TRACE_RING_SIZE 8192
+
+#define TRACE_ARG_LEN 112
+
+typedef struct
+{
+  const gchar *name;
+  gint64 ts;
+  gint64 dur;
+  gchar arg[TRACE_ARG_LEN];
+} trace_event;
+
+typedef struct
+{
+  gint tid;
+  gchar *thread;
+
+  /* written by the owner thread only */
+  guint64 count;
+  trace_event events[TRACE_RING_SIZE];
+} trace_ring;
+
+volatile gint g_trace_on;
+
+static gint64 trace_base;
+
+/*
+ * all the rings, they live as long as the process. the ring of an
+ * ended thread goes to trace_idle and the next new thread appends to
+ * it, so there are only as many rings as threads ever ran at once and
+ * the events of the ended thread are kept until overwritten.
+ * */
+static GPtrArray *trace_rings;
+static GSList *trace_idle;
+G_LOCK_DEFINE_STATIC (trace_rings);
+
+static void trace_ring_release (gpointer);
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+static GPrivate trace_key = G_PRIVATE_INIT (trace_ring_release);
+#else
+static GStaticPrivate trace_key = G_STATIC_PRIVATE_INIT;
+#endif
+
+static trace_ring * trace_ring_get ();
+static void trace_event_write (FILE *, const trace_ring *,
+			       const trace_event *, gboolean);
+
+void
+trace_add (gint64 start, const gchar *name, const gchar *arg)
+{
+  trace_ring *ring;
+  trace_event *event;
+  gint64 now;
+  gsize len;
+
+  now = g_get_monotonic_time ();
+  ring = trace_ring_get ();
+  if (ring == NULL)
+    {
+      return;
+    }
+
+  event = ring->events + ring->count % TRACE_RING_SIZE;
+  event->name = name;
+  event->ts = start - trace_base;
+  event->dur = now - start;
+  if (arg)
+    {
+      /* the tail of a long path, from a utf-8 char */
+      len = strlen (arg);
+      if (len >= sizeof event->arg)
+	{
+	  arg += len - (sizeof event->arg - 1);
+	  while (((guchar) *arg & 0xc0) == 0x80)
+	    {
+	      ++ arg;
+	    }
+	}
+      g_strlcpy (event->arg, arg, sizeof event->arg);
+    }
+  else
+    {
+      event->arg[0] = '\0';
+    }
+  ++ ring->count;
+}
+
+void
+trace_start ()
+{
+  guint i;
+
+  G_LOCK (trace_rings);
+  if (trace_rings == NULL)
+    {
+      trace_rings = g_ptr_array_new ();
+    }
+  for (i = 0; i < trace_rings->len; ++ i)
+    {
+      ((trace_ring *) g_ptr_array_index (trace_rings, i))->count = 0;
+    }
+  trace_base = g_get_monotonic_time ();
+  G_UNLOCK (trace_rings);
+
+  g_atomic_int_set (&g_trace_on, TRUE);
+}
+
+void
+trace_stop ()
+{
+  g_atomic_int_set (&g_trace_on, FALSE);
+}
+
+/* stop the trace before, an event being written may come out torn */
+gboolean
+trace_save (const gchar *file)
+{
+  FILE *fp;
+  trace_ring *ring;
+  gchar *name;
+  guint i;
+  guint64 j, first;
+  gboolean comma;
+
+  fp = g_fopen (file, "w");
+  if (fp == NULL)
+    {
+      g_warning (_ ("Open trace file: %s failed"), file);
+      return FALSE;
+    }
+
+  fprintf (fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  comma = FALSE;
+
+  G_LOCK (trace_rings);
+  for (i = 0; trace_rings && i < trace_rings->len; ++ i)
+    {
+      ring = g_ptr_array_index (trace_rings, i);
+
+      name = fd_json_quote (ring->thread);
+      fprintf (fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\","
+	       "\"pid\":1,\"tid\":%d,\"args\":{\"name\":%s}}",
+	       comma ? "," : "", ring->tid, name);
+      g_free (name);
+      comma = TRUE;
+
+      first = ring->count > TRACE_RING_SIZE ?
+	ring->count - TRACE_RING_SIZE : 0;
+      for (j = first; j < ring->count; ++ j)
+	{
+	  trace_event_write (fp, ring,
+			     ring->events + j % TRACE_RING_SIZE, comma);
+	}
+    }
+  G_UNLOCK (trace_rings);
+
+  fprintf (fp, "\n]}\n");
+
+  return fclose (fp) == 0;
+}
+
+static trace_ring *
+trace_ring_get ()
+{
+  trace_ring *ring;
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+  ring = g_private_get (&trace_key);
+#else
+  ring = g_static_private_get (&trace_key);
+#endif
+  if (ring)
+    {
+      return ring;
+    }
+
+  G_LOCK (trace_rings);
+  if (trace_idle)
+    {
+      ring = trace_idle->data;
+      trace_idle = g_slist_delete_link (trace_idle, trace_idle);
+    }
+  else
+    {
+      ring = g_try_new (trace_ring, 1);
+      if (ring)
+	{
+	  if (trace_rings == NULL)
+	    {
+	      trace_rings = g_ptr_array_new ();
+	    }
+	  ring->count = 0;
+	  ring->tid = trace_rings->len + 1;
+	  ring->thread = g_strdup_printf ("thread %d", ring->tid);
+	  g_ptr_array_add (trace_rings, ring);
+	}
+    }
+  G_UNLOCK (trace_rings);
+  if (ring == NULL)
+    {
+      return NULL;
+    }
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+  g_private_set (&trace_key, ring);
+#else
+  g_static_private_set (&trace_key, ring, trace_ring_release);
+#endif
+
+  return ring;
+}
+
+/* the thread ended, its ring goes to the next new thread */
+static void
+trace_ring_release (gpointer ring)
+{
+  G_LOCK (trace_rings);
+  trace_idle = g_slist_prepend (trace_idle, ring);
+  G_UNLOCK (trace_rings);
+}
+
+static void
+trace_event_write (FILE *fp, const trace_ring *ring,
+		   const trace_event *event, gboolean comma)
+{
+  gchar *name, *arg;
+
+  name = fd_json_quote (event->name);
+  fprintf (fp, "%s\n{\"name\":%s,\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+	   "\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT,
+	   comma ? "," : "", name, ring->tid, event->ts, event->dur);
+  g_free (name);
+
+  if (event->arg[0])
+    {
+      arg = fd_json_quote (event->arg);
+      fprintf (fp, ",\"args\":{\"file\":%s}", arg);
+      g_free (arg);
+    }
+  fprintf (fp, "}");
+}
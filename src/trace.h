@@ -0,0 +1,65 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE trace.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_TRACE_H_
+#define _FDUPVES_TRACE_H_
+
+#include <glib.h>
+
+/*
+ * scoped trace points, kept in per-thread rings and saved as chrome
+ * trace-event json (chrome://tracing, ui.perfetto.dev).
+ *
+ *   gint64 t;
+ *   t = trace_begin ();
+ *   ...
+ *   trace_end (t, "decode", file);
+ *
+ * the name must be a static string. when tracing is off trace_begin
+ * is a load of g_trace_on and trace_end a test of 0.
+ * */
+extern volatile gint g_trace_on;
+
+#define trace_begin() \
+  (G_UNLIKELY (g_trace_on) ? g_get_monotonic_time () : 0)
+
+#define trace_end(start, name, arg) G_STMT_START {	\
+    if (G_UNLIKELY (start))				\
+      {							\
+	trace_add ((start), (name), (arg));		\
+      }							\
+  } G_STMT_END
+
+void trace_add (gint64, const gchar *, const gchar *);
+
+/* clear the rings and switch the trace points on */
+void trace_start ();
+
+void trace_stop ();
+
+gboolean trace_save (const gchar *);
+
+#endif
@@ -36,6 +36,10 @@
 #define PATH_MAX        4096
 #endif
 
+#ifndef FDUPVES_THREAD_STACK_SIZE
+#define FDUPVES_THREAD_STACK_SIZE (1024 * 1024 * 10)
+#endif
+
 gchar *
 fd_realpath (const gchar *path)
 {
@@ -139,3 +143,72 @@ is_video (const gchar *path)
 
   return 0;
 }
+
+gchar *
+fd_json_quote (const gchar *str)
+{
+  GString *out;
+  const gchar *p;
+
+  out = g_string_sized_new (strlen (str) + 2);
+  g_string_append_c (out, '"');
+  for (p = str; *p; ++ p)
+    {
+      switch (*p)
+	{
+	case '"':
+	  g_string_append (out, "\\\"");
+	  break;
+
+	case '\\':
+	  g_string_append (out, "\\\\");
+	  break;
+
+	case '\n':
+	  g_string_append (out, "\\n");
+	  break;
+
+	case '\t':
+	  g_string_append (out, "\\t");
+	  break;
+
+	default:
+	  if ((guchar) *p < 0x20)
+	    {
+	      g_string_append_printf (out, "\\u%04x", (guchar) *p);
+	    }
+	  else
+	    {
+	      g_string_append_c (out, *p);
+	    }
+	  break;
+	}
+    }
+  g_string_append_c (out, '"');
+
+  return g_string_free (out, FALSE);
+}
+
+gboolean
+fd_thread_run (const gchar *name, GThreadFunc func, gpointer data)
+{
+  GThread *th;
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+  th = g_thread_try_new (name, func, data, NULL);
+  if (th)
+    {
+      g_thread_unref (th);
+    }
+#else
+  th = g_thread_create_full (func,
+			     data,
+			     FDUPVES_THREAD_STACK_SIZE,
+			     FALSE,
+			     FALSE,
+			     0,
+			     NULL);
+#endif
+
+  return th != NULL;
+}
@@ -28,8 +28,6 @@
 #ifndef _FDUPVES_UTIL_H_
 #define _FDUPVES_UTIL_H_
 
-#include <gtk/gtk.h>
-
 #include <libintl.h>
 #include <glib.h>
 
@@ -64,4 +62,11 @@ int is_image (const char *);
 
 int is_video (const gchar *);
 
+gchar * fd_json_quote (const gchar *);
+
+/*
+ * start a detached thread
+ * */
+gboolean fd_thread_run (const gchar *, GThreadFunc, gpointer);
+
 #endif
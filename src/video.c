@@ -26,6 +26,9 @@
 
 #include "video.h"
 #include "util.h"
+#include "trace.h"
+#include "cost.h"
+#include "stats.h"
 
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
@@ -36,6 +39,9 @@
 
 #include <glib.h>
 
+static void video_cost (gint64, const char *, AVFormatContext *,
+			int, enum AVCodecID);
+
 video_info *
 video_get_info (const char *file)
 {
@@ -43,7 +49,9 @@ video_get_info (const char *file)
   AVFormatContext *fmt_ctx = NULL;
   AVStream *stream = NULL;
   int i, s, ret;
+  gint64 c;
 
+  c = cost_begin ();
   ret = avformat_open_input (&fmt_ctx, file, NULL, NULL);
   if (ret != 0)
     {
@@ -54,6 +62,7 @@ video_get_info (const char *file)
   if (avformat_find_stream_info (fmt_ctx, NULL) < 0)
     {
       g_warning (_ ("could not find stream infomations: %s"), file);
+      video_cost (c, file, fmt_ctx, 0, AV_CODEC_ID_NONE);
       avformat_close_input (&fmt_ctx);
       return NULL;
     }
@@ -70,6 +79,7 @@ video_get_info (const char *file)
   if (s == -1)
     {
       g_warning (_ ("could not find video stream: %s"), file);
+      video_cost (c, file, fmt_ctx, 0, AV_CODEC_ID_NONE);
       avformat_close_input (&fmt_ctx);
       return NULL;
     }
@@ -92,6 +102,7 @@ video_get_info (const char *file)
   info->size[1] = stream->codec->height;
   info->format = avcodec_get_name (stream->codec->codec_id);
 
+  video_cost (c, file, fmt_ctx, 0, stream->codec->codec_id);
   avformat_close_input (&fmt_ctx);
 
   return info;
@@ -110,9 +121,12 @@ video_get_length (const char *file)
 {
   video_info *info;
   int length;
+  gint64 t;
 
   length = 0;
+  t = trace_begin ();
   info = video_get_info (file);
+  trace_end (t, "probe", file);
   if (info)
     {
       length = (int) info->length;
@@ -133,21 +147,28 @@ video_time_screenshot (const char *file, int time,
   AVFrame *frame,*frame_rgb;
   AVPacket *packet;
   struct SwsContext *img_convert_ctx = NULL;
-  int s, i, bytes, finished;
+  int s, i, bytes, finished, decodes;
   int64_t seek_target;
+  gint64 t, c;
 
+  c = cost_begin ();
+  t = trace_begin ();
   if (avformat_open_input (&format_ctx, file, NULL, NULL) != 0)
     {
+      trace_end (t, "open", file);
       g_warning (_ ("could not open: %s"), file);
       return -1;
     }
 
   if (avformat_find_stream_info (format_ctx, NULL) < 0)
     {
+      trace_end (t, "open", file);
       g_warning (_ ("could not find stream infomations: %s"), file);
+      video_cost (c, file, format_ctx, 0, AV_CODEC_ID_NONE);
       avformat_close_input (&format_ctx);
       return -1;
     }
+  trace_end (t, "open", file);
 
   s = -1;
   for (i=0; i < (int) format_ctx->nb_streams; i++)
@@ -162,6 +183,7 @@ video_time_screenshot (const char *file, int time,
   if (s == -1)
     {
       g_warning (_ ("could not find video stream: %s"), file);
+      video_cost (c, file, format_ctx, 0, AV_CODEC_ID_NONE);
       avformat_close_input (&format_ctx);
       return -1;
     }
@@ -172,6 +194,7 @@ video_time_screenshot (const char *file, int time,
 
   if (codec == NULL)
     {
+      video_cost (c, file, format_ctx, 0, codec_ctx->codec_id);
       avformat_close_input (&format_ctx);
       g_warning (_ ("Unsupported codec: %s"), file);
       return -1;
@@ -215,9 +238,11 @@ video_time_screenshot (const char *file, int time,
   seek_target = av_rescale (time,
 			    format_ctx->streams[s]->time_base.den,
 			    format_ctx->streams[s]->time_base.num);
+  t = trace_begin ();
   avformat_seek_file (format_ctx, s,
 		      0, seek_target, seek_target,
 		      AVSEEK_FLAG_FRAME);
+  trace_end (t, "seek", file);
 
   packet = av_packet_alloc ();
   if (packet == NULL)
@@ -229,6 +254,8 @@ video_time_screenshot (const char *file, int time,
       return -1;
     }
 
+  decodes = 0;
+  t = trace_begin ();
   while (av_read_frame (format_ctx, packet) >= 0)
     {
       if (packet->stream_index != s)
@@ -238,6 +265,7 @@ video_time_screenshot (const char *file, int time,
 	}
 
       avcodec_decode_video2 (codec_ctx, frame, &finished, packet);
+      ++ decodes;
       if (!finished)
         {
           av_packet_unref (packet);
@@ -284,6 +312,7 @@ video_time_screenshot (const char *file, int time,
       sws_freeContext (img_convert_ctx);
       break;
     }
+  trace_end (t, "decode", file);
 
   av_packet_free (&packet);
   av_free (frame_rgb);
@@ -291,29 +320,28 @@ video_time_screenshot (const char *file, int time,
 
   avcodec_close (codec_ctx);
 
+  video_cost (c, file, format_ctx, decodes, codec_ctx->codec_id);
   avformat_close_input (&format_ctx);
 
   return bytes;
 }
 
-int
-video_time_screenshot_file (const char *file, int time,
-			    int width, int height,
-			    const char *out_file)
+GdkPixbuf *
+video_time_screenshot_pixbuf (const char *file, int time,
+			      int width, int height)
 {
   char *buf;
   int len;
   GdkPixbuf *pix;
-  GError *err;
 
   buf = g_malloc (width * height * 3);
-  g_return_val_if_fail (buf, -1);
+  g_return_val_if_fail (buf, NULL);
 
   len = video_time_screenshot (file, time, width, height, buf, width * height * 3);
   if (len <= 0)
     {
       g_free (buf);
-      return -1;
+      return NULL;
     }
 
   pix = gdk_pixbuf_new_from_data ((guchar *) buf,
@@ -323,21 +351,53 @@ video_time_screenshot_file (const char *file, int time,
 				  width,
 				  height,
 				  width * 3,
-				  NULL,
+				  (GdkPixbufDestroyNotify) g_free,
 				  NULL);
-  if (pix)
+  if (pix == NULL)
     {
-      err = NULL;
-      gdk_pixbuf_save (pix, out_file, "jpeg", &err, "quality", "100", NULL);
-      if (err)
-	{
-	  g_free (buf);
-	  g_warning ("%s: %s", file, err->message);
-	  g_error_free (err);
-	  return -1;
-	}
+      g_free (buf);
+    }
+
+  return pix;
+}
+
+int
+video_time_screenshot_file (const char *file, int time,
+			    int width, int height,
+			    const char *out_file)
+{
+  GdkPixbuf *pix;
+  GError *err;
+
+  pix = video_time_screenshot_pixbuf (file, time, width, height);
+  if (pix == NULL)
+    {
+      return -1;
+    }
+
+  err = NULL;
+  gdk_pixbuf_save (pix, out_file, "jpeg", &err, "quality", "100", NULL);
+  g_object_unref (pix);
+  if (err)
+    {
+      g_warning ("%s: %s", file, err->message);
+      g_error_free (err);
+      return -1;
     }
-  g_free (buf);
 
   return 0;
 }
+
+/* for the statistics and the cost report, before the format is closed */
+static void
+video_cost (gint64 start, const char *file, AVFormatContext *format_ctx,
+	    int decodes, enum AVCodecID id)
+{
+  gint64 bytes;
+
+  bytes = format_ctx->pb ? format_ctx->pb->bytes_read : 0;
+  stats_add (FD_STAT_DECODES, decodes);
+  stats_add (FD_STAT_BYTES, (gssize) bytes);
+
+  cost_end (start, file, bytes, decodes, avcodec_get_name (id));
+}
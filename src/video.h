@@ -27,6 +27,8 @@
 #ifndef _FDUPVES_VIDEO_H_
 #define _FDUPVES_VIDEO_H_
 
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
 typedef struct
 {
   /* filename */
@@ -55,6 +57,9 @@ int video_time_screenshot (const char *file, int time,
 			   int width, int height,
 			   char *buffer, int buf_len);
 
+GdkPixbuf * video_time_screenshot_pixbuf (const char *file, int time,
+					 int width, int height);
+
 int video_time_screenshot_file (const char *file, int time,
 				int width, int height,
 				const char *out_file);